@@ -0,0 +1,100 @@
+#!/usr/bin/env python
+#
+#   This file is part of python-dmidecode.
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+"""
+Benchmark of the public python-dmidecode API over a set of dump files.
+
+Every group function and every DMI type is timed through the dict API
+(phase "query") and through the XML API (phase "xmlapi").  Results are
+written to stdout as one JSON object per line, with the keys of the
+bench_decode C harness except "allocs".  Allocations made during a call are
+not visible from Python, "retained_blocks" is instead the number of Python
+memory blocks still allocated after the call, i.e. the size of the returned
+data.
+"""
+
+import os, sys, json, time
+from getopt import getopt
+
+# Use the module from the build dir, like unit-tests/unit does
+TOPDIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+if os.path.isdir(os.path.join(TOPDIR, "build")):
+    for d in os.listdir(os.path.join(TOPDIR, "build")):
+        if d.startswith("lib."):
+            sys.path.insert(0, os.path.join(TOPDIR, "build", d))
+
+import dmidecodemod
+
+SECTIONS = ["bios", "system", "baseboard", "chassis", "processor",
+            "memory", "cache", "connector", "slot"]
+TYPES = list(range(0, 42)) + list(range(126, 128))
+
+try:
+    clock = time.perf_counter
+except AttributeError:
+    clock = time.time
+
+def measure(runs, func, *args):
+    samples = []
+    blocks = 0
+    getblocks = getattr(sys, "getallocatedblocks", lambda: 0)
+    for _ in range(runs):
+        before = getblocks()
+        t0 = clock()
+        result = func(*args)
+        t1 = clock()
+        blocks += getblocks() - before
+        samples.append(int((t1 - t0) * 1e9))
+        del result
+    samples.sort()
+    return {
+        "runs": runs,
+        "median_ns": samples[len(samples) // 2],
+        "p99_ns": samples[(len(samples) * 99) // 100],
+        "retained_blocks": blocks // runs,
+    }
+
+def report(dump, query, phase, result):
+    rec = {"harness": "python", "dump": dump, "query": query, "phase": phase}
+    rec.update(result)
+    sys.stdout.write("%s\n" % json.dumps(rec, sort_keys=True))
+
+def main():
+    runs = 25
+    pymap = os.path.join(TOPDIR, "src", "pymap.xml")
+    opts, dumps = getopt(sys.argv[1:], "n:m:h")
+    for o, a in opts:
+        if o == "-n":
+            runs = int(a)
+        elif o == "-m":
+            pymap = a
+        else:
+            sys.stderr.write("Usage: %s [-n <runs>] [-m <pymap.xml>] <dump file> ...\n" % sys.argv[0])
+            return 1
+
+    dmidecodemod.pythonmap(pymap)
+    for dump in dumps:
+        if not dmidecodemod.set_dev(dump):
+            sys.stderr.write("%s: could not use dump, skipped\n" % dump)
+            continue
+        for section in SECTIONS:
+            report(dump, "group:%s" % section, "query",
+                   measure(runs, getattr(dmidecodemod, section)))
+            report(dump, "group:%s" % section, "xmlapi",
+                   measure(runs, lambda: dmidecodemod.xmlapi(query_type="s", result_type="n",
+                                                             section=section)))
+        for t in TYPES:
+            report(dump, "type:%i" % t, "query", measure(runs, dmidecodemod.type, t))
+            report(dump, "type:%i" % t, "xmlapi",
+                   measure(runs, lambda: dmidecodemod.xmlapi(query_type="t", result_type="n", typeid=t)))
+        dmidecodemod.clear_warnings()
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,447 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+/**
+ *  @file bench_decode.c
+ *  @brief Phase level benchmark of the decoder
+ *
+ *  For every dump, the time spent in each decoding phase is measured
+ *  separately:
+ *
+ *    entry      locating and validating the entry point
+ *    read       reading the DMI table with mem_chunk()
+ *    xml        building the XML tree with dmi_table()/dmi_decode()
+ *    map        parsing the XML->Python mapping for the query
+ *    pythonize  converting the XML tree with pythonizeXMLnode()
+ *
+ *  The xml, map and pythonize phases are measured for every DMI type found
+ *  in the table and for every group in the mapping file.  Results are
+ *  written to stdout as one JSON object per line.
+ */
+
+#include <Python.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <libxml/tree.h>
+#include <libxml/parser.h>
+#include <libxml/xmlmemory.h>
+
+#include "types.h"
+#include "dmilog.h"
+#include "dmixml.h"
+#include "dmidecode.h"
+#include "dmisnapshot.h"
+#include "xmlpythonizer.h"
+
+#define DEFAULT_RUNS 25
+
+/*
+ * Allocation counting.  The decoder itself is linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup, libxml2 is
+ * hooked with xmlMemSetup() and Python with PyMem_SetAllocator().
+ */
+static unsigned long allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size)
+{
+        allocs++;
+        return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+        allocs++;
+        return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+        allocs++;
+        return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+        allocs++;
+        return __real_strdup(s);
+}
+
+static void bench_xmlfree(void *ptr)
+{
+        free(ptr);
+}
+
+static void *bench_xmlmalloc(size_t size)
+{
+        allocs++;
+        return __real_malloc(size);
+}
+
+static void *bench_xmlrealloc(void *ptr, size_t size)
+{
+        allocs++;
+        return __real_realloc(ptr, size);
+}
+
+static char *bench_xmlstrdup(const char *s)
+{
+        allocs++;
+        return __real_strdup(s);
+}
+
+static PyMemAllocatorEx py_mem, py_obj;
+
+static void *bench_pymalloc(void *ctx, size_t size)
+{
+        PyMemAllocatorEx *alloc = (PyMemAllocatorEx *) ctx;
+
+        allocs++;
+        return alloc->malloc(alloc->ctx, size);
+}
+
+static void *bench_pycalloc(void *ctx, size_t nelem, size_t elsize)
+{
+        PyMemAllocatorEx *alloc = (PyMemAllocatorEx *) ctx;
+
+        allocs++;
+        return alloc->calloc(alloc->ctx, nelem, elsize);
+}
+
+static void *bench_pyrealloc(void *ctx, void *ptr, size_t size)
+{
+        PyMemAllocatorEx *alloc = (PyMemAllocatorEx *) ctx;
+
+        allocs++;
+        return alloc->realloc(alloc->ctx, ptr, size);
+}
+
+static void bench_pyfree(void *ctx, void *ptr)
+{
+        PyMemAllocatorEx *alloc = (PyMemAllocatorEx *) ctx;
+
+        alloc->free(alloc->ctx, ptr);
+}
+
+static void bench_hook_python(void)
+{
+        PyMemAllocatorEx hook;
+
+        PyMem_GetAllocator(PYMEM_DOMAIN_MEM, &py_mem);
+        PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &py_obj);
+
+        hook.malloc = bench_pymalloc;
+        hook.calloc = bench_pycalloc;
+        hook.realloc = bench_pyrealloc;
+        hook.free = bench_pyfree;
+
+        hook.ctx = &py_mem;
+        PyMem_SetAllocator(PYMEM_DOMAIN_MEM, &hook);
+        hook.ctx = &py_obj;
+        PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &hook);
+}
+
+
+/*
+ * Timing of one phase
+ */
+typedef struct {
+        int runs;
+        int n;
+        unsigned long long *ns;
+        unsigned long allocs;
+        unsigned long long t0;
+        unsigned long a0;
+} bench_phase;
+
+static unsigned long long bench_now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void phase_init(bench_phase *ph, int runs)
+{
+        ph->runs = runs;
+        ph->n = 0;
+        ph->allocs = 0;
+        ph->ns = (unsigned long long *) __real_calloc(runs, sizeof(unsigned long long));
+}
+
+static inline void phase_start(bench_phase *ph)
+{
+        ph->a0 = allocs;
+        ph->t0 = bench_now();
+}
+
+static inline void phase_stop(bench_phase *ph)
+{
+        unsigned long long t1 = bench_now();
+
+        ph->allocs += allocs - ph->a0;
+        if( ph->n < ph->runs ) {
+                ph->ns[ph->n++] = t1 - ph->t0;
+        }
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+        unsigned long long x = *(const unsigned long long *) a;
+        unsigned long long y = *(const unsigned long long *) b;
+
+        return (x > y) - (x < y);
+}
+
+static void json_string(const char *s)
+{
+        putchar('"');
+        for( ; *s; s++ ) {
+                if( (*s == '"') || (*s == '\\') ) {
+                        printf("\\%c", *s);
+                } else if( (unsigned char) *s < 0x20 ) {
+                        printf("\\u%04x", *s);
+                } else {
+                        putchar(*s);
+                }
+        }
+        putchar('"');
+}
+
+/**
+ * Prints the result of a phase as one JSON line and releases it
+ */
+static void phase_report(bench_phase *ph, const char *dump, const char *query, const char *phase)
+{
+        if( ph->n > 0 ) {
+                qsort(ph->ns, ph->n, sizeof(unsigned long long), cmp_ull);
+                printf("{\"harness\": \"c\", \"dump\": ");
+                json_string(dump);
+                printf(", \"query\": ");
+                json_string(query);
+                printf(", \"phase\": \"%s\", \"runs\": %i, \"median_ns\": %llu, \"p99_ns\": %llu, "
+                       "\"allocs\": %lu}\n",
+                       phase, ph->n, ph->ns[ph->n / 2], ph->ns[(ph->n * 99) / 100],
+                       ph->allocs / ph->n);
+        }
+        free(ph->ns);
+        ph->ns = NULL;
+}
+
+
+/**
+ * Measures the xml, map and pythonize phases of one query.  A query is
+ * either a single type (typeid >= 0) or a group from the mapping file.
+ */
+static void bench_query(Log_t *logp, xmlDoc *mapdoc, const Snapshot_t *snap, const char *dump,
+                        int runs, const char *query, const char *group, const int *types, int ntypes)
+{
+        bench_phase xml, map, pyz;
+        xmlNode *dmixml_n = NULL;
+        ptzMAP *mapping = NULL;
+        PyObject *pydata = NULL;
+        int r, i;
+
+        phase_init(&xml, runs);
+        phase_init(&map, runs);
+        phase_init(&pyz, runs);
+
+        for( r = 0; r < runs; r++ ) {
+                phase_start(&xml);
+                dmixml_n = xmlNewNode(NULL, (xmlChar *) "dmidecode");
+                for( i = 0; i < ntypes; i++ ) {
+                        snapshot_decode(logp, types[i], snap, dmixml_n);
+                }
+                phase_stop(&xml);
+
+                phase_start(&map);
+                if( group != NULL ) {
+                        mapping = dmiMAP_ParseMappingXML_GroupName(logp, mapdoc, group);
+                } else {
+                        mapping = dmiMAP_ParseMappingXML_TypeID(logp, mapdoc, types[0]);
+                }
+                phase_stop(&map);
+
+                if( mapping != NULL ) {
+                        phase_start(&pyz);
+                        pydata = pythonizeXMLnode(logp, mapping, dmixml_n);
+                        phase_stop(&pyz);
+                        Py_XDECREF(pydata);
+                        PyErr_Clear();
+                        ptzmap_Free(mapping);
+                }
+                xmlFreeNode(dmixml_n);
+        }
+
+        phase_report(&xml, dump, query, "xml");
+        phase_report(&map, dump, query, "map");
+        phase_report(&pyz, dump, query, "pythonize");
+}
+
+
+static void bench_dump(Log_t *logp, xmlDoc *mapdoc, const char *dump, int runs)
+{
+        bench_phase entry, read;
+        Snapshot_t *snap = NULL;
+        xmlNode *group_n = NULL;
+        int present[256];
+        int types[256];
+        char query[64];
+        int r, i, n;
+
+        phase_init(&entry, runs);
+        for( r = 0; r < runs; r++ ) {
+                phase_start(&entry);
+                snap = snapshot_locate(logp, NULL, dump);
+                phase_stop(&entry);
+                if( (snap == NULL) || !snap->found ) {
+                        fprintf(stderr, "%s: no SMBIOS nor DMI entry point found, skipped\n", dump);
+                        snapshot_free(snap);
+                        free(entry.ns);
+                        return;
+                }
+                if( r < runs - 1 ) {
+                        snapshot_free(snap);
+                }
+        }
+        phase_report(&entry, dump, "", "entry");
+
+        phase_init(&read, runs);
+        for( r = 0; r < runs; r++ ) {
+                free(snap->table);
+                snap->table = NULL;
+                phase_start(&read);
+                snapshot_load(logp, snap, NULL, dump);
+                phase_stop(&read);
+        }
+        phase_report(&read, dump, "", "read");
+
+        if( snapshot_index(snap) < 0 ) {
+                fprintf(stderr, "%s: DMI table could not be read, skipped\n", dump);
+                snapshot_free(snap);
+                return;
+        }
+
+        // Every type present in the table
+        memset(present, 0, sizeof(present));
+        for( i = 0; i < snap->count; i++ ) {
+                present[snap->structs[i].type] = 1;
+        }
+        for( i = 0; i < 256; i++ ) {
+                if( present[i] ) {
+                        snprintf(query, sizeof(query), "type:%i", i);
+                        bench_query(logp, mapdoc, snap, dump, runs, query, NULL, &i, 1);
+                }
+        }
+
+        // Every group in the mapping file
+        group_n = dmixml_FindNode(dmiMAP_GetRootElement(mapdoc), "GroupMapping");
+        foreach_xmlnode(group_n ? group_n->children : NULL, group_n) {
+                xmlNode *type_n = NULL;
+                char *name = NULL;
+
+                if( (group_n->type != XML_ELEMENT_NODE)
+                    || ((name = dmixml_GetAttrValue(group_n, "name")) == NULL) ) {
+                        continue;
+                }
+                n = 0;
+                foreach_xmlnode(group_n->children, type_n) {
+                        char *id = dmixml_GetAttrValue(type_n, "id");
+
+                        if( (type_n->type == XML_ELEMENT_NODE) && (id != NULL) && (n < 256) ) {
+                                types[n++] = strtol(id, NULL, 0);
+                        }
+                }
+                snprintf(query, sizeof(query), "group:%s", name);
+                bench_query(logp, mapdoc, snap, dump, runs, query, name, types, n);
+        }
+
+        snapshot_free(snap);
+}
+
+
+static void usage(const char *prg)
+{
+        fprintf(stderr, "Usage: %s [-n <runs>] [-m <pymap.xml>] <dump file> [<dump file> ...]\n", prg);
+}
+
+
+int main(int argc, char **argv)
+{
+        const char *pymap = "../src/pymap.xml";
+        int runs = DEFAULT_RUNS;
+        xmlDoc *mapdoc = NULL;
+        Log_t *logp = NULL;
+        int opt, i;
+
+        while( (opt = getopt(argc, argv, "n:m:h")) != -1 ) {
+                switch( opt ) {
+                case 'n':
+                        runs = atoi(optarg);
+                        break;
+                case 'm':
+                        pymap = optarg;
+                        break;
+                default:
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+        if( (optind >= argc) || (runs < 1) ) {
+                usage(argv[0]);
+                return 1;
+        }
+
+        xmlMemSetup(bench_xmlfree, bench_xmlmalloc, bench_xmlrealloc, bench_xmlstrdup);
+        xmlInitParser();
+        Py_Initialize();
+        bench_hook_python();
+
+        if( (mapdoc = xmlReadFile(pymap, NULL, 0)) == NULL ) {
+                fprintf(stderr, "Could not open the XML mapping file '%s'\n", pymap);
+                return 1;
+        }
+
+        logp = log_init();
+        for( i = optind; i < argc; i++ ) {
+                bench_dump(logp, mapdoc, argv[i], runs);
+                // The benchmark is not interested in the warnings
+                log_clear_partial(logp, LOG_WARNING, 1);
+                log_clear_partial(logp, LOG_ERR, 1);
+        }
+        log_close(logp);
+        xmlFreeDoc(mapdoc);
+        return 0;
+}
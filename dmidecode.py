@@ -26,11 +26,19 @@
 #
 
 import libxml2
+import os, json, socket, marshal, tempfile, zlib
+try:
+    from collections.abc import Mapping
+except ImportError:
+    from collections import Mapping
 from dmidecodemod import *
 
 DMIXML_NODE='n'
 DMIXML_DOC='d'
 
+DMIDECODED_SOCKET='/run/python-dmidecode/dmidecoded.sock'
+DMIDECODE_CACHE_DIR='/run/python-dmidecode/cache'
+
 class dmidecodeXML:
     "Native Python API for retrieving dmidecode information as XML"
 
@@ -87,3 +95,220 @@ class dmidecodeXML:
 
         return ret
 
+
+class dmidecodeClient:
+    """
+    Queries a running dmidecoded daemon over its Unix socket.  The daemon reads
+    the DMI table as root, so clients do not need any privileges.  Results hold
+    the same structures and fields as QuerySection() and type() return, but
+    they come back as JSON, like stream() writes: strings are str instead of
+    bytes, and dictionary keys are always str, so integer keys become strings.
+    """
+
+    def __init__(self, path=DMIDECODED_SOCKET):
+        self.path = path
+        self.sock = None
+        self.rfile = None
+
+    def _query(self, request):
+        if self.sock is None:
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self.sock.connect(self.path)
+            self.rfile = self.sock.makefile("rb")
+        self.sock.sendall(("%s\n" % request).encode("ascii"))
+        status = self.rfile.readline().decode("ascii", "replace").rstrip("\n")
+        if status.startswith("OK "):
+            return json.loads(self.rfile.read(int(status[3:])).decode("utf-8"))
+        if status.startswith("ERR "):
+            raise LookupError(status[4:])
+        self.close()
+        raise IOError("Invalid reply from dmidecoded: '%s'" % status)
+
+    def QuerySection(self, sectname):
+        "Returns the structures of a section as JSON types, see the class documentation"
+        return self._query("section %s" % sectname)
+
+    def QueryTypeId(self, tpid):
+        "Returns the structures of a DMI type as JSON types, see the class documentation"
+        return self._query("type %i" % tpid)
+
+    def QueryHandle(self, handle):
+        "Returns the structure with the given handle, keyed by its handle"
+        return self._query("handle %i" % handle)
+
+    def Sections(self):
+        "Returns the names of all sections the daemon knows"
+        return self._query("sections")
+
+    def Fingerprint(self):
+        "Returns the fingerprint of the table the daemon serves"
+        return self._query("fingerprint")
+
+    def close(self):
+        if self.sock is not None:
+            self.rfile.close()
+            self.sock.close()
+        self.sock = None
+        self.rfile = None
+
+
+class dmidecodeCache:
+    """
+    Caches decoded results on disk, keyed by the fingerprint of the DMI table.
+    A cache hit reads the table to compute its fingerprint, but does not
+    decode it.  A changed table gets a new fingerprint, so stale results are
+    never returned.  Results are also keyed by get_units() and the mapping
+    file set with pythonmap().  Each fingerprint directory also holds a copy
+    of the raw table, table.dump, which can be passed to set_dev().
+    """
+
+    def __init__(self, path=DMIDECODE_CACHE_DIR):
+        self.path = path
+
+    def _fingerprint(self):
+        fp = fingerprint()
+        if fp is None:
+            raise RuntimeError("Could not read the DMI table from %s" % get_dev())
+        return fp
+
+    def _store(self, directory, name, data):
+        # Written to a temporary file and renamed, so readers never see a partial file
+        fd, tmp = tempfile.mkstemp(prefix=".%s." % name, dir=directory)
+        try:
+            f = os.fdopen(fd, "wb")
+            try:
+                f.write(data)
+                f.flush()
+                os.fsync(f.fileno())
+            finally:
+                f.close()
+            os.rename(tmp, os.path.join(directory, name))
+        except:
+            os.unlink(tmp)
+            raise
+
+    def _store_table(self, directory, fp):
+        if os.path.exists(os.path.join(directory, "table.dump")):
+            return
+        fd, tmp = tempfile.mkstemp(prefix=".table.dump.", dir=directory)
+        os.close(fd)
+        # Only keep the copy if it is still the table the directory is named after
+        if dump_table(tmp) == fp:
+            os.rename(tmp, os.path.join(directory, "table.dump"))
+        else:
+            os.unlink(tmp)
+
+    def _variant(self, name):
+        # The same table decodes differently with other units or another mapping file
+        mapping = get_pythonmap()
+        try:
+            mtime = int(os.stat(mapping).st_mtime)
+        except OSError:
+            mtime = 0
+        key = ("%s\0%s\0%i" % (get_units(), mapping, mtime)).encode("utf-8")
+        return "%s.%08x" % (name, zlib.crc32(key) & 0xFFFFFFFF)
+
+    def _lookup(self, name, query):
+        fp = self._fingerprint()
+        directory = os.path.join(self.path, fp)
+        name = self._variant(name)
+        try:
+            f = open(os.path.join(directory, name), "rb")
+            try:
+                return marshal.load(f)
+            finally:
+                f.close()
+        except (IOError, OSError, EOFError, ValueError, TypeError):
+            pass
+
+        result = query()
+        try:
+            if not os.path.isdir(directory):
+                os.makedirs(directory, 0o700)
+            self._store_table(directory, fp)
+            self._store(directory, name, marshal.dumps(result))
+        except (IOError, OSError):
+            # A cache which cannot be written only costs speed
+            pass
+        return result
+
+    def QuerySection(self, sectname):
+        "Returns the structures of a section, like QuerySection() does"
+        return self._lookup("section-%s" % sectname, lambda: QuerySection(sectname))
+
+    def QueryTypeId(self, tpid):
+        "Returns the structures of a DMI type, like type() does"
+        return self._lookup("type-%i" % tpid, lambda: type(tpid))
+
+    def TableDump(self):
+        "Returns the path of the cached copy of the current table, or None if there is none"
+        f = os.path.join(self.path, self._fingerprint(), "table.dump")
+        return os.path.exists(f) and f or None
+
+
+class dmidecodeLazyStruct(Mapping):
+    """
+    One structure of a table read by dmidecodeLazy.  It holds a reference to
+    the raw structure, which is decoded the first time a key is read.  The
+    decoded dictionary is kept, so later reads cost a dictionary lookup.
+    """
+
+    def __init__(self, table, index):
+        self._table = table
+        self._index = index
+        self._data = None
+
+    def _decoded(self):
+        if self._data is None:
+            self._data = decode_structure(self._table, self._index)
+        return self._data
+
+    def __getitem__(self, key):
+        return self._decoded()[key]
+
+    def __iter__(self):
+        return iter(self._decoded())
+
+    def __len__(self):
+        return len(self._decoded())
+
+
+class dmidecodeLazyResult(Mapping):
+    """
+    Read-only mapping of handles to dmidecodeLazyStruct objects.  Listing the
+    handles does not decode anything.
+    """
+
+    def __init__(self, table, handles):
+        self._table = table
+        self._handles = dict(handles)
+        self._structs = {}
+
+    def __getitem__(self, handle):
+        if handle not in self._structs:
+            self._structs[handle] = dmidecodeLazyStruct(self._table, self._handles[handle])
+        return self._structs[handle]
+
+    def __iter__(self):
+        return iter(self._handles)
+
+    def __len__(self):
+        return len(self._handles)
+
+
+class dmidecodeLazy:
+    """
+    Returns results which are only decoded when they are read.  A query reads
+    the DMI table once and lists its structures.  A structure is decoded the
+    first time one of its keys is read, so memory and CPU time follow what
+    the caller actually reads.  The results compare equal to the dictionaries
+    returned by QuerySection() and type().
+    """
+
+    def QuerySection(self, sectname):
+        "Returns the structures of a section, like QuerySection() does"
+        return dmidecodeLazyResult(*structures(section=sectname))
+
+    def QueryTypeId(self, tpid):
+        "Returns the structures of a DMI type, like type() does"
+        return dmidecodeLazyResult(*structures(typeid=tpid))
@@ -0,0 +1,443 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+
+/**
+ *  @file dmiarchive.c
+ *  @brief Archive of the DMI tables of many hosts in one file
+ *
+ *  A collection of dump files is mostly file system overhead, the tables
+ *  themselves are a few kilobytes.  An archive keeps them back to back in
+ *  one file, with a trailing index.  Readers map the file read-only and
+ *  only touch the trailer, one index entry and the member they decode.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "util.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+#include "dmiarchive.h"
+
+#define QWORD64(x) ((uint64_t) DWORD(x) | ((uint64_t) DWORD((x) + 4) << 32))
+
+static void put16(u8 *p, u16 v)
+{
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+}
+
+static void put32(u8 *p, u32 v)
+{
+        put16(p, v & 0xFFFF);
+        put16(p + 2, v >> 16);
+}
+
+static void put64(u8 *p, uint64_t v)
+{
+        put32(p, v & 0xFFFFFFFF);
+        put32(p + 4, v >> 32);
+}
+
+/**
+ * Writes len bytes at offset, retrying short writes.
+ *
+ * @return Returns 0 on success, -1 with errno set on error
+ */
+static int archive_pwrite(int fd, const void *buf, size_t len, uint64_t offset)
+{
+        const u8 *p = buf;
+        ssize_t n;
+
+        while( len > 0 ) {
+                if( (n = pwrite(fd, p, len, offset)) < 0 ) {
+                        if( errno == EINTR ) {
+                                continue;
+                        }
+                        return -1;
+                }
+                p += n;
+                len -= n;
+                offset += n;
+        }
+        return 0;
+}
+
+/**
+ * Reads the trailer which ends at end.  Every bound is checked on its own,
+ * so the fields of a broken trailer can not wrap around to a valid size.
+ *
+ * @return Returns 0 if the trailer is valid, -1 if not
+ */
+static int archive_trailer(Archive_t *ar, uint64_t end)
+{
+        const u8 *tr = ar->map + end - ARCHIVE_TRAILER_LEN;
+        uint64_t room;
+
+        if( memcmp(tr + 16, ARCHIVE_INDEX_MAGIC, 8) != 0 ) {
+                return -1;
+        }
+        ar->index = QWORD64(tr);
+        ar->count = DWORD(tr + 8);
+        ar->nslots = DWORD(tr + 12);
+        if( (ar->index < ARCHIVE_HEADER_LEN) || (ar->index > end - ARCHIVE_TRAILER_LEN) ) {
+                return -1;
+        }
+        room = end - ARCHIVE_TRAILER_LEN - ar->index;
+        if( ar->count > room / ARCHIVE_ENTRY_LEN ) {
+                return -1;
+        }
+        room -= (uint64_t) ar->count * ARCHIVE_ENTRY_LEN;
+        if( (ar->nslots == 0) || ((ar->nslots & (ar->nslots - 1)) != 0) || (ar->nslots < ar->count)
+            || ((uint64_t) ar->nslots * 4 != room) ) {
+                return -1;
+        }
+        ar->end = end;
+        return 0;
+}
+
+/**
+ * Opens an archive for reading.  Only the header and trailer are checked
+ * here, index entries are checked when they are used.
+ *
+ * @return Returns the archive, to be closed with archive_close(), or NULL
+ */
+Archive_t *archive_open(Log_t *logp, const char *path)
+{
+        Archive_t *ar = NULL;
+        struct stat st;
+        uint64_t end;
+        int fd;
+
+        if( (fd = open(path, O_RDONLY)) < 0 ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s: %s", path, strerror(errno));
+                return NULL;
+        }
+        if( (ar = calloc(1, sizeof(Archive_t))) == NULL ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for archive");
+                close(fd);
+                return NULL;
+        }
+        if( (fstat(fd, &st) < 0) || (st.st_size < ARCHIVE_HEADER_LEN + ARCHIVE_TRAILER_LEN) ) {
+                goto invalid;
+        }
+        ar->size = st.st_size;
+        if( (ar->map = mmap(NULL, ar->size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED ) {
+                ar->map = NULL;
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s (mmap): %s", path, strerror(errno));
+                close(fd);
+                archive_close(ar);
+                return NULL;
+        }
+        close(fd);
+        fd = -1;
+
+        if( (memcmp(ar->map, ARCHIVE_MAGIC, 8) != 0) || (DWORD(ar->map + 8) != ARCHIVE_VERSION) ) {
+                goto invalid;
+        }
+        if( archive_trailer(ar, ar->size) != 0 ) {
+                /* An append in progress, or one which was interrupted, has written
+                 * past the last trailer which is complete */
+                for( end = ar->size - 1; end >= ARCHIVE_HEADER_LEN + ARCHIVE_TRAILER_LEN; end-- ) {
+                        if( archive_trailer(ar, end) == 0 ) {
+                                break;
+                        }
+                }
+                if( end < ARCHIVE_HEADER_LEN + ARCHIVE_TRAILER_LEN ) {
+                        goto invalid;
+                }
+        }
+        return ar;
+
+ invalid:
+        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s: Not a valid DMI archive", path);
+        if( fd >= 0 ) {
+                close(fd);
+        }
+        archive_close(ar);
+        return NULL;
+}
+
+/**
+ * Reads one index entry.
+ *
+ * @return Returns 0 on success, -1 if idx is out of range or the entry is broken
+ */
+int archive_entry(const Archive_t *ar, u32 idx, Archive_entry *entry)
+{
+        const u8 *p = NULL;
+
+        if( idx >= ar->count ) {
+                return -1;
+        }
+        p = ar->map + ar->index + (uint64_t) idx * ARCHIVE_ENTRY_LEN;
+        entry->offset = QWORD64(p);
+        entry->size = DWORD(p + 0x08);
+        entry->hostlen = WORD(p + 0x0C);
+        entry->hash = DWORD(p + 0x10);
+        entry->len = DWORD(p + 0x14);
+        entry->crc = DWORD(p + 0x18);
+        entry->added = DWORD(p + 0x1C);
+        if( (entry->offset < ARCHIVE_HEADER_LEN + (uint64_t) entry->hostlen)
+            || (entry->offset > ar->index) || (entry->size > ar->index - entry->offset) ) {
+                return -1;
+        }
+        entry->host = (const char *) ar->map + entry->offset - entry->hostlen;
+        return 0;
+}
+
+/**
+ * Looks up a member by its host name.  If a host was appended more than
+ * once, the last one is found.
+ *
+ * @return Returns the index of the member, or -1 if there is none
+ */
+long archive_find(const Archive_t *ar, const char *host)
+{
+        const u8 *slots = ar->map + ar->index + (uint64_t) ar->count * ARCHIVE_ENTRY_LEN;
+        size_t hostlen = strlen(host);
+        u32 hash = crc32c(0, host, hostlen);
+        u32 i, n, slot;
+        Archive_entry e;
+
+        for( n = 0, i = hash & (ar->nslots - 1); n < ar->nslots; n++, i = (i + 1) & (ar->nslots - 1) ) {
+                if( (slot = DWORD(slots + i * 4)) == 0 ) {
+                        break;
+                }
+                if( (archive_entry(ar, slot - 1, &e) == 0) && (e.hash == hash)
+                    && (e.hostlen == hostlen) && (memcmp(e.host, host, hostlen) == 0) ) {
+                        return slot - 1;
+                }
+        }
+        return -1;
+}
+
+/**
+ * Reads the snapshot of one member.
+ *
+ * @return Returns a new snapshot to be freed with snapshot_free(), or NULL
+ */
+Snapshot_t *archive_snapshot(Log_t *logp, const Archive_t *ar, u32 idx)
+{
+        Archive_entry e;
+
+        if( archive_entry(ar, idx, &e) != 0 ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "No member %u in the DMI archive", idx);
+                return NULL;
+        }
+        return snapshot_parse(logp, ar->map + e.offset, e.size);
+}
+
+/**
+ * Opens an archive and reads the snapshot of one member, selected by its
+ * host name, or by its index if host is NULL.
+ *
+ * @return Returns a new snapshot to be freed with snapshot_free(), or NULL
+ */
+Snapshot_t *archive_read(Log_t *logp, const char *path, const char *host, long idx)
+{
+        Archive_t *ar = NULL;
+        Snapshot_t *snap = NULL;
+
+        if( (ar = archive_open(logp, path)) == NULL ) {
+                return NULL;
+        }
+        if( (host != NULL) && ((idx = archive_find(ar, host)) < 0) ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "No host '%s' in the DMI archive %s", host, path);
+        } else if( idx >= 0 ) {
+                snap = archive_snapshot(logp, ar, idx);
+        }
+        archive_close(ar);
+        return snap;
+}
+
+/**
+ * Appends snapshots to an archive, which is created if it does not exist.
+ * The members are written after the last trailer, followed by a new index
+ * and, last, a new trailer.  Nothing before the old trailer is changed, so
+ * readers which opened the archive before keep a valid view, and an append
+ * which is interrupted leaves the old trailer as the last valid one.  Appends
+ * are serialised with flock().
+ *
+ * @param logp   Pointer to the log buffer
+ * @param path   Archive file
+ * @param snaps  Snapshots holding a table
+ * @param hosts  Host name of every snapshot
+ * @param n      Number of snapshots
+ *
+ * @return Returns the number of members in the archive, or -1 on error
+ */
+int archive_append(Log_t *logp, const char *path, Snapshot_t **snaps, const char **hosts, unsigned int n)
+{
+        Archive_t *old = NULL;
+        u8 *index = NULL, *slots = NULL, *p = NULL;
+        u8 head[ARCHIVE_HEADER_LEN], entry[0x20];
+        uint64_t offset = ARCHIVE_HEADER_LEN, end = 0;
+        u32 count = 0, nslots = 16, i, j;
+        size_t indexlen;
+        struct stat st;
+        int fd = -1, ret = -1;
+        time_t now = time(NULL);
+
+        for( i = 0; i < n; i++ ) {
+                if( (snaps[i] == NULL) || !snaps[i]->found || (snaps[i]->table == NULL)
+                    || (strlen(hosts[i]) > 0xFFFF) ) {
+                        log_append(logp, LOGFL_NORMAL, LOG_WARNING,
+                                   "Can not archive the DMI table of host '%s'", hosts[i]);
+                        return -1;
+                }
+        }
+
+        if( (fd = open(path, O_RDWR | O_CREAT, 0644)) < 0 ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s: %s", path, strerror(errno));
+                return -1;
+        }
+        while( flock(fd, LOCK_EX) < 0 ) {
+                if( errno != EINTR ) {
+                        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s (flock): %s", path, strerror(errno));
+                        goto exit;
+                }
+        }
+
+        /* Only read the archive once the lock is held, another append may just have grown it */
+        if( fstat(fd, &st) < 0 ) {
+                goto writeerr;
+        }
+        if( st.st_size > 0 ) {
+                if( (old = archive_open(logp, path)) == NULL ) {
+                        goto exit;
+                }
+                count = old->count;
+                offset = end = old->end;
+        }
+
+        while( nslots < 2 * (count + n) ) {
+                nslots <<= 1;
+        }
+        indexlen = (size_t) (count + n) * ARCHIVE_ENTRY_LEN + (size_t) nslots * 4 + ARCHIVE_TRAILER_LEN;
+        if( (index = calloc(1, indexlen)) == NULL ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for the archive index");
+                goto exit;
+        }
+        if( old != NULL ) {
+                memcpy(index, old->map + old->index, (size_t) count * ARCHIVE_ENTRY_LEN);
+                archive_close(old);
+                old = NULL;
+        }
+
+        /* Drop what an interrupted append left after the last trailer */
+        if( ((uint64_t) st.st_size > end) && (ftruncate(fd, end) < 0) ) {
+                goto writeerr;
+        }
+        if( end == 0 ) {
+                memset(head, 0, sizeof(head));
+                memcpy(head, ARCHIVE_MAGIC, 8);
+                put32(head + 8, ARCHIVE_VERSION);
+                if( archive_pwrite(fd, head, sizeof(head), 0) < 0 ) {
+                        goto writeerr;
+                }
+        }
+
+        for( i = 0; i < n; i++ ) {
+                size_t hostlen = strlen(hosts[i]);
+
+                snapshot_dump_entry(snaps[i], entry, sizeof(entry));
+                if( (archive_pwrite(fd, hosts[i], hostlen, offset) < 0)
+                    || (archive_pwrite(fd, entry, sizeof(entry), offset + hostlen) < 0)
+                    || (archive_pwrite(fd, snaps[i]->table, snaps[i]->len, offset + hostlen + sizeof(entry)) < 0) ) {
+                        goto writeerr;
+                }
+                p = index + (size_t) (count + i) * ARCHIVE_ENTRY_LEN;
+                put64(p, offset + hostlen);
+                put32(p + 0x08, sizeof(entry) + snaps[i]->len);
+                put16(p + 0x0C, hostlen);
+                put32(p + 0x10, crc32c(0, hosts[i], hostlen));
+                /* The entry point made above does not change the fingerprint */
+                put32(p + 0x14, snaps[i]->len);
+                put32(p + 0x18, snaps[i]->crc);
+                put32(p + 0x1C, (u32) now);
+                offset += hostlen + sizeof(entry) + snaps[i]->len;
+        }
+        count += n;
+
+        /* Insert the newest members first, so a host appended again is found first */
+        slots = index + (size_t) count * ARCHIVE_ENTRY_LEN;
+        for( i = count; i > 0; i-- ) {
+                j = DWORD(index + (size_t) (i - 1) * ARCHIVE_ENTRY_LEN + 0x10) & (nslots - 1);
+                while( DWORD(slots + j * 4) != 0 ) {
+                        j = (j + 1) & (nslots - 1);
+                }
+                put32(slots + j * 4, i);
+        }
+        p = slots + (size_t) nslots * 4;
+        put64(p, offset);
+        put32(p + 8, count);
+        put32(p + 12, nslots);
+        memcpy(p + 16, ARCHIVE_INDEX_MAGIC, 8);
+
+        /* The members and the index are on disk before the trailer points to them */
+        if( (archive_pwrite(fd, index, indexlen - ARCHIVE_TRAILER_LEN, offset) < 0) || (fsync(fd) < 0)
+            || (archive_pwrite(fd, p, ARCHIVE_TRAILER_LEN, offset + indexlen - ARCHIVE_TRAILER_LEN) < 0)
+            || (fsync(fd) < 0) ) {
+                goto writeerr;
+        }
+        ret = count;
+        goto exit;
+
+ writeerr:
+        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s: %s", path, strerror(errno));
+        /* Not needed for readers, archive_open() finds the old trailer anyway */
+        if( (end > 0) && (ftruncate(fd, end) < 0) ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s (ftruncate): %s", path, strerror(errno));
+        }
+ exit:
+        if( fd >= 0 ) {
+                /* Also releases the lock */
+                close(fd);
+        }
+        archive_close(old);
+        free(index);
+        return ret;
+}
+
+void archive_close(Archive_t *ar)
+{
+        if( ar == NULL ) {
+                return;
+        }
+        if( ar->map != NULL ) {
+                munmap(ar->map, ar->size);
+        }
+        free(ar);
+}
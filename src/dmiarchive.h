@@ -0,0 +1,106 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+
+/**
+ *  @file dmiarchive.h
+ *  @brief Archive of the DMI tables of many hosts in one file
+ *
+ *  Layout of an archive, all numbers are little-endian:
+ *
+ *  @verbatim
+    header    "DMIARCH1", u32 version (1), u32 reserved
+    members   for every member, the host name without a terminating NUL,
+              followed by a legacy dump image: a 32 byte entry point, as
+              made by snapshot_dump_entry(), and the table
+    index     count entries of ARCHIVE_ENTRY_LEN bytes: u64 offset of the
+              dump image, u32 its size, u16 host name length, u16 reserved,
+              u32 CRC-32C of the host name, u32 table length and u32 CRC
+              of the fingerprint, and u32 time the member was appended
+    slots     nslots u32 values, a hash table over the host names.  A slot
+              holds the member index + 1, or 0 if it is free
+    trailer   u64 offset of the index, u32 count, u32 nslots, "DMIAIDX1"
+    @endverbatim
+ *
+ *  The index has a fixed width, so a member is found with one lookup by its
+ *  position, or by hashing its host name.  New members are appended after
+ *  the trailer, followed by a new index and trailer.  The old index and
+ *  trailer stay in the file unused.  The trailer is found at the end of the
+ *  file, or if an append is in progress or was interrupted, as the last
+ *  valid trailer before it.
+ */
+
+#ifndef DMIARCHIVE_H
+#define DMIARCHIVE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "types.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+
+#define ARCHIVE_MAGIC           "DMIARCH1"
+#define ARCHIVE_INDEX_MAGIC     "DMIAIDX1"
+#define ARCHIVE_VERSION         1
+#define ARCHIVE_HEADER_LEN      16
+#define ARCHIVE_ENTRY_LEN       32
+#define ARCHIVE_TRAILER_LEN     24
+
+/**
+ *  One index entry
+ */
+typedef struct {
+        uint64_t offset;        /**< Offset of the dump image, the host name is right before it */
+        u32 size;               /**< Size of the dump image */
+        u16 hostlen;            /**< Length of the host name */
+        u32 hash;               /**< CRC-32C of the host name */
+        u32 len;                /**< Table length, as in snapshot_fingerprint() */
+        u32 crc;                /**< Table CRC-32C, as in snapshot_fingerprint() */
+        time_t added;           /**< When the member was appended */
+        const char *host;       /**< Host name, not NUL terminated, points into the archive */
+} Archive_entry;
+
+/**
+ *  An archive opened for reading, the file is mapped read-only
+ */
+typedef struct {
+        u8 *map;                /**< Mapping of the whole file */
+        size_t size;            /**< Size of the file */
+        uint64_t end;           /**< End of the trailer, the size of the archive */
+        uint64_t index;         /**< Offset of the index */
+        u32 count;              /**< Number of members */
+        u32 nslots;             /**< Size of the hash table, a power of 2 */
+} Archive_t;
+
+Archive_t *archive_open(Log_t *logp, const char *path);
+int archive_entry(const Archive_t *ar, u32 idx, Archive_entry *entry);
+long archive_find(const Archive_t *ar, const char *host);
+Snapshot_t *archive_snapshot(Log_t *logp, const Archive_t *ar, u32 idx);
+Snapshot_t *archive_read(Log_t *logp, const char *path, const char *host, long idx);
+int archive_append(Log_t *logp, const char *path, Snapshot_t **snaps, const char **hosts, unsigned int n);
+void archive_close(Archive_t *ar);
+
+#endif
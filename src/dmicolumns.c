@@ -0,0 +1,500 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+/**
+ *  @file dmicolumns.c
+ *  @brief Column-wise export of the structures of one type
+ *
+ *  Fleet-wide tables of DIMMs, slots or processors need a few fields of
+ *  every structure of one type.  The columns are filled straight from the
+ *  raw tables, one row per structure, so no dictionary is ever built for a
+ *  structure.  Enumerated fields are given as their raw SMBIOS codes, and
+ *  the strings of a column are stored once each.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "util.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+#include "dmisummary.h"
+#include "dmicolumns.h"
+
+/**
+ *  Where the value of a column comes from
+ */
+typedef struct {
+        const char *name;
+        Column_kind kind;
+        u8 offset;              /**< Offset of the field in the formatted area */
+        u8 width;               /**< Width of an integer field in bytes, 1 for a string number */
+        long long unknown;      /**< Raw value meaning unknown, stored as -1, or -1 if there is none */
+        long long (*value)(const Snapshot_struct *st, const u8 *data); /**< Computed value, or NULL */
+} Column_def;
+
+
+/* 7.5.2, the Processor Family 2 field holds families above 0xFD */
+static long long columns_cpu_family(const Snapshot_struct *st, const u8 *data)
+{
+        if( (data[0x06] == 0xFE) && (st->length >= 0x2A) ) {
+                return WORD(data + 0x28);
+        }
+        return data[0x06];
+}
+
+static long long columns_cpu_count(const Snapshot_struct *st, const u8 *data, u8 offset, u8 offset2)
+{
+        unsigned int count;
+
+        if( st->length <= offset ) {
+                return -1;
+        }
+        count = cpusummary_count(st, data, offset, offset2);
+        return (count != 0 ? (long long) count : -1);
+}
+
+static long long columns_cpu_cores(const Snapshot_struct *st, const u8 *data)
+{
+        return columns_cpu_count(st, data, 0x23, 0x2A);
+}
+
+static long long columns_cpu_cores_enabled(const Snapshot_struct *st, const u8 *data)
+{
+        return columns_cpu_count(st, data, 0x24, 0x2C);
+}
+
+static long long columns_cpu_threads(const Snapshot_struct *st, const u8 *data)
+{
+        return columns_cpu_count(st, data, 0x25, 0x2E);
+}
+
+static long long columns_mem_size(const Snapshot_struct *st, const u8 *data)
+{
+        return memsummary_device_size(st, data);
+}
+
+static long long columns_mem_speed(const Snapshot_struct *st, const u8 *data)
+{
+        unsigned int speed = memsummary_device_speed(st, data);
+
+        return (speed != 0 ? (long long) speed : -1);
+}
+
+/* 7.18.1, SMBIOS 3.3 moved speeds above 65534 MT/s to the Extended Configured Memory Speed */
+static long long columns_mem_configured_speed(const Snapshot_struct *st, const u8 *data)
+{
+        u32 speed;
+
+        if( st->length < 0x22 ) {
+                return -1;
+        }
+        speed = WORD(data + 0x20);
+        if( (speed == 0xFFFF) && (st->length >= 0x5C) ) {
+                speed = DWORD(data + 0x58) & 0x7FFFFFFFUL;
+        }
+        return ((speed != 0) && (speed != 0xFFFF) ? (long long) speed : -1);
+}
+
+static long long columns_mem_rank(const Snapshot_struct *st, const u8 *data)
+{
+        if( (st->length < 0x1C) || ((data[0x1B] & 0x0F) == 0) ) {
+                return -1;
+        }
+        return data[0x1B] & 0x0F;
+}
+
+
+/* 7.5 */
+static const Column_def columns_processor[] = {
+        {"handle",              COLUMN_INT, 0x02, 2, -1, NULL},
+        {"socket",              COLUMN_STR, 0x04, 1, -1, NULL},
+        {"type",                COLUMN_INT, 0x05, 1, -1, NULL},
+        {"family",              COLUMN_INT, 0x06, 1, -1, columns_cpu_family},
+        {"manufacturer",        COLUMN_STR, 0x07, 1, -1, NULL},
+        {"version",             COLUMN_STR, 0x10, 1, -1, NULL},
+        {"voltage",             COLUMN_INT, 0x11, 1, -1, NULL},
+        {"external_clock",      COLUMN_INT, 0x12, 2, 0, NULL},
+        {"max_speed",           COLUMN_INT, 0x14, 2, 0, NULL},
+        {"current_speed",       COLUMN_INT, 0x16, 2, 0, NULL},
+        {"status",              COLUMN_INT, 0x18, 1, -1, NULL},
+        {"upgrade",             COLUMN_INT, 0x19, 1, -1, NULL},
+        {"l1_cache_handle",     COLUMN_INT, 0x1A, 2, 0xFFFF, NULL},
+        {"l2_cache_handle",     COLUMN_INT, 0x1C, 2, 0xFFFF, NULL},
+        {"l3_cache_handle",     COLUMN_INT, 0x1E, 2, 0xFFFF, NULL},
+        {"serial_number",       COLUMN_STR, 0x20, 1, -1, NULL},
+        {"asset_tag",           COLUMN_STR, 0x21, 1, -1, NULL},
+        {"part_number",         COLUMN_STR, 0x22, 1, -1, NULL},
+        {"cores",               COLUMN_INT, 0x23, 1, -1, columns_cpu_cores},
+        {"cores_enabled",       COLUMN_INT, 0x24, 1, -1, columns_cpu_cores_enabled},
+        {"threads",             COLUMN_INT, 0x25, 1, -1, columns_cpu_threads},
+        {"characteristics",     COLUMN_INT, 0x26, 2, -1, NULL},
+        {NULL,                  COLUMN_INT, 0, 0, -1, NULL}
+};
+
+/* 7.10 */
+static const Column_def columns_slot[] = {
+        {"handle",              COLUMN_INT, 0x02, 2, -1, NULL},
+        {"designation",         COLUMN_STR, 0x04, 1, -1, NULL},
+        {"type",                COLUMN_INT, 0x05, 1, -1, NULL},
+        {"bus_width",           COLUMN_INT, 0x06, 1, -1, NULL},
+        {"current_usage",       COLUMN_INT, 0x07, 1, -1, NULL},
+        {"length",              COLUMN_INT, 0x08, 1, -1, NULL},
+        {"id",                  COLUMN_INT, 0x09, 2, -1, NULL},
+        {"characteristics1",    COLUMN_INT, 0x0B, 1, -1, NULL},
+        {"characteristics2",    COLUMN_INT, 0x0C, 1, -1, NULL},
+        {"segment",             COLUMN_INT, 0x0D, 2, 0xFFFF, NULL},
+        {"bus",                 COLUMN_INT, 0x0F, 1, 0xFF, NULL},
+        {"device_function",     COLUMN_INT, 0x10, 1, 0xFF, NULL},
+        {"data_width",          COLUMN_INT, 0x11, 1, -1, NULL},
+        {NULL,                  COLUMN_INT, 0, 0, -1, NULL}
+};
+
+/* 7.18 */
+static const Column_def columns_memory_device[] = {
+        {"handle",              COLUMN_INT, 0x02, 2, -1, NULL},
+        {"array_handle",        COLUMN_INT, 0x04, 2, -1, NULL},
+        {"total_width",         COLUMN_INT, 0x08, 2, 0xFFFF, NULL},
+        {"data_width",          COLUMN_INT, 0x0A, 2, 0xFFFF, NULL},
+        {"size",                COLUMN_INT, 0x0C, 2, -1, columns_mem_size},
+        {"form_factor",         COLUMN_INT, 0x0E, 1, -1, NULL},
+        {"set",                 COLUMN_INT, 0x0F, 1, 0xFF, NULL},
+        {"locator",             COLUMN_STR, 0x10, 1, -1, NULL},
+        {"bank_locator",        COLUMN_STR, 0x11, 1, -1, NULL},
+        {"type",                COLUMN_INT, 0x12, 1, -1, NULL},
+        {"type_detail",         COLUMN_INT, 0x13, 2, -1, NULL},
+        {"speed",               COLUMN_INT, 0x15, 2, -1, columns_mem_speed},
+        {"manufacturer",        COLUMN_STR, 0x17, 1, -1, NULL},
+        {"serial_number",       COLUMN_STR, 0x18, 1, -1, NULL},
+        {"asset_tag",           COLUMN_STR, 0x19, 1, -1, NULL},
+        {"part_number",         COLUMN_STR, 0x1A, 1, -1, NULL},
+        {"rank",                COLUMN_INT, 0x1B, 1, -1, columns_mem_rank},
+        {"configured_speed",    COLUMN_INT, 0x20, 2, -1, columns_mem_configured_speed},
+        {"minimum_voltage",     COLUMN_INT, 0x22, 2, 0, NULL},
+        {"maximum_voltage",     COLUMN_INT, 0x24, 2, 0, NULL},
+        {"configured_voltage",  COLUMN_INT, 0x26, 2, 0, NULL},
+        {"technology",          COLUMN_INT, 0x28, 1, -1, NULL},
+        {NULL,                  COLUMN_INT, 0, 0, -1, NULL}
+};
+
+static const Column_def columns_host = {"host", COLUMN_STR, 0, 0, -1, NULL};
+
+
+static const Column_def *columns_defs(u8 type)
+{
+        switch( type ) {
+        case 4:
+                return columns_processor;
+        case 9:
+                return columns_slot;
+        case 17:
+                return columns_memory_device;
+        }
+        return NULL;
+}
+
+
+/**
+ * Tells if columns_new() supports a structure type.
+ *
+ * @return Returns 1 if it does, otherwise 0
+ */
+int columns_supported(u8 type)
+{
+        return (columns_defs(type) != NULL);
+}
+
+
+/**
+ * Creates empty columns for the structures of one type.
+ *
+ * @param logp       Pointer to the log buffer
+ * @param type       Structure type, see columns_supported()
+ * @param with_host  If set, the first column holds the host of every row
+ *
+ * @return Returns the columns, which must be freed with columns_free(), or
+ *         NULL if the type is not supported or memory ran out
+ */
+Columns_t *columns_new(Log_t *logp, u8 type, int with_host)
+{
+        const Column_def *defs = columns_defs(type);
+        Columns_t *cs = NULL;
+        unsigned int i;
+
+        if( defs == NULL ) {
+                return NULL;
+        }
+        if( (cs = (Columns_t *) calloc(1, sizeof(Columns_t))) == NULL ) {
+                goto error;
+        }
+        cs->type = type;
+        cs->host = (with_host ? 1 : 0);
+        cs->ncols = cs->host;
+        for( i = 0; defs[i].name != NULL; i++ ) {
+                cs->ncols++;
+        }
+        if( (cs->cols = (Column_t *) calloc(cs->ncols, sizeof(Column_t))) == NULL ) {
+                goto error;
+        }
+        for( i = 0; i < cs->ncols; i++ ) {
+                const Column_def *def = (with_host ? (i == 0 ? &columns_host : &defs[i - 1]) : &defs[i]);
+
+                cs->cols[i].name = def->name;
+                cs->cols[i].kind = def->kind;
+        }
+        return cs;
+
+ error:
+        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for the columns");
+        columns_free(cs);
+        return NULL;
+}
+
+
+/**
+ * Makes room for one more row in every column, doubling their size when full.
+ *
+ * @return Returns 0 on success, -1 if memory ran out
+ */
+static int columns_grow(Columns_t *cs)
+{
+        unsigned int size = (cs->size ? cs->size * 2 : 64);
+        unsigned int i;
+        void *ptr = NULL;
+
+        if( cs->rows < cs->size ) {
+                return 0;
+        }
+        for( i = 0; i < cs->ncols; i++ ) {
+                Column_t *col = &cs->cols[i];
+
+                if( col->kind == COLUMN_INT ) {
+                        if( (ptr = realloc(col->ints, size * sizeof(long long))) == NULL ) {
+                                return -1;
+                        }
+                        col->ints = ptr;
+                } else {
+                        if( (ptr = realloc(col->codes, size * sizeof(int))) == NULL ) {
+                                return -1;
+                        }
+                        col->codes = ptr;
+                }
+        }
+        cs->size = size;
+        return 0;
+}
+
+
+/**
+ * Looks up a string in the dictionary of a column, adding it if it is new.
+ *
+ * @return Returns the index of the string, or -1 if memory ran out
+ */
+static int columns_dict(Column_t *col, const char *str, size_t len)
+{
+        unsigned int *slots = NULL;
+        unsigned int i, j, nslots;
+        char **dict = NULL;
+
+        j = crc32c(0, str, len) & (col->nslots - 1);
+        for( ; (col->nslots > 0) && (col->slots[j] != 0); j = (j + 1) & (col->nslots - 1) ) {
+                i = col->slots[j] - 1;
+                if( (strncmp(col->dict[i], str, len) == 0) && (col->dict[i][len] == '\0') ) {
+                        return i;
+                }
+        }
+
+        /* Keep the hash table at most half full */
+        if( 2 * (col->ndict + 1) > col->nslots ) {
+                nslots = (col->nslots ? col->nslots * 2 : 16);
+                if( (slots = (unsigned int *) calloc(nslots, sizeof(unsigned int))) == NULL ) {
+                        return -1;
+                }
+                for( i = 0; i < col->ndict; i++ ) {
+                        j = crc32c(0, col->dict[i], strlen(col->dict[i])) & (nslots - 1);
+                        while( slots[j] != 0 ) {
+                                j = (j + 1) & (nslots - 1);
+                        }
+                        slots[j] = i + 1;
+                }
+                free(col->slots);
+                col->slots = slots;
+                col->nslots = nslots;
+        }
+        if( col->ndict == col->dictsize ) {
+                if( (dict = realloc(col->dict, (col->dictsize ? col->dictsize * 2 : 16) * sizeof(char *))) == NULL ) {
+                        return -1;
+                }
+                col->dict = dict;
+                col->dictsize = (col->dictsize ? col->dictsize * 2 : 16);
+        }
+        if( (col->dict[col->ndict] = malloc(len + 1)) == NULL ) {
+                return -1;
+        }
+        memcpy(col->dict[col->ndict], str, len);
+        col->dict[col->ndict][len] = '\0';
+
+        j = crc32c(0, str, len) & (col->nslots - 1);
+        while( col->slots[j] != 0 ) {
+                j = (j + 1) & (col->nslots - 1);
+        }
+        col->slots[j] = col->ndict + 1;
+        return col->ndict++;
+}
+
+
+/**
+ * Stores a string in a row of a column.  The characters dmi_string() would
+ * filter are replaced with dots and trailing spaces are cut first, so the
+ * dictionary holds the strings as the decoder gives them.
+ *
+ * @return Returns 0 on success, -1 if memory ran out
+ */
+static int columns_string(Columns_t *cs, Column_t *col, const char *str, size_t len)
+{
+        char *scratch = NULL;
+        size_t i;
+        int code;
+
+        if( str == NULL ) {
+                col->codes[cs->rows] = -1;
+                return 0;
+        }
+        while( (len > 0) && (str[len - 1] == ' ') ) {
+                len--;
+        }
+        if( len + 1 > cs->scratchlen ) {
+                if( (scratch = realloc(cs->scratch, len + 1)) == NULL ) {
+                        return -1;
+                }
+                cs->scratch = scratch;
+                cs->scratchlen = len + 1;
+        }
+        for( i = 0; i < len; i++ ) {
+                unsigned char c = str[i];
+
+                cs->scratch[i] = ((c < 32) || (c >= 127) ? '.' : c);
+        }
+        if( (code = columns_dict(col, cs->scratch, len)) < 0 ) {
+                return -1;
+        }
+        col->codes[cs->rows] = code;
+        return 0;
+}
+
+
+/**
+ * Appends one row for every structure of the column type in a table.
+ *
+ * @param logp     Pointer to the log buffer
+ * @param cs       Columns made by columns_new()
+ * @param snap     Snapshot holding a table
+ * @param host     Host of the table, stored if the columns have a host column
+ * @param hostlen  Length of host, which needs no terminating NUL
+ *
+ * @return Returns the number of rows added, or -1 on error
+ */
+int columns_add(Log_t *logp, Columns_t *cs, Snapshot_t *snap, const char *host, size_t hostlen)
+{
+        const Column_def *defs = columns_defs(cs->type);
+        const Column_def *def = NULL;
+        const Snapshot_struct *st = NULL;
+        const u8 *data = NULL;
+        unsigned int i, c, first = cs->host;
+        int added = 0;
+        long long val;
+
+        if( snapshot_index(snap) < 0 ) {
+                return -1;
+        }
+        for( i = 0; i < snap->count; i++ ) {
+                st = &snap->structs[i];
+                if( st->type != cs->type ) {
+                        continue;
+                }
+                data = snap->table + st->offset;
+                if( columns_grow(cs) != 0 ) {
+                        goto error;
+                }
+                if( first && (columns_string(cs, &cs->cols[0], host, hostlen) != 0) ) {
+                        goto error;
+                }
+                for( c = first; c < cs->ncols; c++ ) {
+                        def = &defs[c - first];
+                        if( def->kind == COLUMN_STR ) {
+                                const char *str = (st->length > def->offset
+                                                   ? snapshot_string(snap, st, data[def->offset]) : NULL);
+
+                                if( columns_string(cs, &cs->cols[c], str, (str != NULL ? strlen(str) : 0)) != 0 ) {
+                                        goto error;
+                                }
+                                continue;
+                        }
+                        if( st->length < def->offset + def->width ) {
+                                val = -1;
+                        } else if( def->value != NULL ) {
+                                val = def->value(st, data);
+                        } else {
+                                val = (def->width == 1 ? data[def->offset]
+                                       : (def->width == 2 ? WORD(data + def->offset) : DWORD(data + def->offset)));
+                                if( val == def->unknown ) {
+                                        val = -1;
+                                }
+                        }
+                        cs->cols[c].ints[cs->rows] = val;
+                }
+                cs->rows++;
+                added++;
+        }
+        return added;
+
+ error:
+        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for the columns");
+        return -1;
+}
+
+
+void columns_free(Columns_t *cs)
+{
+        unsigned int i, j;
+
+        if( cs == NULL ) {
+                return;
+        }
+        for( i = 0; (cs->cols != NULL) && (i < cs->ncols); i++ ) {
+                for( j = 0; j < cs->cols[i].ndict; j++ ) {
+                        free(cs->cols[i].dict[j]);
+                }
+                free(cs->cols[i].dict);
+                free(cs->cols[i].slots);
+                free(cs->cols[i].ints);
+                free(cs->cols[i].codes);
+        }
+        free(cs->cols);
+        free(cs->scratch);
+        free(cs);
+}
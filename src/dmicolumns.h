@@ -0,0 +1,77 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+/**
+ *  @file dmicolumns.h
+ *  @brief Column-wise export of the structures of one type
+ */
+
+#ifndef DMICOLUMNS_H
+#define DMICOLUMNS_H
+
+#include "types.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+
+typedef enum { COLUMN_INT = 0,          /**< One integer per row, -1 if the field is missing */
+               COLUMN_STR = 1           /**< One dictionary index per row, -1 if there is no string */
+} Column_kind;
+
+/**
+ *  Values of one field of all rows.  Strings are dictionary encoded: every
+ *  distinct string is stored once in dict, and a row holds its index.
+ */
+typedef struct {
+        const char *name;
+        Column_kind kind;
+        long long *ints;                /**< COLUMN_INT values */
+        int *codes;                     /**< COLUMN_STR dictionary indexes */
+        char **dict;                    /**< COLUMN_STR distinct strings, in order of first use */
+        unsigned int ndict;
+        unsigned int dictsize;
+        unsigned int *slots;            /**< Hash table over dict, holding the index + 1, 0 if free */
+        unsigned int nslots;            /**< Size of the hash table, a power of 2 */
+} Column_t;
+
+/**
+ *  Fields of all structures of one type, taken from any number of tables
+ */
+typedef struct {
+        u8 type;
+        int host;                       /**< Set to 1 if the first column holds the host of every row */
+        Column_t *cols;
+        unsigned int ncols;
+        unsigned int rows;
+        unsigned int size;              /**< Number of rows allocated in every column */
+        char *scratch;                  /**< Buffer for filtering strings before the lookup */
+        size_t scratchlen;
+} Columns_t;
+
+int columns_supported(u8 type);
+Columns_t *columns_new(Log_t *logp, u8 type, int with_host);
+int columns_add(Log_t *logp, Columns_t *cs, Snapshot_t *snap, const char *host, size_t hostlen);
+void columns_free(Columns_t *cs);
+
+#endif
@@ -89,6 +89,9 @@
 #include "dmioem.h"
 #include "efi.h"
 #include "dmidump.h"
+#include "dmisnapshot.h"
+#include "dmistats.h"
+#include "dmitrace.h"
 
 #include "dmihelper.h"
 
@@ -98,31 +101,74 @@
 ** Type-independant Stuff
 */
 
-const char *dmi_string(const struct dmi_header *dm, u8 s)
+/*
+ * Split the string-set following the formatted area of a structure into
+ * offsets, so that dmi_string() does not need to walk the strings on every
+ * lookup.  The string-set ends at the first empty string or at 'end'.
+ */
+void dmi_strings_index(struct dmi_strings *ds, struct dmi_header *h, const u8 *end)
 {
-        char *bp = (char *)dm->data;
-        size_t i, len;
+        const u8 *bp = h->data + h->length;
+        const u8 *start;
 
-        if(s == 0)
-                return "Not Specified";
+        ds->count = 0;
+        memset(ds->dirty, 0, sizeof(ds->dirty));
+        h->strings = ds;
 
-        bp += dm->length;
-        while(s > 1 && *bp) {
-                bp += strlen(bp);
+        while(bp < end && *bp && ds->count < DMI_MAX_STRINGS) {
+                start = bp;
+                while(bp < end && *bp) {
+                        if(*bp < 32 || *bp >= 127)
+                                ds->dirty[ds->count >> 3] |= 1 << (ds->count & 7);
+                        bp++;
+                }
+                if(bp == end)   /* Unterminated string, ignore it */
+                        break;
+                ds->offset[ds->count] = start - h->data;
+                ds->clean[ds->count] = NULL;
+                ds->count++;
                 bp++;
-                s--;
         }
+}
+
+void dmi_strings_free(struct dmi_strings *ds)
+{
+        int i;
+
+        for(i = 0; i < ds->count; i++) {
+                if(ds->clean[i] != NULL) {
+                        free(ds->clean[i]);
+                        ds->clean[i] = NULL;
+                }
+        }
+}
 
-        if(!*bp)
+const char *dmi_string(const struct dmi_header *dm, u8 s)
+{
+        struct dmi_strings *ds = dm->strings;
+        char *bp;
+        size_t i;
+
+        if(s == 0)
+                return "Not Specified";
+
+        if(ds == NULL || s > ds->count)
                 return NULL;
+        s--;
 
-        /* ASCII filtering */
-        len = strlen(bp);
-        for(i = 0; i < len; i++)
-                if(bp[i] < 32 || bp[i] == 127)
-                        bp[i] = '.';
+        bp = (char *)dm->data + ds->offset[s];
+        if(!(ds->dirty[s >> 3] & (1 << (s & 7))))
+                return bp;
 
-        return bp;
+        /* ASCII filtering, done on a copy so the table stays untouched */
+        if(ds->clean[s] == NULL) {
+                if((ds->clean[s] = strdup(bp)) == NULL)
+                        return NULL;
+                for(i = 0; ds->clean[s][i]; i++)
+                        if((unsigned char) ds->clean[s][i] < 32 || (unsigned char) ds->clean[s][i] >= 127)
+                                ds->clean[s][i] = '.';
+        }
+        return ds->clean[s];
 }
 
 xmlNode *dmi_smbios_structure_type(xmlNode *node, u8 code)
@@ -1313,6 +1359,18 @@ int dmi_processor_frequency(const u8 * p)
                 return -1;      //. Unknown
 }
 
+void dmi_processor_speed(xmlNode *node, const char *tag, const u8 * p)
+{
+        int freq = dmi_processor_frequency(p);
+        xmlNode *data_n = dmixml_AddTextChild(node, tag, "%i", freq);
+
+        if(freq < 0) {
+                dmixml_AddAttribute(data_n, "unknown", "1");
+        } else {
+                dmixml_AddAttribute(data_n, "unit", "MHz");
+        }
+}
+
 void dmi_processor_status(xmlNode *node, u8 code)
 {
         static const char *status[] = {
@@ -2673,7 +2731,7 @@ void dmi_memory_array_use(xmlNode *node, u8 code)
         }
 }
 
-void dmi_memory_array_ec_type(xmlNode *node, u8 code)
+const char *dmi_memory_array_ec_type_name(u8 code)
 {
         /* 7.17.3 */
         static const char *type[] = {
@@ -2686,13 +2744,23 @@ void dmi_memory_array_ec_type(xmlNode *node, u8 code)
                 "CRC"           /* 0x07 */
         };
 
+        if(code >= 0x01 && code <= 0x07) {
+                return type[code - 0x01];
+        }
+        return NULL;
+}
+
+void dmi_memory_array_ec_type(xmlNode *node, u8 code)
+{
+        const char *type = dmi_memory_array_ec_type_name(code);
+
         xmlNode *data_n = xmlNewChild(node, NULL, (xmlChar *) "ErrorCorrectionType", NULL);
         assert( data_n != NULL );
         dmixml_AddAttribute(data_n, "dmispec", "7.17.3");
         dmixml_AddAttribute(data_n, "flags", "0x%04x", code);
 
-        if(code >= 0x01 && code <= 0x07) {
-                dmixml_AddTextContent(data_n, type[code - 0x01]);
+        if(type != NULL) {
+                dmixml_AddTextContent(data_n, type);
         } else {
                 dmixml_AddAttribute(data_n, "outofspec", "1");
         }
@@ -2838,7 +2906,7 @@ void dmi_memory_device_set(xmlNode *node, u8 code)
         }
 }
 
-void dmi_memory_device_type(xmlNode *node, u8 code)
+const char *dmi_memory_device_type_name(u8 code)
 {
         /* 7.18.2 */
         static const char *type[] = {
@@ -2865,16 +2933,27 @@ void dmi_memory_device_type(xmlNode *node, u8 code)
                 "Reserved",
                 "Reserved",
                 "Reserved",
-                "DDR3"
+                "DDR3",
                 "FBD2"          /* 0x19 */
         };
+
+        if(code >= 0x01 && code <= 0x19) {
+                return type[code - 0x01];
+        }
+        return NULL;
+}
+
+void dmi_memory_device_type(xmlNode *node, u8 code)
+{
+        const char *type = dmi_memory_device_type_name(code);
+
         xmlNode *data_n = xmlNewChild(node, NULL, (xmlChar *) "Type", NULL);
         assert( data_n != NULL );
         dmixml_AddAttribute(data_n, "dmispec", "7.18.2");
         dmixml_AddAttribute(data_n, "flags", "0x%04x", code);
 
-        if(code >= 0x01 && code <= 0x19) {
-                dmixml_AddTextContent(data_n, "%s", type[code - 0x01]);
+        if(type != NULL) {
+                dmixml_AddTextContent(data_n, "%s", type);
         } else {
                 dmixml_AddAttribute(data_n, "outofspec", "1");
         }
@@ -4193,9 +4272,9 @@ xmlNode *dmi_decode(xmlNode *prnt_n, dmi_codes_major *dmiMajor, struct dmi_heade
                 sub_n = xmlNewChild(sect_n, NULL, (xmlChar *) "Frequencies", NULL);
                 assert( sub_n != NULL );
 
-                dmixml_AddTextChild(sub_n, "ExternalClock", "%i", dmi_processor_frequency(data + 0x12));
-                dmixml_AddTextChild(sub_n, "MaxSpeed", "%i", dmi_processor_frequency(data + 0x14));
-                dmixml_AddTextChild(sub_n, "CurrentSpeed", "%i", dmi_processor_frequency(data + 0x16));
+                dmi_processor_speed(sub_n, "ExternalClock", data + 0x12);
+                dmi_processor_speed(sub_n, "MaxSpeed", data + 0x14);
+                dmi_processor_speed(sub_n, "CurrentSpeed", data + 0x16);
                 sub_n = NULL;
 
                 /*  TODO: Should CurrentSpeed be renamed to BootSpeed?  Specification
@@ -5161,9 +5240,6 @@ xmlNode *dmi_decode(xmlNode *prnt_n, dmi_codes_major *dmiMajor, struct dmi_heade
                 break;
 
         default:
-                if(dmi_decode_oem(h))
-                        break;
-
                 sect_n = xmlNewChild(sect_n, NULL, (xmlChar *) "DMIdump", NULL);
                 assert( sect_n != NULL );
 
@@ -5182,6 +5258,8 @@ void to_dmi_header(struct dmi_header *h, u8 * data)
         h->length = data[1];
         h->handle = WORD(data + 2);
         h->data = data;
+        h->strings = NULL;
+        h->vendor = VENDOR_UNKNOWN;
 }
 
 
@@ -5197,13 +5275,45 @@ dmi_codes_major *find_dmiMajor(const struct dmi_header *h)
         return NULL;
 }
 
-static void dmi_table(Log_t *logp, int type, u32 base, u16 len, u16 num, u16 ver, const char *devmem, xmlNode *xmlnode)
+/*
+ * Decode one complete structure, with the vendor-specific decoder for OEM
+ * types, or add a DMImessage node if the type is not supported.
+ */
+static xmlNode *dmi_decode_handle(xmlNode *xmlnode, struct dmi_header *h, u16 ver)
+{
+        dmi_codes_major *dmiMajor = NULL;
+        const dmi_oem_decoder *oem = NULL;
+        xmlNode *handle_n = NULL;
+
+        DMITRACE3(struct__entry, h->type, h->handle, h->length);
+        dmiMajor = find_dmiMajor(h);
+        if( dmiMajor != NULL ) {
+                handle_n = dmi_decode(xmlnode, dmiMajor, h, ver);
+        } else if( (oem = dmi_find_oem(h)) != NULL ) {
+                handle_n = xmlNewChild(xmlnode, NULL, (xmlChar *) oem->tagname, NULL);
+                assert( handle_n != NULL );
+                dmixml_AddAttribute(handle_n, "type", "%i", h->type);
+                dmixml_AddAttribute(handle_n, "oem", "1");
+                dmixml_AddTextChild(handle_n, "DMIdescription", "%s", oem->desc);
+                oem->decode(handle_n, h);
+        } else {
+                handle_n = xmlNewChild(xmlnode, NULL, (xmlChar *) "DMImessage", NULL);
+                assert( handle_n != NULL );
+                dmixml_AddTextContent(handle_n, "DMI/SMBIOS type 0x%02X is not supported "
+                                      "by dmidecode", h->type);
+                dmixml_AddAttribute(handle_n, "type", "%i", h->type);
+                dmixml_AddAttribute(handle_n, "unsupported", "1");
+        }
+        DMITRACE3(struct__return, h->type, h->handle, h->length);
+        return handle_n;
+}
+
+static void dmi_table(Log_t *logp, int type, u8 *buf, u32 base, u32 len, u16 num, u16 ver, xmlNode *xmlnode)
 {
-        static u8 version_added = 0;
-        u8 *buf;
         u8 *data;
         int i = 0;
         int decoding_done = 0;
+        int vendor = VENDOR_UNKNOWN;
 
         if( type == -1 ) {
                 xmlNode *info_n = NULL;
@@ -5221,7 +5331,7 @@ static void dmi_table(Log_t *logp, int type, u32 base, u16 len, u16 num, u16 ver
                 info_n = NULL;
         }
 
-        if((buf = mem_chunk(logp, base, len, devmem)) == NULL) {
+        if(buf == NULL) {
                 log_append(logp, LOGFL_NODUPS, LOG_WARNING, "Table is unreachable, sorry."
 #ifndef USE_MMAP
                         "Try compiling dmidecode with -DUSE_MMAP."
@@ -5229,6 +5339,7 @@ static void dmi_table(Log_t *logp, int type, u32 base, u16 len, u16 num, u16 ver
                         );
                 return;
         }
+        DMITRACE3(table__entry, type, len, num);
 
         if (ver > SUPPORTED_SMBIOS_VER) {
                 log_append(logp, LOGFL_NODUPS, LOG_WARNING,
@@ -5236,17 +5347,20 @@ static void dmi_table(Log_t *logp, int type, u32 base, u16 len, u16 num, u16 ver
                            "# fully supported by this version of dmidecode.\n",
                        SUPPORTED_SMBIOS_VER >> 8, SUPPORTED_SMBIOS_VER & 0xFF);
         }
-        // FIXME: This is hackerish ... rather try to avoid looping dmi_table() calls too much
-        if( version_added == 0 ) {
+        // dmi_table() is called once per type of a section, add the version only once
+        if( xmlHasProp(xmlnode, (xmlChar *) "smbios_version") == NULL ) {
                 dmixml_AddAttribute(xmlnode, "smbios_version", "%u.%u", ver >> 8, ver & 0xFF);
-                version_added = 1;
         }
 
+        /* SMBIOS 3 entry points do not announce the number of structures (num is 0),
+         * and len is only the maximum table size.  Stop at the end-of-table marker.
+         */
         data = buf;
-        while(i < num && data + 4 <= buf + len) {       /* 4 is the length of an SMBIOS structure header */
+        while((num == 0 || i < num) && data + 4 <= buf + len) { /* 4 is the length of an SMBIOS structure header */
 
                 u8 *next;
                 struct dmi_header h;
+                struct dmi_strings strings;
 
                 to_dmi_header(&h, data);
 
@@ -5267,11 +5381,6 @@ static void dmi_table(Log_t *logp, int type, u32 base, u16 len, u16 num, u16 ver
                  * stop decoding at end of table marker
                  */
 
-                /* assign vendor for vendor-specific decodes later */
-                if(h.type == 1 && h.length >= 5) {
-                        dmi_set_vendor(&h);
-                }
-
                 /* look for the next handle */
                 next = data + h.length;
                 while(next - buf + 1 < len && (next[0] != 0 || next[1] != 0)) {
@@ -5279,26 +5388,24 @@ static void dmi_table(Log_t *logp, int type, u32 base, u16 len, u16 num, u16 ver
                 }
                 next += 2;
 
+                dmi_strings_index(&strings, &h, (next - buf <= len ? next : buf + len));
+
+                /* assign vendor for vendor-specific decodes later */
+                if(h.type == 1 && h.length >= 5) {
+                        vendor = dmi_get_vendor(&h);
+                }
+                h.vendor = vendor;
+
                 xmlNode *handle_n = NULL;
                 if( h.type == type ) {
                         if(next - buf <= len) {
-                                dmi_codes_major *dmiMajor = NULL;
                                 /* TODO: ...
                                  * if(opt->flags & FLAG_DUMP) {
                                  * PyDict_SetItem(hDict, PyString_FromString("lookup"), dmi_dump(&h));
                                  * } */
 
-                                dmiMajor = find_dmiMajor(&h);
-                                if( dmiMajor != NULL ) {
-                                        handle_n = dmi_decode(xmlnode, dmiMajor, &h, ver);
-                                } else {
-                                        handle_n = xmlNewChild(xmlnode, NULL, (xmlChar *) "DMImessage", NULL);
-                                        assert( handle_n != NULL );
-                                        dmixml_AddTextContent(handle_n, "DMI/SMBIOS type 0x%02X is not supported "
-                                                              "by dmidecode", h.type);
-                                        dmixml_AddAttribute(handle_n, "type", "%i", h.type);
-                                        dmixml_AddAttribute(handle_n, "unsupported", "1");
-                                }
+                                handle_n = dmi_decode_handle(xmlnode, &h, ver);
+                                stats_add(structs_decoded, 1);
                         } else {
                                 handle_n = xmlNewChild(xmlnode, NULL, (xmlChar *) "DMIerror", NULL);
                                 assert( handle_n != NULL );
@@ -5318,9 +5425,16 @@ static void dmi_table(Log_t *logp, int type, u32 base, u16 len, u16 num, u16 ver
                         dmixml_AddAttribute(handle_n, "size", "%d", h.length);
                         decoding_done = 1;
                 }
+                dmi_strings_free(&strings);
                 data = next;
                 i++;
+
+                if(num == 0 && h.type == 127) {
+                        break;
+                }
         }
+        stats_add(structs_walked, i);
+        DMITRACE2(table__return, type, i);
 
         if( decoding_done == 0 ) {
                 xmlNode *handle_n = xmlNewChild(xmlnode, NULL, (xmlChar *) "DMImessage", NULL);
@@ -5331,17 +5445,89 @@ static void dmi_table(Log_t *logp, int type, u32 base, u16 len, u16 num, u16 ver
                 dmixml_AddAttribute(handle_n, "notfound", "1");
         }
 
-        if(i != num) {
+        if(num != 0 && i != num) {
                 log_append(logp, LOGFL_NODUPS, LOG_WARNING,
                            "Wrong DMI structures count: %d announced, only %d decoded.", num, i);
         }
 
-        if(data - buf != len) {
+        if(num != 0 && data - buf != len) {
                 log_append(logp, LOGFL_NODUPS, LOG_WARNING,
                         "Wrong DMI structures length: %d bytes announced, structures occupy %d bytes.",
                         len, (unsigned int)(data - buf));
         }
-        free(buf);
+}
+
+/*
+ * Decode the table held by a snapshot.  Returns 1 if the snapshot has a
+ * valid entry point, otherwise 0.
+ */
+int snapshot_decode(Log_t *logp, int type, const Snapshot_t *snap, xmlNode *xmlnode)
+{
+        if(snap == NULL || !snap->found)
+                return 0;
+
+        dmi_table(logp, type, snap->table, snap->base, snap->len, snap->num, snap->ver, xmlnode);
+        return 1;
+}
+
+/*
+ * Decode a single structure of an indexed snapshot, the same way dmi_table()
+ * would.  The vendor used by the OEM decoders comes from the system
+ * manufacturer found by snapshot_index().
+ */
+xmlNode *snapshot_decode_struct(const Snapshot_t *snap, const Snapshot_struct *st, xmlNode *xmlnode)
+{
+        struct dmi_header h;
+        struct dmi_strings strings;
+        xmlNode *handle_n = NULL;
+
+        to_dmi_header(&h, snap->table + st->offset);
+        h.vendor = dmi_vendor_id(snap->manufacturer);
+        dmi_strings_index(&strings, &h, h.data + st->size);
+        handle_n = dmi_decode_handle(xmlnode, &h, snap->ver);
+        stats_add(structs_decoded, 1);
+        dmixml_AddAttribute(handle_n, "handle", "0x%04x", h.handle);
+        dmixml_AddAttribute(handle_n, "size", "%d", h.length);
+        dmi_strings_free(&strings);
+        return handle_n;
+}
+
+/*
+ * Tells if dmi_decode_handle() has a decoder for a structure of an indexed
+ * snapshot.  Structures without one are only decoded into a message.
+ */
+int snapshot_struct_supported(const Snapshot_t *snap, const Snapshot_struct *st)
+{
+        struct dmi_header h;
+
+        to_dmi_header(&h, snap->table + st->offset);
+        h.vendor = dmi_vendor_id(snap->manufacturer);
+        return ((find_dmiMajor(&h) != NULL) || (dmi_find_oem(&h) != NULL));
+}
+
+int _smbios3_decode_check(u8 * buf)
+{
+        int check = (buf[0x06] > 0x20 || !checksum(buf, buf[0x06])) ? 0 : 1;
+        return check;
+}
+
+xmlNode *smbios3_decode_get_version(u8 * buf, const char *devmem)
+{
+        int check = _smbios3_decode_check(buf);
+
+        xmlNode *data_n = xmlNewNode(NULL, (xmlChar *) "DMIversion");
+        assert( data_n != NULL );
+
+        dmixml_AddAttribute(data_n, "type", "SMBIOS");
+
+        if(check == 1) {
+                dmixml_AddTextContent(data_n, "SMBIOS %i.%i.%i present", buf[0x07], buf[0x08], buf[0x09]);
+                dmixml_AddAttribute(data_n, "version", "%i.%i", buf[0x07], buf[0x08]);
+        } else {
+                dmixml_AddTextContent(data_n, "No SMBIOS nor DMI entry point found");
+                dmixml_AddAttribute(data_n, "unknown", "1");
+        }
+        return data_n;
 }
 
 int _smbios_decode_check(u8 * buf)
@@ -5399,6 +5585,7 @@ xmlNode *smbios_decode_get_version(u8 * buf, const char *devmem)
 int smbios_decode(Log_t *logp, int type, u8 *buf, const char *devmem, xmlNode *xmlnode)
 {
         int check = _smbios_decode_check(buf);
+        u8 *table;
 
         if(check == 1) {
                 u16 ver = (buf[0x06] << 8) + buf[0x07];
@@ -5412,8 +5599,10 @@ int smbios_decode(Log_t *logp, int type, u8 *buf, const char *devmem, xmlNode *x
                         break;
                 }
                 // printf(">>%d @ %d, %d<<\n", DWORD(buf+0x18), WORD(buf+0x16), WORD(buf+0x1C));
-                dmi_table(logp, type, DWORD(buf + 0x18), WORD(buf + 0x16), WORD(buf + 0x1C), ver, devmem,
+                table = mem_chunk(logp, DWORD(buf + 0x18), WORD(buf + 0x16), devmem);
+                dmi_table(logp, type, table, DWORD(buf + 0x18), WORD(buf + 0x16), WORD(buf + 0x1C), ver,
                           xmlnode);
+                free(table);
         }
         return check;
 }
@@ -5454,10 +5643,14 @@ xmlNode *legacy_decode_get_version(u8 * buf, const char *devmem)
 int legacy_decode(Log_t *logp, int type, u8 *buf, const char *devmem, xmlNode *xmlnode)
 {
         int check = _legacy_decode_check(buf);
+        u8 *table;
 
-        if(check == 1)
-                dmi_table(logp, type, DWORD(buf + 0x08), WORD(buf + 0x06), WORD(buf + 0x0C),
-                          ((buf[0x0E] & 0xF0) << 4) + (buf[0x0E] & 0x0F), devmem, xmlnode);
+        if(check == 1) {
+                table = mem_chunk(logp, DWORD(buf + 0x08), WORD(buf + 0x06), devmem);
+                dmi_table(logp, type, table, DWORD(buf + 0x08), WORD(buf + 0x06), WORD(buf + 0x0C),
+                          ((buf[0x0E] & 0xF0) << 4) + (buf[0x0E] & 0x0F), xmlnode);
+                free(table);
+        }
         return check;
 }
 
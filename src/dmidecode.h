@@ -22,24 +22,49 @@
 #include <libxml/tree.h>
 #include "dmihelper.h"
 #include "dmierror.h"
+#include "dmisnapshot.h"
+
+/*
+ * Tokenised string-set of one structure.  The offsets point into the raw
+ * table, which is never modified.  Strings containing control characters
+ * get an ASCII filtered copy the first time they are looked up.
+ */
+#define DMI_MAX_STRINGS 255
+
+struct dmi_strings {
+        u8 count;
+        u8 dirty[(DMI_MAX_STRINGS + 7) / 8];
+        u32 offset[DMI_MAX_STRINGS];
+        char *clean[DMI_MAX_STRINGS];
+};
 
 struct dmi_header {
         u8 type;
         u8 length;
         u16 handle;
         u8 *data;
+        struct dmi_strings *strings;
+        int vendor;             /* System vendor for OEM decodes, see dmi_get_vendor() */
 };
 
 void dmi_dump(xmlNode *node, struct dmi_header * h);
 xmlNode *dmi_decode(xmlNode *parent_n, dmi_codes_major *dmiMajor, struct dmi_header * h, u16 ver);
 void to_dmi_header(struct dmi_header *h, u8 * data);
+void dmi_strings_index(struct dmi_strings *ds, struct dmi_header *h, const u8 *end);
+void dmi_strings_free(struct dmi_strings *ds);
 
+xmlNode *smbios3_decode_get_version(u8 * buf, const char *devmem);
 xmlNode *smbios_decode_get_version(u8 * buf, const char *devmem);
 xmlNode *legacy_decode_get_version(u8 * buf, const char *devmem);
 int smbios_decode(Log_t *logp, int type, u8 *buf, const char *devmem, xmlNode *xmlnode);
 int legacy_decode(Log_t *logp, int type, u8 *buf, const char *devmem, xmlNode *xmlnode);
+int snapshot_decode(Log_t *logp, int type, const Snapshot_t *snap, xmlNode *xmlnode);
+xmlNode *snapshot_decode_struct(const Snapshot_t *snap, const Snapshot_struct *st, xmlNode *xmlnode);
+int snapshot_struct_supported(const Snapshot_t *snap, const Snapshot_struct *st);
 
 const char *dmi_string(const struct dmi_header *dm, u8 s);
 void dmi_system_uuid(xmlNode *node, const u8 * p, u16 ver);
 void dmi_chassis_type(xmlNode *node, u8 code);
 int dmi_processor_frequency(const u8 * p);
+const char *dmi_memory_array_ec_type_name(u8 code);
+const char *dmi_memory_device_type_name(u8 code);
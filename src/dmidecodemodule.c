@@ -51,6 +51,14 @@
 #include "xmlpythonizer.h"
 #include "version.h"
 #include "dmidump.h"
+#include "dmidiff.h"
+#include "dmistats.h"
+#include "dmitrace.h"
+#include "dmistream.h"
+#include "dmisummary.h"
+#include "dmisel.h"
+#include "dmiarchive.h"
+#include "dmicolumns.h"
 #include <mcheck.h>
 
 #if (PY_VERSION_HEX < 0x03030000)
@@ -74,6 +82,10 @@ static void init(options *opt)
         opt->mappingxml = NULL;
         opt->python_xml_map = strdup(PYTHON_XML_MAP);
         opt->logdata = log_init();
+        memset(opt->fingerprint, 0, sizeof(opt->fingerprint));
+        opt->units = UNITS_TEXT;
+        opt->archive_host = NULL;
+        opt->archive_index = -1;
 
         /* sanity check */
         if(sizeof(u8) != 1 || sizeof(u16) != 2 || sizeof(u32) != 4 || '\0' != 0) {
@@ -126,7 +138,12 @@ xmlNode *dmidecode_get_version(options *opt)
         if(opt->dumpfile != NULL) {
                 //. printf("Reading SMBIOS/DMI data from file %s.\n", dumpfile);
                 if((buf = mem_chunk(opt->logdata, 0, 0x20, opt->dumpfile)) != NULL) {
-                        if(memcmp(buf, "_SM_", 4) == 0) {
+                        if(memcmp(buf, "_SM3_", 5) == 0) {
+                                ver_n = smbios3_decode_get_version(buf, opt->dumpfile);
+                                if( dmixml_GetAttrValue(ver_n, "unknown") == NULL ) {
+                                        found++;
+                                }
+                        } else if(memcmp(buf, "_SM_", 4) == 0) {
                                 ver_n = smbios_decode_get_version(buf, opt->dumpfile);
                                 if( dmixml_GetAttrValue(ver_n, "unknown") == NULL ) {
                                         found++;
@@ -145,7 +162,13 @@ xmlNode *dmidecode_get_version(options *opt)
                         /* Fallback to memory scan (x86, x86_64) */
                         if((buf = mem_chunk(opt->logdata, 0xF0000, 0x10000, opt->devmem)) != NULL) {
                                 for(fp = 0; fp <= 0xFFF0; fp += 16) {
-                                        if(memcmp(buf + fp, "_SM_", 4) == 0 && fp <= 0xFFE0) {
+                                        if(memcmp(buf + fp, "_SM3_", 5) == 0 && fp <= 0xFFE0) {
+                                                ver_n = smbios3_decode_get_version(buf + fp, opt->devmem);
+                                                if( dmixml_GetAttrValue(ver_n, "unknown") == NULL ) {
+                                                        found++;
+                                                }
+                                                fp += 16;
+                                        } else if(memcmp(buf + fp, "_SM_", 4) == 0 && fp <= 0xFFE0) {
                                                 ver_n = smbios_decode_get_version(buf + fp, opt->devmem);
                                                 if( dmixml_GetAttrValue(ver_n, "unknown") == NULL ) {
                                                         found++;
@@ -164,7 +187,11 @@ xmlNode *dmidecode_get_version(options *opt)
                 } else {
                         // Process as EFI
                         if((buf = mem_chunk(opt->logdata, fp, 0x20, opt->devmem)) != NULL) {
-                                ver_n = smbios_decode_get_version(buf, opt->devmem);
+                                if(memcmp(buf, "_SM3_", 5) == 0) {
+                                        ver_n = smbios3_decode_get_version(buf, opt->devmem);
+                                } else {
+                                        ver_n = smbios_decode_get_version(buf, opt->devmem);
+                                }
                                 if( dmixml_GetAttrValue(ver_n, "unknown") == NULL ) {
                                         found++;
                                 }
@@ -182,77 +209,69 @@ xmlNode *dmidecode_get_version(options *opt)
         return ver_n;
 }
 
-int dmidecode_get_xml(options *opt, xmlNode* dmixml_n)
+/**
+ * Reads the entry point and DMI table from the current device or dump file.
+ * The result can be decoded any number of times with dmidecode_get_xml().
+ *
+ * @param opt  Pointer to the options of the query
+ * @param ret  Set to 1 on a hard read error, otherwise 0
+ *
+ * @return Returns a snapshot to be freed with snapshot_free(), or NULL.  NULL
+ *         with ret set to 0 means the device is not readable, which is only
+ *         logged as a warning.
+ */
+Snapshot_t *dmidecode_read_snapshot(options *opt, int *ret)
 {
-        assert(dmixml_n != NULL);
-        if(dmixml_n == NULL) {
-                return 0;
-        }
-        //mtrace();
-
-        int ret = 0;
-        int found = 0;
-        size_t fp;
-        int efi;
-        u8 *buf = NULL;
+        Snapshot_t *snap = NULL;
+        char fp[SNAPSHOT_FPLEN];
+        unsigned long long start;
 
+        *ret = 0;
         const char *f = opt->dumpfile ? opt->dumpfile : opt->devmem;
-        if(access(f, R_OK) < 0) {
+        // The sysfs copy of the table can be read without the memory device
+        if( (access(f, R_OK) < 0)
+            && ((opt->dumpfile != NULL) || (access(SYS_TABLE_FILE, R_OK) < 0)) ) {
                 log_append(opt->logdata, LOGFL_NORMAL,
                            LOG_WARNING, "Permission denied to memory file/device (%s)", f);
-                return 0;
+                return NULL;
         }
 
-        /* Read from dump if so instructed */
-        if(opt->dumpfile != NULL) {
-                //  printf("Reading SMBIOS/DMI data from file %s.\n", dumpfile);
-                if((buf = mem_chunk(opt->logdata, 0, 0x20, opt->dumpfile)) != NULL) {
-                        if(memcmp(buf, "_SM_", 4) == 0) {
-                                if(smbios_decode(opt->logdata, opt->type, buf, opt->dumpfile, dmixml_n))
-                                        found++;
-                        } else if(memcmp(buf, "_DMI_", 5) == 0) {
-                                if(legacy_decode(opt->logdata, opt->type, buf, opt->dumpfile, dmixml_n))
-                                        found++;
-                        }
-                } else {
-                        ret = 1;
-                }
-        } else {                /* Read from /dev/mem */
-                /* First try EFI (ia64, Intel-based Mac) */
-                efi = address_from_efi(opt->logdata, &fp);
-                if(efi == EFI_NOT_FOUND) {
-                        /* Fallback to memory scan (x86, x86_64) */
-                        if((buf = mem_chunk(opt->logdata, 0xF0000, 0x10000, opt->devmem)) != NULL) {
-                                for(fp = 0; fp <= 0xFFF0; fp += 16) {
-                                        if(memcmp(buf + fp, "_SM_", 4) == 0 && fp <= 0xFFE0) {
-                                                if(smbios_decode(opt->logdata, opt->type,
-                                                                 buf + fp, opt->devmem, dmixml_n)) {
-                                                        found++;
-                                                        fp += 16;
-                                                }
-                                        } else if(memcmp(buf + fp, "_DMI_", 5) == 0) {
-                                                if(legacy_decode(opt->logdata, opt->type,
-                                                                 buf + fp, opt->devmem, dmixml_n))
-                                                        found++;
-                                        }
-                                }
-                        } else
-                                ret = 1;
-                } else if(efi == EFI_NO_SMBIOS) {
-                        ret = 1;
-                } else {
-                        if((buf = mem_chunk(opt->logdata, fp, 0x20, opt->devmem)) == NULL)
-                                ret = 1;
-                        else if(smbios_decode(opt->logdata, opt->type, buf, opt->devmem, dmixml_n))
-                                found++;
-                        //  TODO: dmixml_AddAttribute(dmixml_n, "efi_address", "0x%08x", efiAddress);
-                }
+        start = stats_now();
+        if( (opt->archive_host != NULL) || (opt->archive_index >= 0) ) {
+                snap = archive_read(opt->logdata, opt->dumpfile, opt->archive_host, opt->archive_index);
+        } else {
+                snap = snapshot_read(opt->logdata, opt->devmem, opt->dumpfile);
         }
-        if(ret == 0) {
-                free(buf);
+        stats_phase_end(STATS_PHASE_READ, start);
+        if( snap == NULL ) {
+                *ret = 1;
+                return NULL;
         }
-        //muntrace();
-        return ret;
+
+        if( snapshot_fingerprint(snap, fp, sizeof(fp)) != NULL ) {
+                memcpy(opt->fingerprint, fp, sizeof(fp));
+        }
+        return snap;
+}
+
+int dmidecode_get_xml(options *opt, const Snapshot_t *snap, xmlNode* dmixml_n)
+{
+        xmlNode *last_n = NULL;
+        unsigned long long start;
+
+        assert(dmixml_n != NULL);
+        if( (dmixml_n == NULL) || (snap == NULL) ) {
+                return 0;
+        }
+        //  TODO: dmixml_AddAttribute(dmixml_n, "efi_address", "0x%08x", efiAddress);
+        start = stats_now();
+        last_n = dmixml_n->last;
+        snapshot_decode(opt->logdata, opt->type, snap, dmixml_n);
+        stats_phase_end(STATS_PHASE_DECODE, start);
+
+        // Count what was added, the walk is not part of the decode time
+        dmixml_CountNodes(last_n != NULL ? last_n->next : dmixml_n->children);
+        return 0;
 }
 
 xmlNode* load_mappingxml(options *opt) {
@@ -267,9 +286,113 @@ xmlNode* load_mappingxml(options *opt) {
        return dmiMAP_GetRootElement(opt->mappingxml);
 }
 
+
+/**
+ *  Per-module state.  The options are only used with the lock held.  A query
+ *  works on a private copy taken by dmidecode_begin(), so the table can be
+ *  read and decoded without holding the lock, or the GIL.
+ */
+typedef struct {
+        options opt;
+        PyThread_type_lock lock;
+} dmidecode_state;
+
+#ifdef IS_PY3K
+#define dmidecode_get_state(module) ((dmidecode_state *) PyModule_GetState(module))
+#else
+static dmidecode_state dmidecode_py2_state;
+#define dmidecode_get_state(module) (&dmidecode_py2_state)
+#endif
+
+static void dmidecode_end(PyObject *module, options *opt);
+
+/**
+ * Takes the lock of the module state.  The GIL is released while waiting, as
+ * the thread holding the lock may need it to finish.  Nothing which can run
+ * Python code may be called with the lock held.
+ */
+static void dmidecode_lock(dmidecode_state *st)
+{
+        if( !PyThread_acquire_lock(st->lock, NOWAIT_LOCK) ) {
+                Py_BEGIN_ALLOW_THREADS
+                PyThread_acquire_lock(st->lock, WAIT_LOCK);
+                Py_END_ALLOW_THREADS
+        }
+}
+
+/**
+ * Prepares a query.  The module options are copied into opt, with a private
+ * log buffer.  The XML mapping is loaded once and then shared read-only by
+ * all queries, as pythonmap() does not replace a loaded mapping.
+ *
+ * @param module   The module object
+ * @param opt      Options for the query, to be released with dmidecode_end()
+ * @param mapping  Set to 1 if the query needs the XML mapping
+ *
+ * @return Returns 0 on success, otherwise -1 with an exception set
+ */
+static int dmidecode_begin(PyObject *module, options *opt, int mapping)
+{
+        dmidecode_state *st = dmidecode_get_state(module);
+        Log_t *logp = NULL;
+
+        if( (logp = log_init()) == NULL ) {
+                PyErr_NoMemory();
+                return -1;
+        }
+
+        dmidecode_lock(st);
+        if( mapping && (st->opt.mappingxml == NULL) ) {
+                st->opt.mappingxml = xmlReadFile(st->opt.python_xml_map, NULL, 0);
+        }
+        *opt = st->opt;
+        opt->type = -1;
+        opt->flags = 0;
+        opt->dumpfile = (st->opt.dumpfile != NULL ? strdup(st->opt.dumpfile) : NULL);
+        opt->archive_host = (st->opt.archive_host != NULL ? strdup(st->opt.archive_host) : NULL);
+        opt->python_xml_map = strdup(st->opt.python_xml_map);
+        opt->logdata = logp;
+
+        // Reserve the id of this query in the module log
+        logp->query = log_next_query(st->opt.logdata);
+        PyThread_release_lock(st->lock);
+
+        if( mapping && (opt->mappingxml == NULL) ) {
+                PyErr_Format(PyExc_IOError, "Could not open the XML mapping file '%s'",
+                             opt->python_xml_map);
+                dmidecode_end(module, opt);
+                return -1;
+        }
+        return 0;
+}
+
+
+/**
+ * Finishes a query started with dmidecode_begin().  The log records of the
+ * query are moved to the module log, and the fingerprint of the last table
+ * read is kept for has_changed().
+ */
+static void dmidecode_end(PyObject *module, options *opt)
+{
+        dmidecode_state *st = dmidecode_get_state(module);
+
+        dmidecode_lock(st);
+        log_merge(st->opt.logdata, opt->logdata);
+        memcpy(st->opt.fingerprint, opt->fingerprint, sizeof(st->opt.fingerprint));
+        PyThread_release_lock(st->lock);
+
+        log_close(opt->logdata);
+        free(opt->dumpfile);
+        free(opt->archive_host);
+        free(opt->python_xml_map);
+        memset(opt, 0, sizeof(options));
+}
+
 xmlNode *__dmidecode_xml_getsection(options *opt, const char *section) {
         xmlNode *dmixml_n = NULL;
         xmlNode *group_n = NULL;
+        Snapshot_t *snap = NULL;
+        int ret = 0;
 
         dmixml_n = xmlNewNode(NULL, (xmlChar *) "dmidecode");
         assert( dmixml_n != NULL );
@@ -301,6 +424,14 @@ xmlNode *__dmidecode_xml_getsection(options *opt, const char *section) {
                               "Mapping is empty for the '%s' section in the XML mapping", section);
         }
 
+        // Read the DMI table once, all TypeMaps are decoded from the same copy
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(opt, &ret);
+        Py_END_ALLOW_THREADS
+        if( ret != 0 ) {
+                PyReturnError(PyExc_RuntimeError, "Error decoding DMI data");
+        }
+
         // Go through all TypeMap's belonging to this Mapping section
         foreach_xmlnode(dmixml_FindNode(group_n, "TypeMap"), group_n) {
                 char *typeid = dmixml_GetAttrValue(group_n, "id");
@@ -312,6 +443,7 @@ xmlNode *__dmidecode_xml_getsection(options *opt, const char *section) {
                 // The children of <Mapping> tags must only be <TypeMap> and
                 // they must have an 'id' attribute
                 if( (typeid == NULL) || (xmlStrcmp(group_n->name, (xmlChar *) "TypeMap") != 0) ) {
+                        snapshot_free(snap);
                         PyReturnError(PyExc_RuntimeError, "Invalid TypeMap node in mapping XML");
                 }
 
@@ -320,14 +452,20 @@ xmlNode *__dmidecode_xml_getsection(options *opt, const char *section) {
                 if(opt->type == -1) {
                         char *err = log_retrieve(opt->logdata, LOG_ERR);
                         log_clear_partial(opt->logdata, LOG_ERR, 0);
+                        snapshot_free(snap);
                         PyReturnError(PyExc_RuntimeError, "Invalid type id '%s' -- %s", typeid, err);
                 }
 
                 // Parse the DMI data and put the result into dmixml_n node chain.
-                if( dmidecode_get_xml(opt, dmixml_n) != 0 ) {
+                Py_BEGIN_ALLOW_THREADS
+                ret = dmidecode_get_xml(opt, snap, dmixml_n);
+                Py_END_ALLOW_THREADS
+                if( ret != 0 ) {
+                        snapshot_free(snap);
                         PyReturnError(PyExc_RuntimeError, "Error decoding DMI data");
                 }
         }
+        snapshot_free(snap);
 #if 0  // DEBUG - will dump generated XML to stdout
         xmlDoc *doc = xmlNewDoc((xmlChar *) "1.0");
         xmlDocSetRootElement(doc, xmlCopyNode(dmixml_n, 1));
@@ -342,6 +480,7 @@ static PyObject *dmidecode_get_group(options *opt, const char *section)
         PyObject *pydata = NULL;
         xmlNode *dmixml_n = NULL;
         ptzMAP *mapping = NULL;
+        unsigned long long start;
 
         /* Set default option values */
         if( opt->devmem == NULL ) {
@@ -363,9 +502,16 @@ static PyObject *dmidecode_get_group(options *opt, const char *section)
                 xmlFreeNode(dmixml_n);
                 return NULL;
         }
+        if( opt->units == UNITS_CANONICAL ) {
+                ptzmap_SetCanonicalUnits(mapping);
+        }
 
         // Generate Python dict out of XML node
+        start = stats_now();
+        DMITRACE2(pythonize__entry, section, -1);
         pydata = pythonizeXMLnode(opt->logdata, mapping, dmixml_n);
+        DMITRACE3(pythonize__return, section, -1, pydata != NULL);
+        stats_phase_end(STATS_PHASE_PYTHONIZE, start);
 
         // Clean up and return the resulting Python dictionary
         ptzmap_Free(mapping);
@@ -378,6 +524,8 @@ static PyObject *dmidecode_get_group(options *opt, const char *section)
 xmlNode *__dmidecode_xml_gettypeid(options *opt, int typeid)
 {
         xmlNode *dmixml_n = NULL;
+        Snapshot_t *snap = NULL;
+        int ret = 0;
 
         /* Set default option values */
         if( opt->devmem == NULL ) {
@@ -399,9 +547,17 @@ xmlNode *__dmidecode_xml_gettypeid(options *opt, int typeid)
 
         // Parse the DMI data and put the result into dmixml_n node chain.
         opt->type = typeid;
-        if( dmidecode_get_xml(opt, dmixml_n) != 0 ) {
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(opt, &ret);
+        if( ret == 0 ) {
+                ret = dmidecode_get_xml(opt, snap, dmixml_n);
+        }
+        Py_END_ALLOW_THREADS
+        if( ret != 0 ) {
+                snapshot_free(snap);
                 PyReturnError(PyExc_RuntimeError, "Error decoding DMI data");
         }
+        snapshot_free(snap);
 
         return dmixml_n;
 }
@@ -412,6 +568,7 @@ static PyObject *dmidecode_get_typeid(options *opt, int typeid)
         PyObject *pydata = NULL;
         xmlNode *dmixml_n = NULL;
         ptzMAP *mapping = NULL;
+        unsigned long long start;
 
         dmixml_n = __dmidecode_xml_gettypeid(opt, typeid);
         if( dmixml_n == NULL ) {
@@ -426,9 +583,16 @@ static PyObject *dmidecode_get_typeid(options *opt, int typeid)
                 // Now it passes the unit-test
                 return PyDict_New();
         }
+        if( opt->units == UNITS_CANONICAL ) {
+                ptzmap_SetCanonicalUnits(mapping);
+        }
 
         // Generate Python dict out of XML node
+        start = stats_now();
+        DMITRACE2(pythonize__entry, NULL, typeid);
         pydata = pythonizeXMLnode(opt->logdata, mapping, dmixml_n);
+        DMITRACE3(pythonize__return, NULL, typeid, pydata != NULL);
+        stats_phase_end(STATS_PHASE_PYTHONIZE, start);
 
         // Clean up and return the resulting Python dictionary
         ptzmap_Free(mapping);
@@ -438,45 +602,75 @@ static PyObject *dmidecode_get_typeid(options *opt, int typeid)
 }
 
 
-// This global variable should only be available for the "first-entry" functions
-// which is defined in PyMethodDef DMIDataMethods[].
-options *global_options = NULL;
+/**
+ * Runs a section query with a private copy of the module options
+ */
+static PyObject *dmidecode_query_group(PyObject *module, const char *section)
+{
+        PyObject *pydata = NULL;
+        options opt;
+
+        if( dmidecode_begin(module, &opt, 1) != 0 ) {
+                return NULL;
+        }
+        pydata = dmidecode_get_group(&opt, section);
+        dmidecode_end(module, &opt);
+        return pydata;
+}
+
+
+/**
+ * Runs a type query with a private copy of the module options
+ */
+static PyObject *dmidecode_query_typeid(PyObject *module, int typeid)
+{
+        PyObject *pydata = NULL;
+        options opt;
+
+        if( dmidecode_begin(module, &opt, 1) != 0 ) {
+                return NULL;
+        }
+        pydata = dmidecode_get_typeid(&opt, typeid);
+        dmidecode_end(module, &opt);
+        return pydata;
+}
+
 
 static PyObject *dmidecode_get_bios(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "bios");
+        return dmidecode_query_group(self, "bios");
 }
 static PyObject *dmidecode_get_system(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "system");
+        return dmidecode_query_group(self, "system");
 }
 static PyObject *dmidecode_get_baseboard(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "baseboard");
+        return dmidecode_query_group(self, "baseboard");
 }
 static PyObject *dmidecode_get_chassis(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "chassis");
+        return dmidecode_query_group(self, "chassis");
 }
 static PyObject *dmidecode_get_processor(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "processor");
+        return dmidecode_query_group(self, "processor");
 }
 static PyObject *dmidecode_get_memory(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "memory");
+        return dmidecode_query_group(self, "memory");
 }
 static PyObject *dmidecode_get_cache(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "cache");
+        return dmidecode_query_group(self, "cache");
 }
 static PyObject *dmidecode_get_connector(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "connector");
+        return dmidecode_query_group(self, "connector");
 }
 static PyObject *dmidecode_get_slot(PyObject * self, PyObject * args)
 {
-        return dmidecode_get_group(global_options, "slot");
+        return dmidecode_query_group(self, "slot");
 }
 
 static PyObject *dmidecode_get_section(PyObject *self, PyObject *args)
@@ -489,7 +683,7 @@ static PyObject *dmidecode_get_section(PyObject *self, PyObject *args)
         }
 
         if( section != NULL ) {
-                return dmidecode_get_group(global_options, section);
+                return dmidecode_query_group(self, section);
         }
         PyReturnError(PyExc_RuntimeError, "No section name was given");
 }
@@ -510,7 +704,7 @@ static PyObject *dmidecode_get_type(PyObject * self, PyObject * args)
                 PyReturnError(PyExc_RuntimeError, "Type '%i' is not a valid type identifier%c", typeid);
         }
 
-        pydata = dmidecode_get_typeid(global_options, typeid);
+        pydata = dmidecode_query_typeid(self, typeid);
         return pydata;
 }
 
@@ -522,6 +716,7 @@ static PyObject *dmidecode_xmlapi(PyObject *self, PyObject *args, PyObject *keyw
         xmlNode *dmixml_n = NULL;
         char *sect_query = NULL, *qtype = NULL, *rtype = NULL;
         int type_query = -1;
+        options opt;
 
         // Parse the keywords - we only support keywords, as this is an internal API
         if( !PyArg_ParseTupleAndKeywords(args, keywds, "ss|si", keywordlist,
@@ -535,7 +730,11 @@ static PyObject *dmidecode_xmlapi(PyObject *self, PyObject *args, PyObject *keyw
                 if( sect_query == NULL ) {
                         PyReturnError(PyExc_TypeError, "section keyword cannot be NULL")
                 }
-                dmixml_n = __dmidecode_xml_getsection(global_options, sect_query);
+                if( dmidecode_begin(self, &opt, 1) != 0 ) {
+                        return NULL;
+                }
+                dmixml_n = __dmidecode_xml_getsection(&opt, sect_query);
+                dmidecode_end(self, &opt);
                 break;
 
         case 't': // TypeID / direct TypeMap
@@ -546,7 +745,11 @@ static PyObject *dmidecode_xmlapi(PyObject *self, PyObject *args, PyObject *keyw
                         PyReturnError(PyExc_ValueError,
                                       "typeid keyword must be an integer between 0 and 255");
                 }
-                dmixml_n = __dmidecode_xml_gettypeid(global_options, type_query);
+                if( dmidecode_begin(self, &opt, 1) != 0 ) {
+                        return NULL;
+                }
+                dmixml_n = __dmidecode_xml_gettypeid(&opt, type_query);
+                dmidecode_end(self, &opt);
                 break;
 
         default:
@@ -585,18 +788,71 @@ static PyObject *dmidecode_xmlapi(PyObject *self, PyObject *args, PyObject *keyw
 
 
 
+/**
+ * Returns a copy of the current device or dump file name, to be freed by the caller
+ */
+static char *dmidecode_get_devname(dmidecode_state *st)
+{
+        char *f = NULL;
+
+        dmidecode_lock(st);
+        f = strdup(st->opt.dumpfile != NULL ? st->opt.dumpfile : st->opt.devmem);
+        PyThread_release_lock(st->lock);
+        return f;
+}
+
+/**
+ * Replaces the dump file name, NULL reads the memory device again.  An
+ * archive member is selected by host, or by idx if host is NULL; idx -1
+ * selects a plain dump file.
+ */
+static void dmidecode_set_archive(dmidecode_state *st, const char *f, const char *host, long idx)
+{
+        char *dumpfile = (f != NULL ? strdup(f) : NULL);
+        char *archive_host = (host != NULL ? strdup(host) : NULL);
+
+        dmidecode_lock(st);
+        free(st->opt.dumpfile);
+        free(st->opt.archive_host);
+        st->opt.dumpfile = dumpfile;
+        st->opt.archive_host = archive_host;
+        st->opt.archive_index = idx;
+        PyThread_release_lock(st->lock);
+}
+
+static void dmidecode_set_dumpfile(dmidecode_state *st, const char *f)
+{
+        dmidecode_set_archive(st, f, NULL, -1);
+}
+
 static PyObject *dmidecode_dump(PyObject * self, PyObject * null)
 {
-        const char *f;
+        dmidecode_state *st = dmidecode_get_state(self);
+        char *f = NULL;
         struct stat _buf;
+        int ret = 0, member = 0;
 
-        f = (global_options->dumpfile ? global_options->dumpfile : global_options->devmem);
+        // Never overwrite an archive with a single dump
+        dmidecode_lock(st);
+        member = (st->opt.archive_host != NULL) || (st->opt.archive_index >= 0);
+        PyThread_release_lock(st->lock);
+        if( member ) {
+                Py_RETURN_FALSE;
+        }
+
+        if( (f = dmidecode_get_devname(st)) == NULL ) {
+                return PyErr_NoMemory();
+        }
         stat(f, &_buf);
 
         if( (access(f, F_OK) != 0) || ((access(f, W_OK) == 0) && S_ISREG(_buf.st_mode)) ) {
-                if( dump(DEFAULT_MEM_DEV, f) ) {
-                        Py_RETURN_TRUE;
-                }
+                Py_BEGIN_ALLOW_THREADS
+                ret = dump(DEFAULT_MEM_DEV, f);
+                Py_END_ALLOW_THREADS
+        }
+        free(f);
+        if( ret ) {
+                Py_RETURN_TRUE;
         }
         Py_RETURN_FALSE;
 }
@@ -604,14 +860,60 @@ static PyObject *dmidecode_dump(PyObject * self, PyObject * null)
 static PyObject *dmidecode_get_dev(PyObject * self, PyObject * null)
 {
         PyObject *dev = NULL;
-        dev = PYTEXT_FROMSTRING((global_options->dumpfile != NULL
-                                   ? global_options->dumpfile : global_options->devmem));
-        Py_INCREF(dev);
+        char *f = NULL;
+
+        if( (f = dmidecode_get_devname(dmidecode_get_state(self))) == NULL ) {
+                return PyErr_NoMemory();
+        }
+        dev = PYTEXT_FROMSTRING(f);
+        free(f);
         return dev;
 }
 
+static PyObject *dmidecode_get_units(PyObject * self, PyObject * null)
+{
+        dmidecode_state *st = dmidecode_get_state(self);
+        int units;
+
+        dmidecode_lock(st);
+        units = st->opt.units;
+        PyThread_release_lock(st->lock);
+        return PYTEXT_FROMSTRING(units == UNITS_CANONICAL ? "canonical" : "text");
+}
+
+static PyObject *dmidecode_set_units(PyObject * self, PyObject * arg)
+{
+        dmidecode_state *st = dmidecode_get_state(self);
+        const char *mode = NULL;
+        int units;
+
+        if( PyUnicode_Check(arg) ) {
+                mode = PyUnicode_AsUTF8(arg);
+        } else if( PyBytes_Check(arg) ) {
+                mode = PyBytes_AsString(arg);
+        }
+        if( mode == NULL ) {
+                PyErr_SetString(PyExc_TypeError, "set_units() expects 'text' or 'canonical'");
+                return NULL;
+        }
+        if( strcmp(mode, "text") == 0 ) {
+                units = UNITS_TEXT;
+        } else if( strcmp(mode, "canonical") == 0 ) {
+                units = UNITS_CANONICAL;
+        } else {
+                PyErr_Format(PyExc_ValueError, "Unknown unit mode '%s', expected 'text' or 'canonical'", mode);
+                return NULL;
+        }
+
+        dmidecode_lock(st);
+        st->opt.units = units;
+        PyThread_release_lock(st->lock);
+        Py_RETURN_TRUE;
+}
+
 static PyObject *dmidecode_set_dev(PyObject * self, PyObject * arg)
 {
+        dmidecode_state *st = dmidecode_get_state(self);
         char *f = NULL;
         if(PyUnicode_Check(arg)) {
                 f = PyUnicode_AsUTF8(arg);
@@ -620,11 +922,19 @@ static PyObject *dmidecode_set_dev(PyObject * self, PyObject * arg)
         }
         if(f) {
                 struct stat buf;
-
-                if( (f != NULL) && (global_options->dumpfile != NULL )
-                    && (strcmp(global_options->dumpfile, f) == 0) ) {
+                char *cur = dmidecode_get_devname(st);
+
+                if( (cur != NULL) && (strcmp(cur, f) == 0) ) {
+                        free(cur);
+                        // Back to the whole file, if an archive member was selected
+                        dmidecode_lock(st);
+                        free(st->opt.archive_host);
+                        st->opt.archive_host = NULL;
+                        st->opt.archive_index = -1;
+                        PyThread_release_lock(st->lock);
                         Py_RETURN_TRUE;
                 }
+                free(cur);
                 if( (f == NULL) || (strlen(f) < 0) ) {
                         PyReturnError(PyExc_RuntimeError, "set_dev() file name string cannot be empty");
                 }
@@ -634,23 +944,20 @@ static PyObject *dmidecode_set_dev(PyObject * self, PyObject * arg)
                         if( errno == ENOENT ) {
                                 // If this file does not exist, that's okay.
                                 // python-dmidecode will create it.
-                                global_options->dumpfile = strdup(f);
+                                dmidecode_set_dumpfile(st, f);
                                 Py_RETURN_TRUE;
                         }
                         PyReturnError(PyExc_RuntimeError, strerror(errno));
                 }
                 if(S_ISCHR(buf.st_mode)) {
                         if(memcmp(f, "/dev/mem", 8) == 0) {
-                                if( global_options->dumpfile != NULL ) {
-                                        free(global_options->dumpfile);
-                                        global_options->dumpfile = NULL;
-                                }
+                                dmidecode_set_dumpfile(st, NULL);
                                 Py_RETURN_TRUE;
                         } else {
                                 PyReturnError(PyExc_RuntimeError, "Invalid memory device: %s", f);
                         }
                 } else if(S_ISREG(buf.st_mode) || S_ISLNK(buf.st_mode) ) {
-                        global_options->dumpfile = strdup(f);
+                        dmidecode_set_dumpfile(st, f);
                         Py_RETURN_TRUE;
                 }
         }
@@ -659,6 +966,7 @@ static PyObject *dmidecode_set_dev(PyObject * self, PyObject * arg)
 
 static PyObject *dmidecode_set_pythonxmlmap(PyObject * self, PyObject * arg)
 {
+        dmidecode_state *st = dmidecode_get_state(self);
         char *fname = NULL;
 
         if (PyUnicode_Check(arg)) {
@@ -674,8 +982,11 @@ static PyObject *dmidecode_set_pythonxmlmap(PyObject * self, PyObject * arg)
                         PyReturnError(PyExc_IOError, "Could not access the file '%s'", fname);
                 }
 
-                free(global_options->python_xml_map);
-                global_options->python_xml_map = strdup(fname);
+                fname = strdup(fname);
+                dmidecode_lock(st);
+                free(st->opt.python_xml_map);
+                st->opt.python_xml_map = fname;
+                PyThread_release_lock(st->lock);
                 Py_RETURN_TRUE;
         } else {
                 Py_RETURN_FALSE;
@@ -683,169 +994,1626 @@ static PyObject *dmidecode_set_pythonxmlmap(PyObject * self, PyObject * arg)
 }
 
 
+static PyObject *dmidecode_get_pythonxmlmap(PyObject * self, PyObject * null)
+{
+        dmidecode_state *st = dmidecode_get_state(self);
+        PyObject *fname = NULL;
+
+        dmidecode_lock(st);
+        fname = PYTEXT_FROMSTRING(st->opt.python_xml_map);
+        PyThread_release_lock(st->lock);
+        return fname;
+}
+
+
 static PyObject * dmidecode_get_warnings(PyObject *self, PyObject *null)
 {
+        dmidecode_state *st = dmidecode_get_state(self);
         char *warn = NULL;
         PyObject *ret = NULL;
 
-        warn = log_retrieve(global_options->logdata, LOG_WARNING);
+        dmidecode_lock(st);
+        warn = log_retrieve(st->opt.logdata, LOG_WARNING);
+        PyThread_release_lock(st->lock);
         if( warn ) {
                 ret = PYTEXT_FROMSTRING(warn);
                 free(warn);
         } else {
+                Py_INCREF(Py_None);
                 ret = Py_None;
         }
         return ret;
 }
 
 
-static PyObject * dmidecode_clear_warnings(PyObject *self, PyObject *null)
+static PyObject * dmidecode_get_warnings_structured(PyObject *self, PyObject *null)
 {
-        log_clear_partial(global_options->logdata, LOG_WARNING, 1);
-        Py_RETURN_TRUE;
+        static const struct {
+                int level;
+                const char *name;
+        } levels[] = {
+                {LOG_ERR, "error"},
+                {LOG_WARNING, "warning"},
+        };
+        dmidecode_state *st = dmidecode_get_state(self);
+        const Log_entry *entry = NULL;
+        Log_entry *copy = NULL;
+        PyObject *ret = NULL;
+        unsigned int i, pos, n = 0;
+
+        // Copy the records out, no Python objects can be created with the lock held
+        copy = (Log_entry *) calloc(2 * LOG_CAPACITY, sizeof(Log_entry));
+        if( copy == NULL ) {
+                return PyErr_NoMemory();
+        }
+        dmidecode_lock(st);
+        for( i = 0; i < sizeof(levels) / sizeof(levels[0]); i++ ) {
+                pos = 0;
+                while( (entry = log_next(st->opt.logdata, levels[i].level, &pos)) != NULL ) {
+                        copy[n] = *entry;
+                        copy[n].level = i;
+                        copy[n++].message = strdup(entry->message);
+                }
+        }
+        PyThread_release_lock(st->lock);
+
+        ret = PyList_New(0);
+        for( i = 0; i < n; i++ ) {
+                PyObject *rec = NULL;
+
+                if( ret != NULL ) {
+                        rec = Py_BuildValue("{s:s,s:s,s:I,s:k,s:k}",
+                                            "level", levels[copy[i].level].name,
+                                            "message", copy[i].message,
+                                            "count", copy[i].count,
+                                            "first_query", copy[i].first_query,
+                                            "last_query", copy[i].last_query);
+                        if( rec == NULL ) {
+                                Py_DECREF(ret);
+                                ret = NULL;
+                        } else {
+                                PyList_Append(ret, rec);
+                                Py_DECREF(rec);
+                        }
+                }
+                free(copy[i].message);
+        }
+        free(copy);
+        return ret;
 }
 
 
-static PyMethodDef DMIDataMethods[] = {
-        {(char *)"dump", dmidecode_dump, METH_NOARGS, (char *)"Dump dmidata to set file"},
-        {(char *)"get_dev", dmidecode_get_dev, METH_NOARGS,
-         (char *)"Get an alternative memory device file"},
-        {(char *)"set_dev", dmidecode_set_dev, METH_O,
-         (char *)"Set an alternative memory device file"},
+static PyObject * dmidecode_clear_warnings(PyObject *self, PyObject *null)
+{
+        dmidecode_state *st = dmidecode_get_state(self);
 
-        {(char *)"bios", dmidecode_get_bios, METH_VARARGS, (char *)"BIOS Data"},
-        {(char *)"system", dmidecode_get_system, METH_VARARGS, (char *)"System Data"},
-        {(char *)"baseboard", dmidecode_get_baseboard, METH_VARARGS, (char *)"Baseboard Data"},
-        {(char *)"chassis", dmidecode_get_chassis, METH_VARARGS, (char *)"Chassis Data"},
-        {(char *)"processor", dmidecode_get_processor, METH_VARARGS, (char *)"Processor Data"},
-        {(char *)"memory", dmidecode_get_memory, METH_VARARGS, (char *)"Memory Data"},
-        {(char *)"cache", dmidecode_get_cache, METH_VARARGS, (char *)"Cache Data"},
-        {(char *)"connector", dmidecode_get_connector, METH_VARARGS, (char *)"Connector Data"},
-        {(char *)"slot", dmidecode_get_slot, METH_VARARGS, (char *)"Slot Data"},
+        dmidecode_lock(st);
+        log_clear_partial(st->opt.logdata, LOG_WARNING, 1);
+        PyThread_release_lock(st->lock);
+        Py_RETURN_TRUE;
+}
 
-        {(char *)"QuerySection", dmidecode_get_section, METH_O,
-         (char *) "Queries the DMI data structure for a given section name.  A section"
-         "can often contain several DMI type elements"
-        },
 
-        {(char *)"type", dmidecode_get_type, METH_VARARGS, (char *)"By Type"},
+static PyObject * dmidecode_get_stats(PyObject *self, PyObject *null)
+{
+        PyObject *phases = NULL;
+        PyObject *value = NULL;
+        int i;
 
-        {(char *)"QueryTypeId", dmidecode_get_type, METH_VARARGS,
-         (char *) "Queries the DMI data structure for a specific DMI type."
-        },
+        if( (phases = PyDict_New()) == NULL ) {
+                return NULL;
+        }
+        for( i = 0; i < STATS_PHASE_MAX; i++ ) {
+                if( (value = PyLong_FromUnsignedLongLong(stats_get(ns[i]))) == NULL ) {
+                        Py_DECREF(phases);
+                        return NULL;
+                }
+                PyDict_SetItemString(phases, stats_phase_name(i), value);
+                Py_DECREF(value);
+        }
 
-        {(char *)"pythonmap", dmidecode_set_pythonxmlmap, METH_O,
-         (char *) "Use another python dict map definition. The default file is " PYTHON_XML_MAP},
+        return Py_BuildValue("{s:K,s:k,s:k,s:k,s:k,s:k,s:k,s:k,s:N}",
+                             "bytes_read", stats_get(bytes_read),
+                             "structs_walked", stats_get(structs_walked),
+                             "structs_decoded", stats_get(structs_decoded),
+                             "xml_nodes", stats_get(xml_nodes),
+                             "xml_attributes", stats_get(xml_attributes),
+                             "xpath_evals", stats_get(xpath_evals),
+                             "python_objects", stats_get(py_objects),
+                             "log_appends", stats_get(log_appends),
+                             "phase_ns", phases);
+}
 
-        {(char *)"xmlapi", dmidecode_xmlapi, METH_VARARGS | METH_KEYWORDS,
-         (char *) "Internal API for retrieving data as raw XML data"},
+
+static PyObject * dmidecode_reset_stats(PyObject *self, PyObject *null)
+{
+        stats_reset();
+        Py_RETURN_TRUE;
+}
 
 
-        {(char *)"get_warnings", dmidecode_get_warnings, METH_NOARGS,
-         (char *) "Retrieve warnings from operations"},
+/**
+ * Flags the types which belong to a section of the GroupMapping
+ */
+static void dmidecode_section_types(options *opt, const char *section, u8 *types)
+{
+        xmlNode *group_n = NULL;
+        char *typeid = NULL;
+        int type;
 
-        {(char *)"clear_warnings", dmidecode_clear_warnings, METH_NOARGS,
-         (char *) "Clear all warnings"},
+        group_n = dmixml_FindNode(xmlDocGetRootElement(opt->mappingxml), "GroupMapping");
+        group_n = dmixml_FindNodeByAttr(group_n, "Mapping", "name", section);
+        if( group_n == NULL ) {
+                return;
+        }
+        foreach_xmlnode(dmixml_FindNode(group_n, "TypeMap"), group_n) {
+                if( (group_n->type == XML_ELEMENT_NODE)
+                    && ((typeid = dmixml_GetAttrValue(group_n, "id")) != NULL)
+                    && ((type = parse_opt_type(opt->logdata, typeid)) != -1) ) {
+                        types[type] = 1;
+                }
+        }
+}
 
-        {NULL, NULL, 0, NULL}
-};
 
-void destruct_options(void *ptr)
+static PyObject *dmidecode_stream(PyObject *self, PyObject *args, PyObject *keywds)
 {
-#ifdef IS_PY3K
-        ptr = PyCapsule_GetPointer(ptr, NULL);
-#endif
-        options *opt = (options *) ptr;
+        static char *keywordlist[] = {"section", "typeid", "fd", "format", NULL};
+        options query, *opt = &query;
+        const Sink_ops *encoder = NULL;
+        PyObject *fdobj = Py_None;
+        PyObject *pydata = NULL;
+        Snapshot_t *snap = NULL;
+        Sink_t *sink = NULL;
+        ptzMAP *mapping = NULL;
+        char *section = NULL, *format = "json";
+        int typeid = -1, fd = -1, readerr = 0, ret = 0;
+        u8 types[256];
 
-        if( opt->mappingxml != NULL ) {
-                xmlFreeDoc(opt->mappingxml);
-                opt->mappingxml = NULL;
+        if( !PyArg_ParseTupleAndKeywords(args, keywds, "|siOs", keywordlist,
+                                         &section, &typeid, &fdobj, &format) ) {
+                return NULL;
         }
-
-        if( opt->python_xml_map != NULL ) {
-                free(opt->python_xml_map);
-                opt->python_xml_map = NULL;
+        if( (section == NULL) == (typeid < 0) ) {
+                PyReturnError(PyExc_TypeError, "Either the section or the typeid keyword must be set");
+        }
+        if( typeid > 255 ) {
+                PyReturnError(PyExc_ValueError, "typeid keyword must be an integer between 0 and 255");
+        }
+        if( (encoder = sink_find(format)) == NULL ) {
+                PyErr_Format(PyExc_ValueError, "Unknown stream format '%s'", format);
+                return NULL;
+        }
+        if( (fdobj != Py_None) && ((fd = PyObject_AsFileDescriptor(fdobj)) < 0) ) {
+                return NULL;
         }
 
-        if( opt->dmiversion_n != NULL ) {
-                xmlFreeNode(opt->dmiversion_n);
-                opt->dmiversion_n = NULL;
+        if( dmidecode_begin(self, opt, 1) != 0 ) {
+                return NULL;
         }
 
-        if( opt->dumpfile != NULL ) {
-                free(opt->dumpfile);
-                opt->dumpfile = NULL;
+        memset(types, 0, sizeof(types));
+        if( section != NULL ) {
+                mapping = dmiMAP_ParseMappingXML_GroupName(opt->logdata, opt->mappingxml, section);
+                if( mapping == NULL ) {
+                        dmidecode_end(self, opt);
+                        return NULL;
+                }
+                dmidecode_section_types(opt, section, types);
+        } else {
+                // As with type(), a type without a mapping gives an empty result
+                mapping = dmiMAP_ParseMappingXML_TypeID(opt->logdata, opt->mappingxml, typeid);
+                types[typeid] = 1;
+        }
+        if( (mapping != NULL) && (opt->units == UNITS_CANONICAL) ) {
+                ptzmap_SetCanonicalUnits(mapping);
         }
 
-        if( opt->logdata != NULL ) {
-                char *warn = NULL;
+        if( (sink = sink_new(encoder, fd)) == NULL ) {
+                ptzmap_Free(mapping);
+                dmidecode_end(self, opt);
+                return PyErr_NoMemory();
+        }
 
-                log_clear_partial(opt->logdata, LOG_WARNING, 0);
-                warn = log_retrieve(opt->logdata, LOG_WARNING);
+        // Reading and encoding do not touch any Python object
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(opt, &readerr);
+        if( readerr == 0 ) {
+                if( snap != NULL ) {
+                        ret = dmistream_snapshot(opt->logdata, sink, mapping, types, snap);
+                } else {
+                        ret = dmistream_snapshot(opt->logdata, sink, NULL, types, NULL);
+                }
+                sink_flush(sink);
+        }
+        Py_END_ALLOW_THREADS
+        snapshot_free(snap);
+        ptzmap_Free(mapping);
+
+        if( readerr != 0 ) {
+                PyErr_SetString(PyExc_RuntimeError, "Error decoding DMI data");
+        } else if( sink->error != 0 ) {
+                errno = sink->error;
+                PyErr_SetFromErrno(PyExc_OSError);
+        } else if( ret != 0 ) {
+                char *err = log_retrieve(opt->logdata, LOG_ERR);
+                log_clear_partial(opt->logdata, LOG_ERR, 0);
+                PyErr_Format(PyExc_ValueError, "%s", (err != NULL ? err : "Could not stream DMI data"));
+                free(err);
+        } else if( (fd < 0) && (encoder == &sink_cbor) ) {
+                pydata = PyBytes_FromStringAndSize(sink->buf, sink->len);
+        } else if( fd < 0 ) {
+                pydata = PyUnicode_FromStringAndSize(sink->buf, sink->len);
+        } else {
+                pydata = PyLong_FromSize_t(sink->written);
+        }
+        sink_free(sink);
+        dmidecode_end(self, opt);
+        return pydata;
+}
+
+
+#define DMIDECODE_LAZY_CAPSULE "dmidecode.structures"
+
+/**
+ *  A table kept by structures() for decode_structure(), with the mapping of
+ *  every type selected by the query
+ */
+typedef struct {
+        Snapshot_t *snap;
+        ptzMAP *maps[256];
+} dmidecode_lazy;
+
+static void dmidecode_lazy_free(PyObject *capsule)
+{
+        dmidecode_lazy *lazy = PyCapsule_GetPointer(capsule, DMIDECODE_LAZY_CAPSULE);
+        int i;
+
+        if( lazy == NULL ) {
+                return;
+        }
+        for( i = 0; i < 256; i++ ) {
+                ptzmap_Free(lazy->maps[i]);
+        }
+        snapshot_free(lazy->snap);
+        free(lazy);
+}
+
+
+static PyObject *dmidecode_structures(PyObject *self, PyObject *args, PyObject *keywds)
+{
+        static char *keywordlist[] = {"section", "typeid", NULL};
+        dmidecode_lazy *lazy = NULL;
+        PyObject *capsule = NULL, *list = NULL, *val = NULL;
+        char *section = NULL, key[8];
+        int typeid = -1, ret = 0, i;
+        options opt;
+        u8 types[256];
+        u32 s;
+
+        if( !PyArg_ParseTupleAndKeywords(args, keywds, "|si", keywordlist, &section, &typeid) ) {
+                return NULL;
+        }
+        if( (section == NULL) == (typeid < 0) ) {
+                PyReturnError(PyExc_TypeError, "Either the section or the typeid keyword must be set");
+        }
+        if( typeid > 255 ) {
+                PyReturnError(PyExc_ValueError, "typeid keyword must be an integer between 0 and 255");
+        }
+        if( (lazy = (dmidecode_lazy *) calloc(1, sizeof(dmidecode_lazy))) == NULL ) {
+                return PyErr_NoMemory();
+        }
+        if( dmidecode_begin(self, &opt, 1) != 0 ) {
+                free(lazy);
+                return NULL;
+        }
+
+        memset(types, 0, sizeof(types));
+        if( section != NULL ) {
+                if( dmixml_FindNodeByAttr(dmixml_FindNode(xmlDocGetRootElement(opt.mappingxml), "GroupMapping"),
+                                          "Mapping", "name", section) == NULL ) {
+                        dmidecode_end(self, &opt);
+                        free(lazy);
+                        PyErr_Format(PyExc_LookupError, "Could not find the XML->Python Mapping section for '%s'",
+                                     section);
+                        return NULL;
+                }
+                dmidecode_section_types(&opt, section, types);
+        } else {
+                types[typeid] = 1;
+        }
+        // As with type(), a type without a mapping gives an empty result
+        for( i = 0; i < 256; i++ ) {
+                if( types[i] && ((lazy->maps[i] = dmiMAP_ParseMappingXML_TypeID(opt.logdata, opt.mappingxml, i)) != NULL)
+                    && (opt.units == UNITS_CANONICAL) ) {
+                        ptzmap_SetCanonicalUnits(lazy->maps[i]);
+                }
+        }
+        PyErr_Clear();
+
+        Py_BEGIN_ALLOW_THREADS
+        lazy->snap = dmidecode_read_snapshot(&opt, &ret);
+        snapshot_index(lazy->snap);
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        capsule = PyCapsule_New(lazy, DMIDECODE_LAZY_CAPSULE, dmidecode_lazy_free);
+        if( capsule == NULL ) {
+                for( i = 0; i < 256; i++ ) {
+                        ptzmap_Free(lazy->maps[i]);
+                }
+                snapshot_free(lazy->snap);
+                free(lazy);
+                return NULL;
+        }
+        if( ret != 0 ) {
+                Py_DECREF(capsule);
+                PyReturnError(PyExc_RuntimeError, "Error decoding DMI data");
+        }
+
+        // Only the keys are made here, decode_structure() decodes a structure when it is read
+        if( (list = PyList_New(0)) == NULL ) {
+                goto error;
+        }
+        for( s = 0; (lazy->snap != NULL) && (lazy->snap->structs != NULL) && (s < lazy->snap->count); s++ ) {
+                if( (lazy->maps[lazy->snap->structs[s].type] == NULL)
+                    || !snapshot_struct_supported(lazy->snap, &lazy->snap->structs[s]) ) {
+                        continue;
+                }
+                snprintf(key, sizeof(key), "0x%04x", lazy->snap->structs[s].handle);
+                val = Py_BuildValue("(sI)", key, (unsigned int) s);
+                if( val == NULL || PyList_Append(list, val) != 0 ) {
+                        goto error;
+                }
+                Py_CLEAR(val);
+        }
+        return Py_BuildValue("(NN)", capsule, list);
+
+ error:
+        Py_XDECREF(val);
+        Py_XDECREF(list);
+        Py_DECREF(capsule);
+        return NULL;
+}
+
+
+static PyObject *dmidecode_decode_structure(PyObject *self, PyObject *args)
+{
+        dmidecode_lazy *lazy = NULL;
+        const Snapshot_struct *st = NULL;
+        PyObject *capsule = NULL, *pydata = NULL, *val = NULL;
+        xmlNode *root_n = NULL;
+        unsigned long long start;
+        unsigned int idx = 0;
+        char key[8];
+        options opt;
+
+        if( !PyArg_ParseTuple(args, "OI", &capsule, &idx) ) {
+                return NULL;
+        }
+        if( (lazy = PyCapsule_GetPointer(capsule, DMIDECODE_LAZY_CAPSULE)) == NULL ) {
+                return NULL;
+        }
+        if( (lazy->snap == NULL) || (lazy->snap->structs == NULL) || (idx >= lazy->snap->count) ) {
+                PyErr_Format(PyExc_IndexError, "No structure %u in the DMI table", idx);
+                return NULL;
+        }
+        st = &lazy->snap->structs[idx];
+        if( lazy->maps[st->type] == NULL ) {
+                return PyDict_New();
+        }
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+
+        root_n = xmlNewNode(NULL, (xmlChar *) "dmidecode");
+        assert( root_n != NULL );
+        start = stats_now();
+        Py_BEGIN_ALLOW_THREADS
+        snapshot_decode_struct(lazy->snap, st, root_n);
+        Py_END_ALLOW_THREADS
+        stats_phase_end(STATS_PHASE_DECODE, start);
+        dmixml_CountNodes(root_n->children);
+
+        start = stats_now();
+        pydata = pythonizeXMLnode(opt.logdata, lazy->maps[st->type], root_n);
+        stats_phase_end(STATS_PHASE_PYTHONIZE, start);
+        xmlFreeNode(root_n);
+        dmidecode_end(self, &opt);
+
+        if( pydata == NULL ) {
+                return NULL;
+        }
+        // The mapping keys every structure by its handle, return what is under it
+        snprintf(key, sizeof(key), "0x%04x", st->handle);
+        if( (val = PyDict_GetItemString(pydata, key)) == NULL ) {
+                Py_DECREF(pydata);
+                PyErr_Format(PyExc_KeyError, "The mapping gave no entry for structure handle %s", key);
+                return NULL;
+        }
+        Py_INCREF(val);
+        Py_DECREF(pydata);
+        return val;
+}
+
+
+static PyObject * dmidecode_get_fingerprint(PyObject *self, PyObject *null)
+{
+        Snapshot_t *snap = NULL;
+        char fp[SNAPSHOT_FPLEN];
+        const char *found = NULL;
+        options opt;
+        int ret = 0;
+
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(&opt, &ret);
+        found = snapshot_fingerprint(snap, fp, sizeof(fp));
+        snapshot_free(snap);
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        if( found == NULL ) {
+                Py_RETURN_NONE;
+        }
+        return PYTEXT_FROMSTRING(fp);
+}
+
+
+static PyObject * dmidecode_dump_table(PyObject *self, PyObject *arg)
+{
+        Snapshot_t *snap = NULL;
+        char fp[SNAPSHOT_FPLEN];
+        const char *fname = NULL;
+        options opt;
+        int ret = 0;
+
+        if( PyUnicode_Check(arg) ) {
+                fname = PyUnicode_AsUTF8(arg);
+        } else if( PyBytes_Check(arg) ) {
+                fname = PyBytes_AsString(arg);
+        }
+        if( fname == NULL ) {
+                PyReturnError(PyExc_TypeError, "dump_table() needs a file name");
+        }
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(&opt, &ret);
+        ret = ((snapshot_fingerprint(snap, fp, sizeof(fp)) != NULL)
+               && snapshot_write(opt.logdata, snap, fname));
+        snapshot_free(snap);
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        if( !ret ) {
+                Py_RETURN_NONE;
+        }
+        return PYTEXT_FROMSTRING(fp);
+}
+
+
+static PyObject *dmidecode_dump_info(PyObject *self, PyObject *args)
+{
+        static const char *sources[] = { "dump", "efi", "scan", "sysfs" };
+        const char *dumpfile = NULL, *entry = "_DMI_";
+        Snapshot_t *snap = NULL;
+        PyObject *info = NULL, *val = NULL;
+        char fp[SNAPSHOT_FPLEN];
+        int valid = 0;
+        options opt;
+
+        if( !PyArg_ParseTuple(args, "s", &dumpfile) ) {
+                return NULL;
+        }
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        snap = snapshot_read(opt.logdata, NULL, dumpfile);
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        if( snap == NULL ) {
+                PyErr_Format(PyExc_IOError, "Could not read the dump file %s", dumpfile);
+                return NULL;
+        }
+        if( !snap->found ) {
+                snapshot_free(snap);
+                Py_RETURN_NONE;
+        }
+        if( memcmp(snap->entry, "_SM3_", 5) == 0 ) {
+                entry = "_SM3_";
+        } else if( memcmp(snap->entry, "_SM_", 4) == 0 ) {
+                entry = "_SM_";
+        }
+        valid = (snapshot_fingerprint(snap, fp, sizeof(fp)) != NULL);
+        info = Py_BuildValue("{s:i,s:s,s:O,s:O,s:s,s:k,s:O,s:O}",
+                             "version", snap->dumpver,
+                             "source", ((unsigned) snap->origin <= SNAPSHOT_SRC_SYSFS
+                                        ? sources[snap->origin] : "unknown"),
+                             "time", Py_None,
+                             "host", Py_None,
+                             "entry", entry,
+                             "length", (unsigned long) snap->len,
+                             "fingerprint", Py_None,
+                             "valid", (valid ? Py_True : Py_False));
+        if( (info != NULL) && (snap->taken != 0) ) {
+                val = PyLong_FromLongLong((long long) snap->taken);
+                PyDict_SetItemString(info, "time", val);
+                Py_DECREF(val);
+        }
+        if( (info != NULL) && (snap->host[0] != '\0') ) {
+                val = PyUnicode_DecodeUTF8(snap->host, strlen(snap->host), "replace");
+                PyDict_SetItemString(info, "host", val);
+                Py_DECREF(val);
+        }
+        if( (info != NULL) && valid ) {
+                val = PYTEXT_FROMSTRING(fp);
+                PyDict_SetItemString(info, "fingerprint", val);
+                Py_DECREF(val);
+        }
+        snapshot_free(snap);
+        return info;
+}
+
+
+static PyObject *dmidecode_archive_append(PyObject *self, PyObject *args)
+{
+        const char *archive = NULL;
+        const char **hosts = NULL, **files = NULL;
+        Snapshot_t **snaps = NULL;
+        PyObject *members = NULL, *seq = NULL;
+        Py_ssize_t n = 0, i;
+        options opt;
+        int ret = 0, count = -1;
+
+        if( !PyArg_ParseTuple(args, "sO", &archive, &members) ) {
+                return NULL;
+        }
+        if( (seq = PySequence_Fast(members, "archive_append() needs a list of (host, dumpfile) pairs")) == NULL ) {
+                return NULL;
+        }
+        n = PySequence_Fast_GET_SIZE(seq);
+        hosts = calloc(n + 1, sizeof(char *));
+        files = calloc(n + 1, sizeof(char *));
+        snaps = calloc(n + 1, sizeof(Snapshot_t *));
+        if( (hosts == NULL) || (files == NULL) || (snaps == NULL) ) {
+                PyErr_NoMemory();
+                goto exit;
+        }
+        for( i = 0; i < n; i++ ) {
+                PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
+
+                if( !PyTuple_Check(item) ) {
+                        PyErr_Format(PyExc_TypeError, "archive_append() member %zd is not a (host, dumpfile) tuple", i);
+                        goto exit;
+                }
+                if( !PyArg_ParseTuple(item, "sz", &hosts[i], &files[i]) ) {
+                        goto exit;
+                }
+        }
+
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                goto exit;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        for( i = 0; i < n; i++ ) {
+                // A member without a dump file is the current device
+                if( files[i] == NULL ) {
+                        snaps[i] = dmidecode_read_snapshot(&opt, &ret);
+                } else {
+                        snaps[i] = snapshot_read(opt.logdata, opt.devmem, files[i]);
+                }
+        }
+        count = archive_append(opt.logdata, archive, snaps, hosts, n);
+        for( i = 0; i < n; i++ ) {
+                snapshot_free(snaps[i]);
+        }
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        if( count < 0 ) {
+                PyErr_Format(PyExc_IOError, "Could not append to the DMI archive %s", archive);
+        }
+
+ exit:
+        free(hosts);
+        free(files);
+        free(snaps);
+        Py_DECREF(seq);
+        if( count < 0 ) {
+                return NULL;
+        }
+        return PYNUMBER_FROMLONG(count);
+}
+
+
+static PyObject *dmidecode_archive_list(PyObject *self, PyObject *args)
+{
+        const char *archive = NULL;
+        Archive_t *ar = NULL;
+        Archive_entry e;
+        PyObject *list = NULL, *val = NULL;
+        char fp[SNAPSHOT_FPLEN];
+        options opt;
+        u32 i;
+
+        if( !PyArg_ParseTuple(args, "s", &archive) ) {
+                return NULL;
+        }
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        ar = archive_open(opt.logdata, archive);
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+        if( ar == NULL ) {
+                PyErr_Format(PyExc_IOError, "Could not open the DMI archive %s", archive);
+                return NULL;
+        }
+
+        if( (list = PyList_New(0)) == NULL ) {
+                goto error;
+        }
+        for( i = 0; i < ar->count; i++ ) {
+                if( archive_entry(ar, i, &e) != 0 ) {
+                        PyErr_Format(PyExc_IOError, "Broken index entry %u in the DMI archive %s", i, archive);
+                        goto error;
+                }
+                snprintf(fp, sizeof(fp), "%08x%08x", e.len, e.crc);
+                // A NULL host name makes Py_BuildValue() fail with its error set
+                val = Py_BuildValue("{s:N,s:s,s:l}",
+                                    "host", PyUnicode_DecodeUTF8(e.host, e.hostlen, "replace"),
+                                    "fingerprint", fp,
+                                    "added", (long) e.added);
+                if( val == NULL ) {
+                        goto error;
+                }
+                if( PyList_Append(list, val) != 0 ) {
+                        Py_DECREF(val);
+                        goto error;
+                }
+                Py_DECREF(val);
+        }
+        archive_close(ar);
+        return list;
+
+ error:
+        Py_XDECREF(list);
+        archive_close(ar);
+        return NULL;
+}
+
+
+static PyObject *dmidecode_set_archive_member(PyObject *self, PyObject *args)
+{
+        dmidecode_state *st = dmidecode_get_state(self);
+        const char *archive = NULL, *host = NULL;
+        PyObject *member = NULL;
+        Archive_t *ar = NULL;
+        long idx = -1;
+        options opt;
+
+        if( !PyArg_ParseTuple(args, "sO", &archive, &member) ) {
+                return NULL;
+        }
+        if( PyUnicode_Check(member) ) {
+                host = PyUnicode_AsUTF8(member);
+        } else if( PyLong_Check(member) ) {
+                idx = PyLong_AsLong(member);
+        }
+        if( (host == NULL) && (idx < 0) ) {
+                PyReturnError(PyExc_TypeError, "set_archive() needs a host name or a member index");
+        }
+
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        ar = archive_open(opt.logdata, archive);
+        if( (ar != NULL) && (host != NULL) ) {
+                idx = archive_find(ar, host);
+        }
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+        if( ar == NULL ) {
+                PyErr_Format(PyExc_IOError, "Could not open the DMI archive %s", archive);
+                return NULL;
+        }
+        if( (idx < 0) || (idx >= (long) ar->count) ) {
+                archive_close(ar);
+                if( host != NULL ) {
+                        PyErr_Format(PyExc_KeyError, "No host '%s' in the DMI archive", host);
+                } else {
+                        PyErr_SetString(PyExc_IndexError, "DMI archive member index out of range");
+                }
+                return NULL;
+        }
+        archive_close(ar);
+
+        dmidecode_set_archive(st, archive, host, (host != NULL ? -1 : idx));
+        Py_RETURN_TRUE;
+}
+
+
+static PyObject * dmidecode_has_changed(PyObject *self, PyObject *null)
+{
+        Snapshot_t *snap = NULL;
+        char last[SNAPSHOT_FPLEN];
+        options opt;
+        int ret = 0;
+
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+
+        // dmidecode_read_snapshot() records the new fingerprint in opt, and
+        // dmidecode_end() keeps it for the next call
+        memcpy(last, opt.fingerprint, sizeof(last));
+        memset(opt.fingerprint, 0, sizeof(opt.fingerprint));
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(&opt, &ret);
+        snapshot_free(snap);
+        Py_END_ALLOW_THREADS
+
+        ret = ((last[0] == '\0') || (opt.fingerprint[0] == '\0')
+               || (memcmp(last, opt.fingerprint, sizeof(last)) != 0));
+        dmidecode_end(self, &opt);
+        if( ret ) {
+                Py_RETURN_TRUE;
+        }
+        Py_RETURN_FALSE;
+}
+
+
+/**
+ * Converts a memory summary to a dictionary.  Sizes are given in bytes.
+ */
+static PyObject *dmidecode_memsummary_dict(const Memsummary_t *ms)
+{
+        PyObject *arrays = NULL, *channels = NULL, *mix = NULL, *ranges = NULL;
+        PyObject *val = NULL;
+        unsigned int i;
+
+        if( (arrays = PyList_New(0)) == NULL || (channels = PyList_New(0)) == NULL
+            || (mix = PyList_New(0)) == NULL || (ranges = PyList_New(0)) == NULL ) {
+                goto error;
+        }
+        for( i = 0; i < ms->narrays; i++ ) {
+                const Memsummary_array *arr = &ms->arrays[i];
+
+                val = Py_BuildValue("{s:i,s:z,s:K,s:I,s:I,s:I,s:K}",
+                                    "handle", arr->handle,
+                                    "ecc", arr->ecc,
+                                    "maximum", arr->maximum,
+                                    "devices", arr->devices,
+                                    "slots", arr->slots,
+                                    "populated", arr->populated,
+                                    "installed", arr->installed);
+                if( val == NULL || PyList_Append(arrays, val) != 0 ) {
+                        goto error;
+                }
+                Py_CLEAR(val);
+        }
+        for( i = 0; i < ms->nchannels; i++ ) {
+                const Memsummary_channel *chn = &ms->channels[i];
+
+                val = Py_BuildValue("{s:i,s:s,s:I,s:I,s:K}",
+                                    "array", chn->array,
+                                    "name", chn->name,
+                                    "slots", chn->slots,
+                                    "populated", chn->populated,
+                                    "installed", chn->installed);
+                if( val == NULL || PyList_Append(channels, val) != 0 ) {
+                        goto error;
+                }
+                Py_CLEAR(val);
+        }
+        for( i = 0; i < ms->nmix; i++ ) {
+                val = Py_BuildValue("{s:z,s:I,s:I}",
+                                    "type", ms->mix[i].type,
+                                    "speed", ms->mix[i].speed,
+                                    "count", ms->mix[i].count);
+                if( val == NULL || PyList_Append(mix, val) != 0 ) {
+                        goto error;
+                }
+                Py_CLEAR(val);
+        }
+        for( i = 0; i < ms->nranges; i++ ) {
+                const Memsummary_range *rng = &ms->ranges[i];
+
+                val = Py_BuildValue("{s:i,s:i,s:K,s:K,s:I}",
+                                    "handle", rng->handle,
+                                    "array", rng->array,
+                                    "start", rng->start,
+                                    "end", rng->end,
+                                    "devices", rng->devices);
+                if( val == NULL || PyList_Append(ranges, val) != 0 ) {
+                        goto error;
+                }
+                Py_CLEAR(val);
+        }
+
+        // The lists are handed over with "N", Py_BuildValue() releases them on failure too
+        return Py_BuildValue("{s:K,s:K,s:K,s:I,s:I,s:N,s:N,s:N,s:N}",
+                             "installed", ms->installed,
+                             "maximum", ms->maximum,
+                             "mapped", ms->mapped,
+                             "slots", ms->slots,
+                             "populated", ms->populated,
+                             "arrays", arrays,
+                             "channels", channels,
+                             "mix", mix,
+                             "ranges", ranges);
+
+ error:
+        Py_XDECREF(val);
+        Py_XDECREF(arrays);
+        Py_XDECREF(channels);
+        Py_XDECREF(mix);
+        Py_XDECREF(ranges);
+        return NULL;
+}
+
+
+static PyObject * dmidecode_memory_summary(PyObject *self, PyObject *null)
+{
+        Snapshot_t *snap = NULL;
+        Memsummary_t *ms = NULL;
+        PyObject *pydata = NULL;
+        options opt;
+        int ret = 0;
+
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(&opt, &ret);
+        if( snap != NULL ) {
+                ms = memsummary_build(opt.logdata, snap);
+        }
+        snapshot_free(snap);
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        if( ret != 0 ) {
+                PyReturnError(PyExc_RuntimeError, "Error decoding DMI data");
+        }
+        if( ms == NULL ) {
+                Py_RETURN_NONE;
+        }
+        pydata = dmidecode_memsummary_dict(ms);
+        memsummary_free(ms);
+        return pydata;
+}
+
+
+/**
+ * Converts a processor summary to a dictionary.  Cache sizes are given in bytes.
+ */
+static PyObject *dmidecode_cpusummary_dict(const Cpusummary_t *cs)
+{
+        PyObject *cpus = NULL;
+        PyObject *val = NULL;
+        unsigned int i;
+
+        if( (cpus = PyList_New(0)) == NULL ) {
+                return NULL;
+        }
+        for( i = 0; i < cs->ncpus; i++ ) {
+                const Cpusummary_socket *cpu = &cs->cpus[i];
+
+                val = Py_BuildValue("{s:i,s:s,s:s,s:s,s:O,s:I,s:I,s:I,s:I,s:I,s:K,s:K,s:K}",
+                                    "handle", cpu->handle,
+                                    "socket", cpu->socket,
+                                    "manufacturer", cpu->manufacturer,
+                                    "version", cpu->version,
+                                    "populated", (cpu->populated ? Py_True : Py_False),
+                                    "cores", cpu->cores,
+                                    "cores_enabled", cpu->cores_enabled,
+                                    "threads", cpu->threads,
+                                    "max_speed", cpu->max_speed,
+                                    "current_speed", cpu->current_speed,
+                                    "l1", cpu->cache[0],
+                                    "l2", cpu->cache[1],
+                                    "l3", cpu->cache[2]);
+                if( val == NULL || PyList_Append(cpus, val) != 0 ) {
+                        goto error;
+                }
+                Py_CLEAR(val);
+        }
+
+        return Py_BuildValue("{s:I,s:I,s:I,s:I,s:N}",
+                             "sockets", cs->sockets,
+                             "populated", cs->populated,
+                             "cores", cs->cores,
+                             "threads", cs->threads,
+                             "processors", cpus);
+
+ error:
+        Py_XDECREF(val);
+        Py_DECREF(cpus);
+        return NULL;
+}
+
+
+static PyObject * dmidecode_processor_summary(PyObject *self, PyObject *null)
+{
+        Snapshot_t *snap = NULL;
+        Cpusummary_t *cs = NULL;
+        PyObject *pydata = NULL;
+        options opt;
+        int ret = 0;
+
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(&opt, &ret);
+        if( snap != NULL ) {
+                cs = cpusummary_build(opt.logdata, snap);
+        }
+        snapshot_free(snap);
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        if( ret != 0 ) {
+                PyReturnError(PyExc_RuntimeError, "Error decoding DMI data");
+        }
+        if( cs == NULL ) {
+                Py_RETURN_NONE;
+        }
+        pydata = dmidecode_cpusummary_dict(cs);
+        cpusummary_free(cs);
+        return pydata;
+}
+
+
+static PyObject *dmidecode_sel_dict(const Sel_t *sel)
+{
+        PyObject *entries = NULL;
+        PyObject *val = NULL, *stamp = NULL, *data = NULL;
+        char cursor[SEL_CURSORLEN];
+        unsigned int i;
+
+        if( (entries = PyList_New(0)) == NULL ) {
+                return NULL;
+        }
+        for( i = 0; i < sel->count; i++ ) {
+                const Sel_record *r = &sel->records[i];
+
+                if( r->time[0] ) {
+                        stamp = PYTEXT_FROMSTRING(r->time);
+                } else {
+                        Py_INCREF(Py_None);
+                        stamp = Py_None;
+                }
+                data = PyBytes_FromStringAndSize((const char *) r->data, r->datalen);
+                if( stamp == NULL || data == NULL ) {
+                        goto error;
+                }
+                val = Py_BuildValue("{s:I,s:I,s:s,s:O,s:O,s:O}",
+                                    "offset", r->offset,
+                                    "type", r->type,
+                                    "name", sel_event_type(r->type),
+                                    "read", (r->read ? Py_True : Py_False),
+                                    "time", stamp,
+                                    "data", data);
+                Py_CLEAR(stamp);
+                Py_CLEAR(data);
+                if( val == NULL || PyList_Append(entries, val) != 0 ) {
+                        goto error;
+                }
+                Py_CLEAR(val);
+        }
+
+        return Py_BuildValue("{s:I,s:k,s:O,s:O,s:O,s:O,s:s,s:N}",
+                             "handle", sel->handle,
+                             "token", (unsigned long) sel->token,
+                             "valid", (sel->status & 0x01 ? Py_True : Py_False),
+                             "full", (sel->status & 0x02 ? Py_True : Py_False),
+                             "changed", (sel->changed ? Py_True : Py_False),
+                             "reset", (sel->reset ? Py_True : Py_False),
+                             "cursor", sel_cursor_format(&sel->next, cursor, sizeof(cursor)),
+                             "entries", entries);
+
+ error:
+        Py_XDECREF(stamp);
+        Py_XDECREF(data);
+        Py_XDECREF(val);
+        Py_DECREF(entries);
+        return NULL;
+}
+
+
+static PyObject *dmidecode_event_log(PyObject *self, PyObject *args, PyObject *keywds)
+{
+        static char *keywordlist[] = {"cursor", "devmem", NULL};
+        Snapshot_t *snap = NULL;
+        Sel_t *sel = NULL;
+        Sel_cursor cursor;
+        PyObject *pydata = NULL;
+        char *cursorstr = NULL, *devmem = NULL;
+        options opt;
+        int ret = 0;
+
+        if( !PyArg_ParseTupleAndKeywords(args, keywds, "|zz", keywordlist, &cursorstr, &devmem) ) {
+                return NULL;
+        }
+        if( (cursorstr != NULL) && (sel_cursor_parse(&cursor, cursorstr) != 0) ) {
+                PyErr_Format(PyExc_ValueError, "Invalid event log cursor '%s'", cursorstr);
+                return NULL;
+        }
+
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        snap = dmidecode_read_snapshot(&opt, &ret);
+        if( snap != NULL ) {
+                // The log area is not part of a dump file, it is always read from a memory device
+                sel = sel_read(opt.logdata, snap, (devmem != NULL ? devmem : opt.devmem),
+                               (cursorstr != NULL ? &cursor : NULL));
+        }
+        snapshot_free(snap);
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        if( ret != 0 ) {
+                PyReturnError(PyExc_RuntimeError, "Error decoding DMI data");
+        }
+        if( sel == NULL ) {
+                Py_RETURN_NONE;
+        }
+        pydata = dmidecode_sel_dict(sel);
+        sel_free(sel);
+        return pydata;
+}
+
+
+/**
+ * Converts columns to a dictionary keyed by the column names.  Integers are
+ * given as array.array('q'), strings as a tuple of an array.array('i') of
+ * dictionary indexes and the list of distinct strings.
+ */
+static PyObject *dmidecode_columns_dict(const Columns_t *cs)
+{
+        PyObject *arraymod = NULL, *data = NULL, *val = NULL, *dict = NULL, *item = NULL;
+        unsigned int i, j;
+
+        if( (arraymod = PyImport_ImportModule("array")) == NULL ) {
+                return NULL;
+        }
+        if( (data = PyDict_New()) == NULL ) {
+                goto error;
+        }
+        for( i = 0; i < cs->ncols; i++ ) {
+                const Column_t *col = &cs->cols[i];
+
+                if( col->kind == COLUMN_INT ) {
+                        val = PyObject_CallMethod(arraymod, "array", "sN", "q",
+                                                  PyBytes_FromStringAndSize((const char *) col->ints,
+                                                                            cs->rows * sizeof(long long)));
+                } else {
+                        if( (dict = PyList_New(col->ndict)) == NULL ) {
+                                goto error;
+                        }
+                        for( j = 0; j < col->ndict; j++ ) {
+                                item = PyUnicode_DecodeUTF8(col->dict[j], strlen(col->dict[j]), "replace");
+                                if( item == NULL ) {
+                                        goto error;
+                                }
+                                PyList_SET_ITEM(dict, j, item);
+                        }
+                        // Py_BuildValue() releases the "N" arguments on failure too
+                        val = Py_BuildValue("(NN)",
+                                            PyObject_CallMethod(arraymod, "array", "sN", "i",
+                                                                PyBytes_FromStringAndSize((const char *) col->codes,
+                                                                                          cs->rows * sizeof(int))),
+                                            dict);
+                        dict = NULL;
+                }
+                if( val == NULL || PyDict_SetItemString(data, col->name, val) != 0 ) {
+                        goto error;
+                }
+                Py_CLEAR(val);
+        }
+        Py_DECREF(arraymod);
+        return data;
+
+ error:
+        Py_XDECREF(val);
+        Py_XDECREF(dict);
+        Py_XDECREF(data);
+        Py_DECREF(arraymod);
+        return NULL;
+}
+
+
+static PyObject *dmidecode_columns(PyObject *self, PyObject *args, PyObject *keywds)
+{
+        static char *keywordlist[] = {"type", "archive", NULL};
+        const char *archive = NULL;
+        Snapshot_t *snap = NULL;
+        Columns_t *cs = NULL;
+        Archive_t *ar = NULL;
+        Archive_entry e;
+        PyObject *pydata = NULL;
+        options opt;
+        int type = 0, ret = 0;
+        u32 i;
+
+        if( !PyArg_ParseTupleAndKeywords(args, keywds, "i|z", keywordlist, &type, &archive) ) {
+                return NULL;
+        }
+        if( (type < 0) || (type > 255) || !columns_supported(type) ) {
+                PyErr_Format(PyExc_ValueError, "No columns for structure type %d", type);
+                return NULL;
+        }
+        if( dmidecode_begin(self, &opt, 0) != 0 ) {
+                return NULL;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        if( archive == NULL ) {
+                snap = dmidecode_read_snapshot(&opt, &ret);
+                if( (snap != NULL) && snap->found && (snap->table != NULL)
+                    && ((cs = columns_new(opt.logdata, type, 0)) != NULL)
+                    && (columns_add(opt.logdata, cs, snap, NULL, 0) < 0) ) {
+                        ret = 1;
+                }
+                snapshot_free(snap);
+        } else if( (ar = archive_open(opt.logdata, archive)) != NULL ) {
+                if( (cs = columns_new(opt.logdata, type, 1)) == NULL ) {
+                        ret = 1;
+                }
+                // Every member is read, indexed and dropped in turn
+                for( i = 0; (ret == 0) && (i < ar->count); i++ ) {
+                        if( (archive_entry(ar, i, &e) != 0) || ((snap = archive_snapshot(opt.logdata, ar, i)) == NULL)
+                            || (snap->table == NULL) ) {
+                                log_append(opt.logdata, LOGFL_NORMAL, LOG_WARNING,
+                                           "Skipping broken member %u of the DMI archive", i);
+                        } else if( columns_add(opt.logdata, cs, snap, e.host, e.hostlen) < 0 ) {
+                                ret = 1;
+                        }
+                        snapshot_free(snap);
+                        snap = NULL;
+                }
+                archive_close(ar);
+        }
+        Py_END_ALLOW_THREADS
+        dmidecode_end(self, &opt);
+
+        if( (archive != NULL) && (ar == NULL) ) {
+                PyErr_Format(PyExc_IOError, "Could not open the DMI archive %s", archive);
+                return NULL;
+        }
+        if( ret != 0 ) {
+                columns_free(cs);
+                PyReturnError(PyExc_RuntimeError, "Error decoding DMI data");
+        }
+        if( cs == NULL ) {
+                Py_RETURN_NONE;
+        }
+        pydata = dmidecode_columns_dict(cs);
+        columns_free(cs);
+        return pydata;
+}
+
+
+static Snapshot_t *dmidecode_diff_snapshot(options *opt, const char *dumpfile)
+{
+        Snapshot_t *snap = NULL;
+        const char *f = (dumpfile != NULL ? dumpfile : (opt->dumpfile ? opt->dumpfile : opt->devmem));
+
+        if( dumpfile == NULL ) {
+                dumpfile = opt->dumpfile;
+        }
+        if( access(f, R_OK) < 0 ) {
+                PyReturnError(PyExc_IOError, "Permission denied to memory file/device (%s)", f);
+        }
+        snap = snapshot_read(opt->logdata, opt->devmem, dumpfile);
+        if( (snap == NULL) || !snap->found || (snap->table == NULL) ) {
+                snapshot_free(snap);
+                PyReturnError(PyExc_IOError, "Could not read the DMI table from %s", f);
+        }
+        return snap;
+}
+
+
+static PyObject *dmidecode_diff_struct(xmlNode *st_n)
+{
+        PyObject *st = PyDict_New();
+        PyObject *val = NULL;
+        char *attr = NULL;
+
+        val = PYNUMBER_FROMLONG(atoi(dmixml_GetAttrValue(st_n, "type")));
+        PyDict_SetItemString(st, "type", val);
+        Py_DECREF(val);
+        val = PYNUMBER_FROMLONG(strtol(dmixml_GetAttrValue(st_n, "handle"), NULL, 16));
+        PyDict_SetItemString(st, "handle", val);
+        Py_DECREF(val);
+        if( (attr = dmixml_GetAttrValue(st_n, "locator")) != NULL ) {
+                val = PYTEXT_FROMSTRING(attr);
+                PyDict_SetItemString(st, "locator", val);
+                Py_DECREF(val);
+        }
+        return st;
+}
+
+
+static PyObject *dmidecode_diff(PyObject *self, PyObject *args)
+{
+        options query, *opt = &query;
+        const char *oldfile = NULL, *newfile = NULL;
+        Snapshot_t *old = NULL, *new = NULL;
+        xmlNode *dmixml_n = NULL, *diff_n = NULL, *ptr = NULL;
+        PyObject *added = NULL, *removed = NULL, *changed = NULL, *pydata = NULL;
+
+        if( !PyArg_ParseTuple(args, (char *)"s|z", &oldfile, &newfile) ) {
+                return NULL;
+        }
+        if( dmidecode_begin(self, opt, 0) != 0 ) {
+                return NULL;
+        }
+
+        if( (old = dmidecode_diff_snapshot(opt, oldfile)) == NULL ) {
+                dmidecode_end(self, opt);
+                return NULL;
+        }
+        if( (new = dmidecode_diff_snapshot(opt, newfile)) == NULL ) {
+                snapshot_free(old);
+                dmidecode_end(self, opt);
+                return NULL;
+        }
+
+        dmixml_n = xmlNewNode(NULL, (xmlChar *) "dmidecode");
+        assert( dmixml_n != NULL );
+        Py_BEGIN_ALLOW_THREADS
+        diff_n = dmidiff_compare(opt->logdata, old, new, dmixml_n);
+        Py_END_ALLOW_THREADS
+        snapshot_free(old);
+        snapshot_free(new);
+        dmidecode_end(self, opt);
+        if( diff_n == NULL ) {
+                xmlFreeNode(dmixml_n);
+                PyReturnError(PyExc_RuntimeError, "Error comparing DMI data");
+        }
+
+        added = PyList_New(0);
+        removed = PyList_New(0);
+        changed = PyList_New(0);
+        foreach_xmlnode(diff_n->children, ptr) {
+                PyObject *st = NULL;
+
+                if( ptr->type != XML_ELEMENT_NODE ) {
+                        continue;
+                }
+                st = dmidecode_diff_struct(ptr);
+                if( xmlStrcmp(ptr->name, (xmlChar *) "Added") == 0 ) {
+                        PyList_Append(added, st);
+                } else if( xmlStrcmp(ptr->name, (xmlChar *) "Removed") == 0 ) {
+                        PyList_Append(removed, st);
+                } else {
+                        PyObject *fields = PyDict_New();
+                        PyObject *val = NULL;
+                        xmlNode *field_n = NULL;
+
+                        val = PYNUMBER_FROMLONG(strtol(dmixml_GetAttrValue(ptr, "new_handle"), NULL, 16));
+                        PyDict_SetItemString(st, "new_handle", val);
+                        Py_DECREF(val);
+                        val = PYTEXT_FROMSTRING(dmixml_GetAttrValue(ptr, "matched"));
+                        PyDict_SetItemString(st, "matched", val);
+                        Py_DECREF(val);
+
+                        foreach_xmlnode(ptr->children, field_n) {
+                                char *o = dmixml_GetAttrValue(field_n, "old");
+                                char *n = dmixml_GetAttrValue(field_n, "new");
+
+                                if( field_n->type != XML_ELEMENT_NODE ) {
+                                        continue;
+                                }
+                                val = Py_BuildValue("(zz)", o, n);
+                                PyDict_SetItemString(fields, dmixml_GetAttrValue(field_n, "name"), val);
+                                Py_DECREF(val);
+                        }
+                        PyDict_SetItemString(st, "fields", fields);
+                        Py_DECREF(fields);
+                        PyList_Append(changed, st);
+                }
+                Py_DECREF(st);
+        }
+        xmlFreeNode(dmixml_n);
+
+        pydata = Py_BuildValue("{s:N,s:N,s:N}", "added", added, "removed", removed, "changed", changed);
+        return pydata;
+}
+
+
+static PyMethodDef DMIDataMethods[] = {
+        {(char *)"dump", dmidecode_dump, METH_NOARGS, (char *)"Dump dmidata to set file"},
+        {(char *)"get_dev", dmidecode_get_dev, METH_NOARGS,
+         (char *)"Get an alternative memory device file"},
+        {(char *)"set_dev", dmidecode_set_dev, METH_O,
+         (char *)"Set an alternative memory device file"},
+        {(char *)"get_units", dmidecode_get_units, METH_NOARGS,
+         (char *)"Get how values with a unit are returned, 'text' or 'canonical'"},
+        {(char *)"set_units", dmidecode_set_units, METH_O,
+         (char *)"Return values with a unit as display strings ('text', the default) or as "
+                 "integers in bytes, Hz, mV, mA, mW, mWh, bits or ns ('canonical')"},
+
+        {(char *)"bios", dmidecode_get_bios, METH_VARARGS, (char *)"BIOS Data"},
+        {(char *)"system", dmidecode_get_system, METH_VARARGS, (char *)"System Data"},
+        {(char *)"baseboard", dmidecode_get_baseboard, METH_VARARGS, (char *)"Baseboard Data"},
+        {(char *)"chassis", dmidecode_get_chassis, METH_VARARGS, (char *)"Chassis Data"},
+        {(char *)"processor", dmidecode_get_processor, METH_VARARGS, (char *)"Processor Data"},
+        {(char *)"memory", dmidecode_get_memory, METH_VARARGS, (char *)"Memory Data"},
+        {(char *)"cache", dmidecode_get_cache, METH_VARARGS, (char *)"Cache Data"},
+        {(char *)"connector", dmidecode_get_connector, METH_VARARGS, (char *)"Connector Data"},
+        {(char *)"slot", dmidecode_get_slot, METH_VARARGS, (char *)"Slot Data"},
+
+        {(char *)"QuerySection", dmidecode_get_section, METH_O,
+         (char *) "Queries the DMI data structure for a given section name.  A section"
+         "can often contain several DMI type elements"
+        },
+
+        {(char *)"type", dmidecode_get_type, METH_VARARGS, (char *)"By Type"},
+
+        {(char *)"QueryTypeId", dmidecode_get_type, METH_VARARGS,
+         (char *) "Queries the DMI data structure for a specific DMI type."
+        },
+
+        {(char *)"pythonmap", dmidecode_set_pythonxmlmap, METH_O,
+         (char *) "Use another python dict map definition. The default file is " PYTHON_XML_MAP},
+
+        {(char *)"get_pythonmap", dmidecode_get_pythonxmlmap, METH_NOARGS,
+         (char *) "Get the file of the python dict map definition"},
+
+        {(char *)"xmlapi", dmidecode_xmlapi, METH_VARARGS | METH_KEYWORDS,
+         (char *) "Internal API for retrieving data as raw XML data"},
+
+
+        {(char *)"get_warnings", dmidecode_get_warnings, METH_NOARGS,
+         (char *) "Retrieve warnings from operations"},
+
+        {(char *)"get_warnings_structured", dmidecode_get_warnings_structured, METH_NOARGS,
+         (char *) "Retrieve errors and warnings as a list of records with level, message, "
+         "count and the first and last query id"},
+
+        {(char *)"clear_warnings", dmidecode_clear_warnings, METH_NOARGS,
+         (char *) "Clear all warnings"},
+
+        {(char *)"stream", (PyCFunction)dmidecode_stream, METH_VARARGS | METH_KEYWORDS,
+         (char *) "Decodes a section or a type straight to JSON or CBOR (format='cbor'), with "
+         "the same layout as the dictionaries returned by QuerySection() and type().  JSON is "
+         "returned as a string and CBOR as bytes, or written to fd if given, in which case the "
+         "number of bytes is returned"},
+
+        {(char *)"get_stats", dmidecode_get_stats, METH_NOARGS,
+         (char *) "Returns the instrumentation counters collected since the module was loaded "
+         "or reset_stats() was called.  The counters are shared by all interpreters in the process"},
+
+        {(char *)"reset_stats", dmidecode_reset_stats, METH_NOARGS,
+         (char *) "Resets all instrumentation counters, in all interpreters"},
+
+        {(char *)"structures", (PyCFunction)dmidecode_structures, METH_VARARGS | METH_KEYWORDS,
+         (char *) "Reads the DMI table once for a section or typeid keyword, without decoding it.  "
+         "Returns a table reference and the (handle, index) pairs of the selected structures; "
+         "used by dmidecode.dmidecodeLazy"},
+
+        {(char *)"decode_structure", dmidecode_decode_structure, METH_VARARGS,
+         (char *) "Decodes one structure of a table returned by structures(), and returns it as "
+         "type() and QuerySection() give it"},
+
+        {(char *)"fingerprint", dmidecode_get_fingerprint, METH_NOARGS,
+         (char *) "Returns a fingerprint of the DMI table, or None if it cannot be read"},
+
+        {(char *)"dump_table", dmidecode_dump_table, METH_O,
+         (char *) "Writes the entry point and DMI table of the current device to a dump file, "
+         "as one consistent read.  Returns the fingerprint of the written table, or None "
+         "if it cannot be read or written"},
+
+        {(char *)"dump_info", dmidecode_dump_info, METH_VARARGS,
+         (char *) "Returns what the header of a dump file records, as a dict with the dump "
+         "format version (1 for dump files without a header), the source and time the "
+         "table was read from, the host, the entry point type, the table length, its "
+         "fingerprint and whether the table matches its checksum.  Returns None if the "
+         "file holds no entry point"},
+
+        {(char *)"archive_append", dmidecode_archive_append, METH_VARARGS,
+         (char *) "Appends the DMI tables of many hosts to an archive file, which is created "
+         "if needed.  Takes the archive and a list of (host, dumpfile) pairs; a dumpfile of "
+         "None reads the current device.  Returns the number of members in the archive"},
+
+        {(char *)"archive_list", dmidecode_archive_list, METH_VARARGS,
+         (char *) "Returns the members of an archive in order, as dicts with the host, the "
+         "fingerprint of its table and the time it was added"},
+
+        {(char *)"set_archive", dmidecode_set_archive_member, METH_VARARGS,
+         (char *) "Decodes one member of an archive, selected by host name or by index, "
+         "until set_dev() is called again.  The member is looked up in the archive index "
+         "on every query, without reading the other members"},
+
+        {(char *)"has_changed", dmidecode_has_changed, METH_NOARGS,
+         (char *) "Returns True if the DMI table changed since the last query"},
+
+        {(char *)"memory_summary", dmidecode_memory_summary, METH_NOARGS,
+         (char *) "Returns the installed and maximum memory, the population of every memory "
+         "array and channel, the memory type and speed mix and the mapped address ranges, "
+         "computed straight from the DMI table.  Sizes are in bytes, speeds in MT/s.  "
+         "Returns None if the table cannot be read"},
+
+        {(char *)"processor_summary", dmidecode_processor_summary, METH_NOARGS,
+         (char *) "Returns the socket, core and thread counts, and for every processor socket "
+         "its speeds in MHz and the installed size of its L1, L2 and L3 caches in bytes, "
+         "computed straight from the DMI table.  Returns None if the table cannot be read"},
+
+        {(char *)"event_log", (PyCFunction)dmidecode_event_log, METH_VARARGS | METH_KEYWORDS,
+         (char *) "Reads the System Event Log described by the type 15 structure.  The log area "
+         "is read from the memory device, or from the devmem keyword.  Pass the cursor of an "
+         "earlier result to get only the entries added since; if the Log Change Token has not "
+         "moved the log area is not read at all and changed is False.  Returns None if there "
+         "is no memory-mapped event log"},
+
+        {(char *)"columns", (PyCFunction)dmidecode_columns, METH_VARARGS | METH_KEYWORDS,
+         (char *) "Returns the fields of every structure of one type as columns, for processors "
+         "(4), system slots (9) and memory devices (17).  Integer columns are array.array('q') "
+         "with -1 for a missing or unknown value; enumerated fields keep their SMBIOS codes.  "
+         "String columns are (codes, strings) tuples, codes being an array.array('i') of "
+         "indexes into strings, or -1 for no string.  With the archive keyword, the rows of "
+         "all members are returned and a host column comes first.  Returns None if the DMI "
+         "table cannot be read"},
+
+        {(char *)"diff", dmidecode_diff, METH_VARARGS,
+         (char *) "Compares the DMI tables of two dump files, or of a dump file and the current device.  "
+         "Returns the added, removed and changed structures"},
+
+        {NULL, NULL, 0, NULL}
+};
+
+static void destruct_options(options *opt)
+{
+        if( opt->mappingxml != NULL ) {
+                xmlFreeDoc(opt->mappingxml);
+                opt->mappingxml = NULL;
+        }
+
+        if( opt->python_xml_map != NULL ) {
+                free(opt->python_xml_map);
+                opt->python_xml_map = NULL;
+        }
+
+        if( opt->dmiversion_n != NULL ) {
+                xmlFreeNode(opt->dmiversion_n);
+                opt->dmiversion_n = NULL;
+        }
+
+        if( opt->dumpfile != NULL ) {
+                free(opt->dumpfile);
+                opt->dumpfile = NULL;
+        }
+
+        if( opt->archive_host != NULL ) {
+                free(opt->archive_host);
+                opt->archive_host = NULL;
+        }
+
+        if( opt->logdata != NULL ) {
+                char *warn = NULL;
+
+                log_clear_partial(opt->logdata, LOG_WARNING, 0);
+                warn = log_retrieve(opt->logdata, LOG_WARNING);
                 if( warn ) {
                         fprintf(stderr, "\n** COLLECTED WARNINGS **\n%s** END OF WARNINGS **\n\n", warn);
                         free(warn);
                 }
                 log_close(opt->logdata);
+                opt->logdata = NULL;
         }
+}
 
-        free(ptr);
+/**
+ * Sets up the state of a new module object.  Under Python 3 this runs once
+ * for every interpreter importing the module.
+ */
+static int dmidecode_exec(PyObject *module)
+{
+        dmidecode_state *st = dmidecode_get_state(module);
+        PyObject *dmi = Py_None;
+        char *dmiver = NULL;
+
+        memset(st, 0, sizeof(dmidecode_state));
+        init(&st->opt);
+        if( (st->lock = PyThread_allocate_lock()) == NULL ) {
+                PyErr_NoMemory();
+                return -1;
+        }
+
+        if( PyModule_AddObject(module, "version", PYTEXT_FROMSTRING(VERSION)) < 0 ) {
+                return -1;
+        }
+
+        st->opt.dmiversion_n = dmidecode_get_version(&st->opt);
+        dmiver = dmixml_GetContent(st->opt.dmiversion_n);
+        if( dmiver != NULL ) {
+                dmi = PYTEXT_FROMSTRING(dmiver);
+        } else {
+                Py_INCREF(dmi);
+        }
+        if( PyModule_AddObject(module, "dmi", dmi) < 0 ) {
+                return -1;
+        }
+        return 0;
 }
 
 #ifdef IS_PY3K
+static void dmidecode_free(void *module)
+{
+        dmidecode_state *st = dmidecode_get_state((PyObject *) module);
+
+        if( st == NULL ) {
+                return;
+        }
+        destruct_options(&st->opt);
+        if( st->lock != NULL ) {
+                PyThread_free_lock(st->lock);
+                st->lock = NULL;
+        }
+}
+
+static PyModuleDef_Slot dmidecodemod_slots[] = {
+        {Py_mod_exec, dmidecode_exec},
+#ifdef Py_mod_multiple_interpreters
+        {Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#ifdef Py_mod_gil
+        {Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+        {0, NULL}
+};
+
 static struct PyModuleDef dmidecodemod_def = {
     PyModuleDef_HEAD_INIT,
     "dmidecodemod",
     NULL,
-    -1,
+    sizeof(dmidecode_state),
     DMIDataMethods,
+    dmidecodemod_slots,
     NULL,
     NULL,
-    NULL,
-    NULL
+    dmidecode_free
 };
 
 PyMODINIT_FUNC
 PyInit_dmidecodemod(void)
+{
+        xmlInitParser();
+        xmlXPathInit();
+        snapshot_init_umask();
+
+        return PyModuleDef_Init(&dmidecodemod_def);
+}
 #else
 PyMODINIT_FUNC
 initdmidecodemod(void)
-#endif
 {
-        char *dmiver = NULL;
         PyObject *module = NULL;
-        PyObject *version = NULL;
-        options *opt;
 
         xmlInitParser();
         xmlXPathInit();
+        snapshot_init_umask();
 
-        opt = (options *) malloc(sizeof(options)+2);
-        memset(opt, 0, sizeof(options)+2);
-        init(opt);
-#ifdef IS_PY3K
-        module = PyModule_Create(&dmidecodemod_def);
-#else
         module = Py_InitModule3((char *)"dmidecodemod", DMIDataMethods,
                                 "Python extension module for dmidecode");
-#endif
         if (module == NULL)
                 MODINITERROR;
-
-        version = PYTEXT_FROMSTRING(VERSION);
-        Py_INCREF(version);
-        PyModule_AddObject(module, "version", version);
-
-        opt->dmiversion_n = dmidecode_get_version(opt);
-        dmiver = dmixml_GetContent(opt->dmiversion_n);
-        PyModule_AddObject(module, "dmi", dmiver ? PYTEXT_FROMSTRING(dmiver) : Py_None);
-
-        // Assign this options struct to the module as well with a destructor, that way it will
-        // clean up the memory for us.
-        // TODO: destructor has wrong type under py3?
-        PyModule_AddObject(module, "options", PyCapsule_New(opt, NULL, destruct_options));
-        global_options = opt;
-#ifdef IS_PY3K
-        return module;
-#endif
+        if( dmidecode_exec(module) < 0 )
+                MODINITERROR;
 }
+#endif
@@ -64,12 +64,14 @@
 #include "dmihelper.h"
 
 xmlNode *dmidecode_get_version(options *);
+Snapshot_t *dmidecode_read_snapshot(options *opt, int *ret);
 
 extern void dmi_dump(xmlNode *node, struct dmi_header *h);
 extern int address_from_efi(Log_t *logp, size_t * address);
 extern void to_dmi_header(struct dmi_header *h, u8 * data);
 extern int smbios_decode(Log_t *logp, int type, u8 *buf, const char *devmem, xmlNode *node);
 extern int legacy_decode(Log_t *logp, int type, u8 *buf, const char *devmem, xmlNode *node);
+extern xmlNode *smbios3_decode_get_version(u8 * buf, const char *devmem);
 extern xmlNode *smbios_decode_get_version(u8 * buf, const char *devmem);
 extern xmlNode *legacy_decode_get_version(u8 * buf, const char *devmem);
 extern void *mem_chunk(Log_t *logp, size_t base, size_t len, const char *devmem);
@@ -0,0 +1,553 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+/**
+ *  @file dmidiff.c
+ *  @brief Structural comparison of two DMI snapshots
+ *
+ *  Structures are compared on their raw bytes first.  Only the structures
+ *  which differ are decoded, and their decoded fields are then compared to
+ *  find out what changed.
+ *
+ *  Structures are paired by type and handle.  When a BIOS update renumbers
+ *  the handles, the locator string (socket, slot or device locator) is used
+ *  to pair them instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <libxml/tree.h>
+
+#include "types.h"
+#include "util.h"
+#include "dmilog.h"
+#include "dmixml.h"
+#include "dmidecode.h"
+#include "dmisnapshot.h"
+#include "dmidiff.h"
+
+#define DIFF_MATCH_NONE    0
+#define DIFF_MATCH_HANDLE  1
+#define DIFF_MATCH_LOCATOR 2
+
+#define DIFF_HANDLE_KEY(st) ((u32) (st)->type << 16 | (st)->handle)
+
+/**
+ *  String offsets identifying the physical location of a structure
+ */
+static const struct {
+        u8 type;
+        u8 offset;
+} dmidiff_locators[] = {
+        { 4, 0x04},             /* Processor, Socket Designation */
+        { 7, 0x04},             /* Cache, Socket Designation */
+        { 8, 0x04},             /* Port Connector, Internal Reference Designator */
+        { 9, 0x04},             /* System Slots, Slot Designation */
+        {17, 0x10},             /* Memory Device, Device Locator */
+        {22, 0x04},             /* Portable Battery, Location */
+        {26, 0x04},             /* Voltage Probe, Description */
+        {28, 0x04},             /* Temperature Probe, Description */
+        {29, 0x04},             /* Electrical Current Probe, Description */
+        {41, 0x04},             /* Onboard Devices Extended Information, Reference Designation */
+};
+
+/**
+ *  One side of the comparison
+ */
+typedef struct {
+        const Snapshot_struct *st;
+        const char *locator;
+        int match;              /**< Index of the paired structure on the other side, -1 if none */
+        int how;                /**< DIFF_MATCH_* */
+        int next;               /**< Next structure with the same type and locator, -1 if none */
+} dmidiff_item;
+
+typedef struct {
+        char *name;
+        xmlChar *value;
+        int seen;
+} dmidiff_field;
+
+typedef struct {
+        dmidiff_field *f;
+        int count;
+        int size;
+} dmidiff_fields;
+
+
+static const char *dmidiff_locator(const Snapshot_t *snap, const Snapshot_struct *st)
+{
+        size_t i;
+
+        for( i = 0; i < sizeof(dmidiff_locators) / sizeof(dmidiff_locators[0]); i++ ) {
+                if( (dmidiff_locators[i].type == st->type) && (dmidiff_locators[i].offset < st->length) ) {
+                        return snapshot_string(snap, st,
+                                              snap->table[st->offset + dmidiff_locators[i].offset]);
+                }
+        }
+        return NULL;
+}
+
+
+static int dmidiff_locator_equal(const char *a, const char *b)
+{
+        if( (a == NULL) || (b == NULL) ) {
+                return a == b;
+        }
+        return strcmp(a, b) == 0;
+}
+
+
+static dmidiff_item *dmidiff_items(const Snapshot_t *snap)
+{
+        dmidiff_item *items = NULL;
+        u32 i;
+
+        items = (dmidiff_item *) calloc(snap->count + 1, sizeof(dmidiff_item));
+        if( items == NULL ) {
+                return NULL;
+        }
+        for( i = 0; i < snap->count; i++ ) {
+                items[i].st = &snap->structs[i];
+                items[i].locator = dmidiff_locator(snap, &snap->structs[i]);
+                items[i].match = -1;
+                items[i].next = -1;
+        }
+        return items;
+}
+
+
+static int dmidiff_key_cmp(const void *a, const void *b)
+{
+        uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+        return (x > y) - (x < y);
+}
+
+
+/**
+ * Sorts the structures by type and handle.  The index of a structure is in
+ * the low 32 bits of its key, so structures sharing a handle keep their
+ * order in the table.
+ *
+ * @return Returns the sorted keys, or NULL if out of memory
+ */
+static uint64_t *dmidiff_sort(const dmidiff_item *items, u32 cnt)
+{
+        uint64_t *keys = NULL;
+        u32 i;
+
+        if( (keys = (uint64_t *) malloc((cnt + 1) * sizeof(uint64_t))) == NULL ) {
+                return NULL;
+        }
+        for( i = 0; i < cnt; i++ ) {
+                keys[i] = (uint64_t) DIFF_HANDLE_KEY(items[i].st) << 32 | i;
+        }
+        qsort(keys, cnt, sizeof(uint64_t), dmidiff_key_cmp);
+        return keys;
+}
+
+
+/**
+ * Pairs structures with the same type and handle, by merging both sides
+ * sorted with dmidiff_sort().  In strict mode the locators must be equal
+ * as well, so that renumbered handles are left for the locator pass.
+ *
+ * Within a group sharing a type and handle, every structure on side a is
+ * offered the first unpaired structure on side b only.  In strict mode a
+ * structure whose locator differs from that one is left unpaired even if a
+ * later structure of the group has the same locator; the locator pass pairs
+ * it then.
+ */
+static void dmidiff_match_handle(dmidiff_item *a, const uint64_t *akeys, u32 acnt,
+                                 dmidiff_item *b, const uint64_t *bkeys, u32 bcnt, int strict)
+{
+        u32 i = 0, j = 0, end, ai, bj;
+        u32 key;
+
+        while( (i < acnt) && (j < bcnt) ) {
+                key = akeys[i] >> 32;
+                if( key < (bkeys[j] >> 32) ) {
+                        i++;
+                        continue;
+                }
+                if( key > (bkeys[j] >> 32) ) {
+                        j++;
+                        continue;
+                }
+                for( end = j; (end < bcnt) && ((bkeys[end] >> 32) == key); end++ ) {
+                        ;
+                }
+                for( ; (i < acnt) && ((akeys[i] >> 32) == key); i++ ) {
+                        ai = akeys[i] & 0xFFFFFFFF;
+                        if( a[ai].match != -1 ) {
+                                continue;
+                        }
+                        while( (j < end) && (b[bkeys[j] & 0xFFFFFFFF].match != -1) ) {
+                                j++;
+                        }
+                        if( j == end ) {
+                                continue;
+                        }
+                        bj = bkeys[j] & 0xFFFFFFFF;
+                        if( strict && !dmidiff_locator_equal(a[ai].locator, b[bj].locator) ) {
+                                continue;
+                        }
+                        a[ai].match = bj;
+                        b[bj].match = ai;
+                        a[ai].how = b[bj].how = DIFF_MATCH_HANDLE;
+                }
+                j = end;
+        }
+}
+
+
+static u32 dmidiff_locator_hash(const dmidiff_item *it)
+{
+        return crc32c(it->st->type, it->locator, strlen(it->locator));
+}
+
+
+/**
+ * Pairs the structures left over by the strict handle pass which have the
+ * same type and locator.  Side b is put in a hash table on (type, locator),
+ * where every slot holds the structures with one key in table order.
+ *
+ * @return Returns 0 on success, -1 if out of memory
+ */
+static int dmidiff_match_locator(dmidiff_item *a, u32 acnt, dmidiff_item *b, u32 bcnt)
+{
+        int *slots = NULL;
+        u32 nslots = 16, mask, i, j, h;
+
+        while( nslots < 2 * bcnt ) {
+                nslots <<= 1;
+        }
+        mask = nslots - 1;
+        if( (slots = (int *) malloc(nslots * sizeof(int))) == NULL ) {
+                return -1;
+        }
+        memset(slots, 0xFF, nslots * sizeof(int));
+
+        /* Inserted from the end, so every chain is in table order */
+        for( j = bcnt; j > 0; j-- ) {
+                if( (b[j - 1].match != -1) || (b[j - 1].locator == NULL) ) {
+                        continue;
+                }
+                for( h = dmidiff_locator_hash(&b[j - 1]) & mask; slots[h] != -1; h = (h + 1) & mask ) {
+                        if( (b[slots[h]].st->type == b[j - 1].st->type)
+                            && (strcmp(b[slots[h]].locator, b[j - 1].locator) == 0) ) {
+                                break;
+                        }
+                }
+                b[j - 1].next = slots[h];
+                slots[h] = j - 1;
+        }
+
+        for( i = 0; i < acnt; i++ ) {
+                if( (a[i].match != -1) || (a[i].locator == NULL) ) {
+                        continue;
+                }
+                for( h = dmidiff_locator_hash(&a[i]) & mask; slots[h] != -1; h = (h + 1) & mask ) {
+                        if( (b[slots[h]].st->type == a[i].st->type)
+                            && (strcmp(b[slots[h]].locator, a[i].locator) == 0) ) {
+                                break;
+                        }
+                }
+                /* The head of a chain is its first unpaired structure, or its last
+                 * one once all are paired; the slot is kept so probing goes on */
+                if( (slots[h] == -1) || (b[slots[h]].match != -1) ) {
+                        continue;
+                }
+                j = slots[h];
+                a[i].match = j;
+                b[j].match = i;
+                a[i].how = b[j].how = DIFF_MATCH_LOCATOR;
+                if( b[j].next != -1 ) {
+                        slots[h] = b[j].next;
+                }
+        }
+        free(slots);
+        return 0;
+}
+
+
+static void dmidiff_field_add(dmidiff_fields *fl, const char *name, xmlChar *value)
+{
+        if( fl->count == fl->size ) {
+                dmidiff_field *f = NULL;
+
+                f = (dmidiff_field *) realloc(fl->f, (fl->size + 32) * sizeof(dmidiff_field));
+                if( f == NULL ) {
+                        xmlFree(value);
+                        return;
+                }
+                fl->f = f;
+                fl->size += 32;
+        }
+        fl->f[fl->count].name = strdup(name);
+        fl->f[fl->count].value = value;
+        fl->f[fl->count].seen = 0;
+        fl->count++;
+}
+
+
+/**
+ * Flattens a decoded structure into a list of field paths and values.
+ * Attributes become "path/@name", repeated elements get a [n] suffix.
+ */
+static void dmidiff_flatten(dmidiff_fields *fl, xmlNode *node, const char *path)
+{
+        char buf[512];
+        xmlAttr *attr = NULL;
+        xmlNode *ptr = NULL, *sib = NULL;
+        int children = 0;
+
+        for( attr = node->properties; attr != NULL; attr = attr->next ) {
+                snprintf(buf, sizeof(buf), "%s%s@%s", path, (path[0] ? "/" : ""), attr->name);
+                dmidiff_field_add(fl, buf, xmlGetProp(node, attr->name));
+        }
+
+        foreach_xmlnode(node->children, ptr) {
+                int idx = 0, total = 0;
+
+                if( ptr->type != XML_ELEMENT_NODE ) {
+                        continue;
+                }
+                children++;
+                foreach_xmlnode(node->children, sib) {
+                        if( (sib->type == XML_ELEMENT_NODE) && (xmlStrcmp(sib->name, ptr->name) == 0) ) {
+                                total++;
+                                if( sib == ptr ) {
+                                        idx = total;
+                                }
+                        }
+                }
+                if( total > 1 ) {
+                        snprintf(buf, sizeof(buf), "%s%s%s[%i]", path, (path[0] ? "/" : ""), ptr->name, idx);
+                } else {
+                        snprintf(buf, sizeof(buf), "%s%s%s", path, (path[0] ? "/" : ""), ptr->name);
+                }
+                dmidiff_flatten(fl, ptr, buf);
+        }
+
+        if( (children == 0) && (path[0] != '\0') ) {
+                dmidiff_field_add(fl, path, xmlNodeGetContent(node));
+        }
+}
+
+
+static void dmidiff_fields_free(dmidiff_fields *fl)
+{
+        int i;
+
+        for( i = 0; i < fl->count; i++ ) {
+                free(fl->f[i].name);
+                xmlFree(fl->f[i].value);
+        }
+        free(fl->f);
+        fl->f = NULL;
+        fl->count = fl->size = 0;
+}
+
+
+static void dmidiff_add_field(xmlNode *chg_n, const char *name, const xmlChar *old, const xmlChar *new)
+{
+        xmlNode *field_n = xmlNewChild(chg_n, NULL, (xmlChar *) "Field", NULL);
+        assert( field_n != NULL );
+
+        dmixml_AddAttribute(field_n, "name", "%s", name);
+        if( old != NULL ) {
+                dmixml_AddAttribute(field_n, "old", "%s", (const char *) old);
+        }
+        if( new != NULL ) {
+                dmixml_AddAttribute(field_n, "new", "%s", (const char *) new);
+        }
+}
+
+
+/**
+ * Decodes both versions of a changed structure and adds a Field node for
+ * every decoded value which differs.
+ */
+static void dmidiff_fields_compare(xmlNode *chg_n,
+                                   const Snapshot_t *old, const Snapshot_struct *ost,
+                                   const Snapshot_t *new, const Snapshot_struct *nst)
+{
+        xmlNode *old_n = NULL, *new_n = NULL;
+        dmidiff_fields ofl = {NULL, 0, 0}, nfl = {NULL, 0, 0};
+        int i, j, hint = 0;
+
+        old_n = xmlNewNode(NULL, (xmlChar *) "dmidecode");
+        new_n = xmlNewNode(NULL, (xmlChar *) "dmidecode");
+        assert( (old_n != NULL) && (new_n != NULL) );
+
+        dmidiff_flatten(&ofl, snapshot_decode_struct(old, ost, old_n), "");
+        dmidiff_flatten(&nfl, snapshot_decode_struct(new, nst, new_n), "");
+
+        for( i = 0; i < ofl.count; i++ ) {
+                /* The fields are mostly in the same order on both sides */
+                for( j = 0; j < nfl.count; j++ ) {
+                        int k = (hint + j) % nfl.count;
+
+                        if( !nfl.f[k].seen && (strcmp(ofl.f[i].name, nfl.f[k].name) == 0) ) {
+                                nfl.f[k].seen = 1;
+                                ofl.f[i].seen = 1;
+                                hint = k + 1;
+                                if( xmlStrcmp(ofl.f[i].value, nfl.f[k].value) != 0 ) {
+                                        dmidiff_add_field(chg_n, ofl.f[i].name,
+                                                          ofl.f[i].value, nfl.f[k].value);
+                                }
+                                break;
+                        }
+                }
+                if( !ofl.f[i].seen ) {
+                        dmidiff_add_field(chg_n, ofl.f[i].name, ofl.f[i].value, NULL);
+                }
+        }
+        for( j = 0; j < nfl.count; j++ ) {
+                if( !nfl.f[j].seen ) {
+                        dmidiff_add_field(chg_n, nfl.f[j].name, NULL, nfl.f[j].value);
+                }
+        }
+
+        dmidiff_fields_free(&ofl);
+        dmidiff_fields_free(&nfl);
+        xmlFreeNode(old_n);
+        xmlFreeNode(new_n);
+}
+
+
+static xmlNode *dmidiff_add_struct(xmlNode *diff_n, const char *tagname, const dmidiff_item *it)
+{
+        xmlNode *st_n = xmlNewChild(diff_n, NULL, (xmlChar *) tagname, NULL);
+        assert( st_n != NULL );
+
+        dmixml_AddAttribute(st_n, "type", "%i", it->st->type);
+        dmixml_AddAttribute(st_n, "handle", "0x%04x", it->st->handle);
+        if( it->locator != NULL ) {
+                dmixml_AddAttribute(st_n, "locator", "%s", it->locator);
+        }
+        return st_n;
+}
+
+
+/**
+ * Compares two snapshots structure by structure.
+ *
+ * @param logp      Pointer to the log buffer
+ * @param old       The old snapshot
+ * @param new       The new snapshot
+ * @param parent_n  XML node to add the result to
+ *
+ * @return Returns a DMIdiff node with Added, Removed and Changed children, or
+ *         NULL if one of the snapshots holds no table.
+ */
+xmlNode *dmidiff_compare(Log_t *logp, Snapshot_t *old, Snapshot_t *new, xmlNode *parent_n)
+{
+        dmidiff_item *oit = NULL, *nit = NULL;
+        uint64_t *okeys = NULL, *nkeys = NULL;
+        xmlNode *diff_n = NULL;
+        int added = 0, removed = 0, changed = 0;
+        u32 i;
+
+        if( (snapshot_index(old) < 0) || (snapshot_index(new) < 0) ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Cannot compare snapshots without a DMI table");
+                return NULL;
+        }
+
+        oit = dmidiff_items(old);
+        nit = dmidiff_items(new);
+        if( (oit == NULL) || (nit == NULL) ) {
+                goto nomem;
+        }
+
+        okeys = dmidiff_sort(oit, old->count);
+        nkeys = dmidiff_sort(nit, new->count);
+        if( (okeys == NULL) || (nkeys == NULL) ) {
+                goto nomem;
+        }
+        dmidiff_match_handle(oit, okeys, old->count, nit, nkeys, new->count, 1);
+        if( dmidiff_match_locator(oit, old->count, nit, new->count) < 0 ) {
+                goto nomem;
+        }
+        dmidiff_match_handle(oit, okeys, old->count, nit, nkeys, new->count, 0);
+        free(okeys);
+        free(nkeys);
+
+        diff_n = xmlNewChild(parent_n, NULL, (xmlChar *) "DMIdiff", NULL);
+        assert( diff_n != NULL );
+
+        for( i = 0; i < old->count; i++ ) {
+                const Snapshot_struct *ost = oit[i].st, *nst = NULL;
+                xmlNode *chg_n = NULL;
+
+                if( oit[i].match == -1 ) {
+                        dmidiff_add_struct(diff_n, "Removed", &oit[i]);
+                        removed++;
+                        continue;
+                }
+
+                nst = nit[oit[i].match].st;
+                if( (ost->size == nst->size)
+                    && (memcmp(old->table + ost->offset, new->table + nst->offset, ost->size) == 0) ) {
+                        continue;
+                }
+
+                chg_n = dmidiff_add_struct(diff_n, "Changed", &oit[i]);
+                dmixml_AddAttribute(chg_n, "new_handle", "0x%04x", nst->handle);
+                dmixml_AddAttribute(chg_n, "matched", "%s",
+                                    (oit[i].how == DIFF_MATCH_LOCATOR ? "locator" : "handle"));
+                dmidiff_fields_compare(chg_n, old, ost, new, nst);
+                changed++;
+        }
+
+        for( i = 0; i < new->count; i++ ) {
+                if( nit[i].match == -1 ) {
+                        dmidiff_add_struct(diff_n, "Added", &nit[i]);
+                        added++;
+                }
+        }
+
+        dmixml_AddAttribute(diff_n, "added", "%i", added);
+        dmixml_AddAttribute(diff_n, "removed", "%i", removed);
+        dmixml_AddAttribute(diff_n, "changed", "%i", changed);
+
+        free(oit);
+        free(nit);
+        return diff_n;
+
+ nomem:
+        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for snapshot comparison");
+        free(okeys);
+        free(nkeys);
+        free(oit);
+        free(nit);
+        return NULL;
+}
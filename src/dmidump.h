@@ -28,10 +28,9 @@
  */
 
 #ifndef _DMIDUMP_H
+#define _DMIDUMP_H
 
-#define NON_LEGACY 0
-#define LEGACY 1
-
+/* Returns 1 if the dump file was written, otherwise 0 */
 int dump(const char *memdev, const char *dumpfile);
 
 #endif
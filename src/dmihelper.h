@@ -54,6 +54,7 @@
 
 #include "types.h"
 #include "dmilog.h"
+#include "dmisnapshot.h"
 
 #define MAXVAL 1024
 
@@ -124,6 +125,14 @@ typedef struct _options {
         xmlNode *dmiversion_n;
         char *dumpfile;
         Log_t *logdata;
+        char fingerprint[SNAPSHOT_FPLEN];  /* Fingerprint of the last table read, empty if none */
+        int units;                         /* UNITS_TEXT or UNITS_CANONICAL, see set_units() */
+        char *archive_host;                /* Host of the archive member in dumpfile, see set_archive() */
+        long archive_index;                /* Member index if archive_host is NULL, -1 for a dump file */
 } options;
 
+/* How values with a unit are returned to Python */
+#define UNITS_TEXT      0       /* Display strings like "2048 MB", as in the pymap.xml value */
+#define UNITS_CANONICAL 1       /* Integers in bytes, Hz, mV, mWh, ..., from the unitvalue */
+
 #endif
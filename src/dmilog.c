@@ -34,21 +34,152 @@
 #include <string.h>
 
 #include "dmilog.h"
+#include "dmistats.h"
+#include "dmitrace.h"
 
 /**
- * Allocates memory for a new Log_t record
+ * Hash function used for duplicate detection (FNV-1a)
+ *
+ * @param str  String to hash
+ *
+ * @return Returns the hash value of str
+ */
+static unsigned int log_hash(const char *str)
+{
+	unsigned int h = 2166136261u;
+
+	while( *str ) {
+		h ^= (unsigned char) *str++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+
+/**
+ * Removes a ring buffer slot from its hash bucket
+ *
+ * @param logp  Pointer to the log buffer
+ * @param slot  Slot to unlink
+ */
+static void log_unlink(Log_t *logp, int slot)
+{
+	int *pp = &logp->bucket[logp->ring[slot].hash & (LOG_BUCKETS - 1)];
+
+	while( *pp != -1 ) {
+		if( *pp == slot ) {
+			*pp = logp->ring[slot].chain;
+			break;
+		}
+		pp = &logp->ring[*pp].chain;
+	}
+	logp->ring[slot].chain = -1;
+}
+
+
+/**
+ * Rebuilds all hash buckets from the records in the ring buffer
+ *
+ * @param logp  Pointer to the log buffer
+ */
+static void log_rehash(Log_t *logp)
+{
+	unsigned int i;
+
+	for( i = 0; i < LOG_BUCKETS; i++ ) {
+		logp->bucket[i] = -1;
+	}
+	for( i = 0; i < logp->used; i++ ) {
+		int slot = (logp->head + i) % LOG_CAPACITY;
+		int b = logp->ring[slot].hash & (LOG_BUCKETS - 1);
+
+		logp->ring[slot].chain = logp->bucket[b];
+		logp->bucket[b] = slot;
+	}
+}
+
+
+/**
+ * Looks up a record by its message
+ *
+ * @param logp  Pointer to the log buffer
+ * @param msg   Message to look for
+ * @param hash  log_hash() of msg
+ *
+ * @return Returns the slot of the record, or -1 if there is none
+ */
+static int log_find(Log_t *logp, const char *msg, unsigned int hash)
+{
+	int slot;
+
+	for( slot = logp->bucket[hash & (LOG_BUCKETS - 1)]; slot != -1; slot = logp->ring[slot].chain ) {
+		if( (logp->ring[slot].hash == hash) && (strcmp(logp->ring[slot].message, msg) == 0) ) {
+			return slot;
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * Adds a new record, logged once in the current query.  If the log buffer is
+ * full, the oldest record is dropped and counted in the dropped counter for
+ * its log level.
+ *
+ * @return Returns the slot of the new record, or -1 if memory ran out
+ */
+static int log_store(Log_t *logp, Log_f flags, int level, const char *msg, unsigned int hash)
+{
+	int slot, b;
+
+	if( logp->used == LOG_CAPACITY ) {
+		slot = logp->head;
+		log_unlink(logp, slot);
+		logp->dropped[logp->ring[slot].level]++;
+		free(logp->ring[slot].message);
+		logp->ring[slot].message = NULL;
+		logp->head = (logp->head + 1) % LOG_CAPACITY;
+		logp->used--;
+	}
+
+	slot = (logp->head + logp->used) % LOG_CAPACITY;
+	logp->ring[slot].message = strdup(msg);
+	if( !logp->ring[slot].message ) {
+		return -1;
+	}
+	b = hash & (LOG_BUCKETS - 1);
+	logp->ring[slot].level = level;
+	logp->ring[slot].flags = flags;
+	logp->ring[slot].read = 0;
+	logp->ring[slot].count = 1;
+	logp->ring[slot].first_query = logp->query;
+	logp->ring[slot].last_query = logp->query;
+	logp->ring[slot].hash = hash;
+	logp->ring[slot].chain = logp->bucket[b];
+	logp->bucket[b] = slot;
+	logp->used++;
+	return slot;
+}
+
+
+/**
+ * Allocates memory for a new log buffer
  *
  * @return Returns a pointer to a new Log_t record, otherwise NULL on error
  */
 Log_t * log_init()
 {
 	Log_t *ret = NULL;
+	int i;
 
-	ret = (Log_t *) calloc(1, sizeof(Log_t)+2);
+	ret = (Log_t *) calloc(1, sizeof(Log_t));
 	if( !ret ) {
 		fprintf(stderr, "** ERROR **  Could not allocate memory for log data\n");
+		return NULL;
+	}
+	for( i = 0; i < LOG_BUCKETS; i++ ) {
+		ret->bucket[i] = -1;
 	}
-	ret->level = -1; // Initialised - chain header pointer always have -1.
 	return ret;
 }
 
@@ -56,9 +187,10 @@ Log_t * log_init()
 
 
 /**
- * Registers a new log entry
+ * Registers a new log entry.  If the log buffer is full, the oldest record is
+ * dropped and counted in the dropped counter for its log level.
  *
- * @param logp   Pointer to an allocated Log_t record.  New records will be appended to the end
+ * @param logp   Pointer to an allocated Log_t record
  * @param flags  Log flags, to specify logging behaviour
  * @param level  syslog log level values.  LOG_ERR and LOG_WARNING are allowed
  * @param fmt    stdarg based string with the log contents
@@ -68,32 +200,31 @@ Log_t * log_init()
  */
 int log_append(Log_t *logp, Log_f flags, int level, const char *fmt, ...)
 {
-        Log_t *ptr = NULL;
         va_list ap;
         char logmsg[4098];
+        unsigned int hash;
+        int slot;
+
+        stats_add(log_appends, 1);
 
         // Prepare log message
-        memset(&logmsg, 0, 4098);
         va_start(ap, fmt);
         vsnprintf(logmsg, 4096, fmt, ap);
         va_end(ap);
+        DMITRACE2(log__append, level, logmsg);
+
+        if( logp && ((level == LOG_ERR) || (level == LOG_WARNING)) ) {
+                hash = log_hash(logmsg);
 
-        // Go the end of the record chain
-        ptr = logp;
-        while( ptr && ptr->next ) {
                 // Ignore duplicated messages if LOGFL_NODUPS is set
-                if( (flags & LOGFL_NODUPS) && ptr->next && ptr->next->message
-                    && (strcmp(ptr->next->message, logmsg) == 0) ) {
+                if( (flags & LOGFL_NODUPS) && ((slot = log_find(logp, logmsg, hash)) != -1) ) {
+                        logp->ring[slot].count++;
+                        logp->ring[slot].last_query = logp->query;
+                        logp->suppressed++;
                         return 1;
                 }
-                ptr = ptr->next;
-        }
 
-        if( ptr && ((level == LOG_ERR) || (level == LOG_WARNING)) ) {
-                ptr->next = log_init();
-                if( ptr->next ) {
-                        ptr->next->level = level;
-                        ptr->next->message = strdup(logmsg);
+                if( log_store(logp, flags, level, logmsg, hash) != -1 ) {
                         return 1;
                 }
         }
@@ -113,10 +244,75 @@ int log_append(Log_t *logp, Log_f flags, int level, const char *fmt, ...)
 
 
 /**
- * Retrieve all log entries in the Log_t record chain with the corresponding log level.
+ * Moves all records of one log buffer into another, as if they had been
+ * logged there.  Used to fold the private log of a query into a shared log.
+ * Records logged with LOGFL_NODUPS are merged with an existing record with
+ * the same message.  src is left empty.
+ *
+ * @param dst  Log buffer to add the records to
+ * @param src  Log buffer to take the records from
+ */
+void log_merge(Log_t *dst, Log_t *src)
+{
+	Log_entry *ptr = NULL;
+	unsigned int i;
+	int slot;
+
+	if( !dst || !src ) {
+		return;
+	}
+	for( i = 0; i < src->used; i++ ) {
+		ptr = &src->ring[(src->head + i) % LOG_CAPACITY];
+		if( (ptr->flags & LOGFL_NODUPS) && ((slot = log_find(dst, ptr->message, ptr->hash)) != -1) ) {
+			dst->ring[slot].count += ptr->count;
+			dst->ring[slot].last_query = ptr->last_query;
+			dst->suppressed++;
+			continue;
+		}
+		if( (slot = log_store(dst, ptr->flags, ptr->level, ptr->message, ptr->hash)) != -1 ) {
+			dst->ring[slot].read = ptr->read;
+			dst->ring[slot].count = ptr->count;
+			dst->ring[slot].first_query = ptr->first_query;
+			dst->ring[slot].last_query = ptr->last_query;
+		}
+	}
+	for( i = 0; i <= LOG_DEBUG; i++ ) {
+		dst->dropped[i] += src->dropped[i];
+		src->dropped[i] = 0;
+	}
+	dst->suppressed += src->suppressed;
+	src->suppressed = 0;
+	if( src->query > dst->query ) {
+		dst->query = src->query;
+	}
+	log_clear_partial(src, LOG_ERR, 1);
+	log_clear_partial(src, LOG_WARNING, 1);
+}
+
+
+/**
+ * Starts a new query.  Log records remember the id of the query they were
+ * first and last logged in.
+ *
+ * @param logp  Pointer to the log buffer
+ *
+ * @return Returns the id of the new query
+ */
+unsigned long log_next_query(Log_t *logp)
+{
+	if( !logp ) {
+		return 0;
+	}
+	return ++logp->query;
+}
+
+
+/**
+ * Retrieve all log entries in the log buffer with the corresponding log level.
  * One string will be returned, with all log entries separated with newline.
+ * If records of this level have been dropped, a note about it is added first.
  *
- * @param logp  Pointer to Log_t record chain with log data
+ * @param logp  Pointer to the log buffer
  * @param level Log entries to retrieve
  *
  * @return Returns a pointer to a buffer with all log lines.  This must be freed after usage.
@@ -124,99 +320,146 @@ int log_append(Log_t *logp, Log_f flags, int level, const char *fmt, ...)
 char * log_retrieve(Log_t *logp, int level)
 {
 	char *ret = NULL;
-	size_t len = 0;
-	Log_t *ptr = NULL;
+	char dropmsg[64];
+	size_t len = 0, pos = 0;
+	unsigned int i;
+	const Log_entry *ptr = NULL;
 
 	if( !logp ) {
 		return NULL;
 	}
 
-	for( ptr = logp; ptr != NULL; ptr = ptr->next ) {
-		if( ptr && ptr->level == level ) {
-			if( ret ) {
-				ret = realloc(ret, strlen(ptr->message)+len+3);
-			} else {
-				ret = calloc(1, strlen(ptr->message)+2);
-			}
-
-			if( !ret ) {
-				fprintf(stderr,
-					"** ERROR ** Could not allocate log retrieval memory buffer\n");
-				return NULL;
-			}
-			strcat(ret, ptr->message);
-			strcat(ret, "\n");
-			ptr->read++;
-			len = strlen(ret);
+	dropmsg[0] = '\0';
+	if( (level >= 0) && (level <= LOG_DEBUG) && (logp->dropped[level] > 0) ) {
+		snprintf(dropmsg, sizeof(dropmsg), "%u older messages were dropped\n",
+			 logp->dropped[level]);
+	}
+
+	// Size the buffer first, so the messages are only copied once
+	len = strlen(dropmsg);
+	for( i = 0; i < logp->used; i++ ) {
+		ptr = &logp->ring[(logp->head + i) % LOG_CAPACITY];
+		if( ptr->level == level ) {
+			len += strlen(ptr->message) + 1;
 		}
 	}
+	if( len == 0 ) {
+		return NULL;
+	}
+
+	ret = malloc(len + 1);
+	if( !ret ) {
+		fprintf(stderr,
+			"** ERROR ** Could not allocate log retrieval memory buffer\n");
+		return NULL;
+	}
+
+	pos = strlen(dropmsg);
+	memcpy(ret, dropmsg, pos);
+	i = 0;
+	while( (ptr = log_next(logp, level, &i)) != NULL ) {
+		size_t l = strlen(ptr->message);
+
+		memcpy(ret + pos, ptr->message, l);
+		ret[pos + l] = '\n';
+		pos += l + 1;
+	}
+	ret[pos] = '\0';
 	return ret;
 }
 
 
 /**
- * Remove only log records of a particular log level from the log chain.  Only
+ * Iterates over the log records with a given log level, oldest first.  Each
+ * returned record is marked as read.
+ *
+ * @param logp   Pointer to the log buffer
+ * @param level  Log entries to retrieve
+ * @param pos    Iterator position, must be set to 0 before the first call
+ *
+ * @return Returns the next log record, or NULL when there are no more records
+ */
+const Log_entry * log_next(Log_t *logp, int level, unsigned int *pos)
+{
+	Log_entry *ptr = NULL;
+
+	if( !logp ) {
+		return NULL;
+	}
+	while( *pos < logp->used ) {
+		ptr = &logp->ring[(logp->head + *pos) % LOG_CAPACITY];
+		(*pos)++;
+		if( ptr->level == level ) {
+			ptr->read++;
+			return ptr;
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * Remove only log records of a particular log level from the log buffer.  Only
  * records that have been read (by using log_retrieve()) will be removed unless
  * the unread argument == 1.
  *
- * @param logp   Pointer to log chain to work on
+ * @param logp   Pointer to log buffer to work on
  * @param level  Log level to remove
- * @param unread Set to 1 to also clear unread log entriesz
+ * @param unread Set to 1 to also clear unread log entries and the dropped counter
  *
  * @return Returns number of removed elements.
  */
 size_t log_clear_partial(Log_t *logp, int level, int unread)
 {
-	Log_t *ptr = NULL, *prev = NULL;
+	unsigned int i, kept = 0;
 	size_t elmnt = 0;
 
 	if( !logp ) {
 		return 0;
 	}
 
-	prev = logp;
-	for( ptr = logp->next; ptr != NULL; ptr = ptr->next ) {
-		if( !ptr ) {
-			break;
-		}
+	// Compact the remaining records towards the head of the ring buffer
+	for( i = 0; i < logp->used; i++ ) {
+		Log_entry *ptr = &logp->ring[(logp->head + i) % LOG_CAPACITY];
 
 		// Only remove log entries which is of the expected log level
 		// and that have been read.
 		if( (ptr->level == level) && ((unread == 1) || (ptr->read > 0)) ) {
-			prev->next = ptr->next;
-			if( ptr->message ) {
-				free(ptr->message);
-				ptr->message = NULL;
-			}
-			free(ptr);
-			ptr = prev;
+			free(ptr->message);
+			ptr->message = NULL;
 			elmnt++;
+			continue;
 		}
-		prev = ptr;
+		if( kept != i ) {
+			logp->ring[(logp->head + kept) % LOG_CAPACITY] = *ptr;
+			ptr->message = NULL;
+		}
+		kept++;
 	}
+	logp->used = kept;
+	log_rehash(logp);
 
+	if( (unread == 1) && (level >= 0) && (level <= LOG_DEBUG) ) {
+		logp->dropped[level] = 0;
+	}
 	return elmnt;
 }
 
 
 /**
- * Free all memory used by a Log_t pointer chain.
+ * Free all memory used by a log buffer.
  *
  * @param logp Pointer to log entries to free up.
  */
 void log_close(Log_t *logp)
 {
-	Log_t *ptr = NULL, *next = NULL;
+	unsigned int i;
 
-	ptr = logp;
-	while( ptr ) {
-		next = ptr->next;
-		ptr->next = NULL;
-		if( ptr->message ) {
-			free(ptr->message);
-			ptr->message = NULL;
-		}
-		free(ptr);
-		ptr = next;
+	if( !logp ) {
+		return;
+	}
+	for( i = 0; i < logp->used; i++ ) {
+		free(logp->ring[(logp->head + i) % LOG_CAPACITY].message);
 	}
+	free(logp);
 }
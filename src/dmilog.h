@@ -35,14 +35,40 @@
 #include <stdarg.h>
 #include <syslog.h>
 
+/** Maximum number of log records kept.  The oldest records are dropped when full */
+#define LOG_CAPACITY 256
+
+/** Number of hash buckets used for duplicate detection, must be a power of 2 */
+#define LOG_BUCKETS 512
+
 /**
- *  Struct defining log records.  Organised as a pointer chain.
+ *  Struct defining a single log record.
  */
-struct _Log_t {
+struct _Log_entry {
 	int level;		/**< Log type, based on syslog levels (LOG_ERR|LOG_WARNING) */
+	int flags;		/**< Log_f flags the record was first logged with */
 	char *message;		/**< Formated log text */
 	unsigned int read;	/**< Number of times this log entry has been read */
-	struct _Log_t *next;	/**< Next log entry */
+	unsigned int count;	/**< Number of times this message was logged */
+	unsigned long first_query; /**< Query id when this message was first logged */
+	unsigned long last_query; /**< Query id when this message was last logged */
+	unsigned int hash;	/**< Hash value of message */
+	int chain;		/**< Next slot in the same hash bucket, -1 if last */
+};
+typedef struct _Log_entry Log_entry;
+
+/**
+ *  Log buffer.  Records are kept in a fixed size ring buffer, and indexed by
+ *  a hash of the message for duplicate detection.
+ */
+struct _Log_t {
+	Log_entry ring[LOG_CAPACITY];	/**< Log records */
+	unsigned int head;		/**< Slot of the oldest record */
+	unsigned int used;		/**< Number of records in use */
+	int bucket[LOG_BUCKETS];	/**< First slot in each hash bucket, -1 if empty */
+	unsigned int dropped[LOG_DEBUG+1]; /**< Records dropped because the buffer was full, per level */
+	unsigned int suppressed;	/**< Duplicated messages not logged due to LOGFL_NODUPS */
+	unsigned long query;		/**< Id of the current query, see log_next_query() */
 };
 typedef struct _Log_t Log_t;
 
@@ -56,7 +82,10 @@ typedef enum { LOGFL_NORMAL   = 1, /**< Normal behaviour, log everything and use
 
 Log_t * log_init();
 int log_append(Log_t *logp, Log_f flags, int level, const char *fmt, ...);
+void log_merge(Log_t *dst, Log_t *src);
+unsigned long log_next_query(Log_t *logp);
 char * log_retrieve(Log_t *logp, int level);
+const Log_entry * log_next(Log_t *logp, int level, unsigned int *pos);
 size_t log_clear_partial(Log_t *logp, int level, int unread);
 void log_close(Log_t *logp);
 
@@ -22,37 +22,55 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
 
 #include "types.h"
 #include "dmidecode.h"
+#include "dmixml.h"
 #include "dmioem.h"
 
 /*
- * Globals for vendor-specific decodes
+ * Manufacturer names of the System Information structure, for the vendors
+ * we know how to decode at least one specific entry type for.
  */
+static const struct {
+        const char *name;
+        int vendor;
+} dmiOEMVendors[] = {
+        { "HP", VENDOR_HP },
+        { "Hewlett-Packard", VENDOR_HP },
+        { "HPE", VENDOR_HP },
+        { NULL, VENDOR_UNKNOWN }
+};
 
-enum DMI_VENDORS { VENDOR_UNKNOWN, VENDOR_HP };
+/*
+ * Look up a system manufacturer name.
+ */
+int dmi_vendor_id(const char *manufacturer)
+{
+        int i;
 
-static enum DMI_VENDORS dmi_vendor = VENDOR_UNKNOWN;
+        if( manufacturer == NULL ) {
+                return VENDOR_UNKNOWN;
+        }
+        for( i = 0; dmiOEMVendors[i].name != NULL; i++ ) {
+                if( strcmp(manufacturer, dmiOEMVendors[i].name) == 0 ) {
+                        return dmiOEMVendors[i].vendor;
+                }
+        }
+        return VENDOR_UNKNOWN;
+}
 
 /*
- * Remember the system vendor for later use. We only actually store the
- * value if we know how to decode at least one specific entry type for
- * that vendor.
+ * Look up the system vendor in a System Information structure. The table
+ * walkers resolve it once per table and pass it along in each dmi_header.
  */
-void dmi_set_vendor(const struct dmi_header *h)
+int dmi_get_vendor(const struct dmi_header *h)
 {
-        const char *vendor;
-
         if( !h || !h->data ) {
-                return;
-        }
-        vendor = dmi_string(h, h->data[0x04]);
-        if( !vendor ) {
-                return;
-        } else if(strcmp(vendor, "HP") == 0) {
-                dmi_vendor = VENDOR_HP;
+                return VENDOR_UNKNOWN;
         }
+        return dmi_vendor_id(dmi_string(h, h->data[0x04]));
 }
 
 /*
@@ -61,74 +79,81 @@ void dmi_set_vendor(const struct dmi_header *h)
  * Code contributed by John Cagle.
  */
 
-static int dmi_decode_hp(struct dmi_header *h)
+/* HP ProLiant System/Rack Locator */
+static void dmi_decode_hp_locator(xmlNode *node, const struct dmi_header *h)
 {
-        u8 *data = h->data;
-        int nic, ptr;
-
-        switch (h->type) {
-        case 204:
-                /*
-                 * Vendor Specific: HP ProLiant System/Rack Locator
-                 */
-                printf("HP ProLiant System/Rack Locator\n");
-                if(h->length < 0x0B)
-                        break;
-                printf("\tRack Name: %s\n", dmi_string(h, data[0x04]));
-                printf("\tEnclosure Name: %s\n", dmi_string(h, data[0x05]));
-                printf("\tEnclosure Model: %s\n", dmi_string(h, data[0x06]));
-                printf("\tEnclosure Serial: %s\n", dmi_string(h, data[0x0A]));
-                printf("\tEnclosure Bays: %d\n", data[0x08]);
-                printf("\tServer Bay: %s\n", dmi_string(h, data[0x07]));
-                printf("\tBays Filled: %d\n", data[0x09]);
-                break;
-
-        case 209:
-        case 221:
-                /*
-                 * Vendor Specific: HP ProLiant NIC MAC Information
-                 *
-                 * This prints the BIOS NIC number,
-                 * PCI bus/device/function, and MAC address
-                 */
-                printf(h->type == 221 ?
-                       "HP BIOS iSCSI NIC PCI and MAC Information\n" :
-                       "HP BIOS NIC PXE PCI and MAC Information\n");
-                nic = 1;
-                ptr = 4;
-                while(h->length >= ptr + 8) {
-                        if(data[ptr] == 0x00 && data[ptr + 1] == 0x00)
-                                printf("\tNIC %d: Disabled\n", nic);
-                        else if(data[ptr] == 0xFF && data[ptr + 1] == 0xFF)
-                                printf("\tNIC %d: Not Installed\n", nic);
-                        else {
-                                printf("\tNIC %d: PCI device %02x:%02x.%x, "
-                                       "MAC address %02X:%02X:%02X:%02X:%02X:%02X\n",
-                                       nic, data[ptr + 1], data[ptr] >> 3, data[ptr] & 7,
-                                       data[ptr + 2], data[ptr + 3],
-                                       data[ptr + 4], data[ptr + 5], data[ptr + 6], data[ptr + 7]);
-                        }
-                        nic++;
-                        ptr += 8;
-                }
-                break;
+        const u8 *data = h->data;
+
+        if( h->length < 0x0B ) {
+                return;
+        }
+        dmixml_AddDMIstring(node, "RackName", h, data[0x04]);
+        dmixml_AddDMIstring(node, "EnclosureName", h, data[0x05]);
+        dmixml_AddDMIstring(node, "EnclosureModel", h, data[0x06]);
+        dmixml_AddDMIstring(node, "EnclosureSerial", h, data[0x0A]);
+        dmixml_AddTextChild(node, "EnclosureBays", "%i", data[0x08]);
+        dmixml_AddDMIstring(node, "ServerBay", h, data[0x07]);
+        dmixml_AddTextChild(node, "BaysFilled", "%i", data[0x09]);
+}
+
+/*
+ * HP ProLiant NIC MAC Information, for PXE (209) and iSCSI (221).  Each
+ * NIC takes 8 bytes: PCI device/function, bus and the MAC address.
+ */
+static void dmi_decode_hp_nic(xmlNode *node, const struct dmi_header *h)
+{
+        const u8 *data = h->data;
+        xmlNode *nic_n = NULL;
+        int nic = 1, ptr = 4;
+
+        while( h->length >= ptr + 8 ) {
+                nic_n = xmlNewChild(node, NULL, (xmlChar *) "NIC", NULL);
+                assert( nic_n != NULL );
+                dmixml_AddAttribute(nic_n, "index", "%i", nic);
 
-        default:
-                return 0;
+                if( data[ptr] == 0x00 && data[ptr + 1] == 0x00 ) {
+                        dmixml_AddTextChild(nic_n, "Status", "Disabled");
+                } else if( data[ptr] == 0xFF && data[ptr + 1] == 0xFF ) {
+                        dmixml_AddTextChild(nic_n, "Status", "Not Installed");
+                } else {
+                        dmixml_AddTextChild(nic_n, "Status", "Enabled");
+                        dmixml_AddTextChild(nic_n, "PCIDevice", "%02x:%02x.%x",
+                                            data[ptr + 1], data[ptr] >> 3, data[ptr] & 7);
+                        dmixml_AddTextChild(nic_n, "MACAddress", "%02X:%02X:%02X:%02X:%02X:%02X",
+                                            data[ptr + 2], data[ptr + 3], data[ptr + 4],
+                                            data[ptr + 5], data[ptr + 6], data[ptr + 7]);
+                }
+                nic++;
+                ptr += 8;
         }
-        return 1;
 }
 
 /*
- * Dispatch vendor-specific entries decoding
- * Return 1 if decoding was successful, 0 otherwise
+ * Vendor-specific decoders, keyed by vendor and structure type.  A type
+ * without an entry here is dumped as an unknown OEM-specific structure.
+ */
+static const dmi_oem_decoder dmiOEMDecoders[] = {
+        { VENDOR_HP, 204, "HP ProLiant System/Rack Locator", "HPRackLocator", dmi_decode_hp_locator },
+        { VENDOR_HP, 209, "HP BIOS NIC PXE PCI and MAC Information", "HPNICInfo", dmi_decode_hp_nic },
+        { VENDOR_HP, 221, "HP BIOS iSCSI NIC PCI and MAC Information", "HPiSCSINICInfo", dmi_decode_hp_nic },
+        { VENDOR_UNKNOWN, 0, NULL, NULL, NULL }
+};
+
+/*
+ * Find the decoder for a vendor-specific entry, using the vendor in the
+ * dmi_header.  Returns NULL if there is none.
  */
-int dmi_decode_oem(struct dmi_header *h)
+const dmi_oem_decoder *dmi_find_oem(const struct dmi_header *h)
 {
-        switch (dmi_vendor) {
-        case VENDOR_HP:
-                return dmi_decode_hp(h);
-        default:
-                return 0;
+        int i;
+
+        if( h->vendor == VENDOR_UNKNOWN ) {
+                return NULL;
+        }
+        for( i = 0; dmiOEMDecoders[i].decode != NULL; i++ ) {
+                if( dmiOEMDecoders[i].vendor == h->vendor && dmiOEMDecoders[i].type == h->type ) {
+                        return &dmiOEMDecoders[i];
+                }
         }
+        return NULL;
 }
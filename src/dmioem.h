@@ -20,7 +20,36 @@
  *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
  */
 
+#ifndef DMIOEM_H
+#define DMIOEM_H
+
+#include <libxml/tree.h>
+
+#include "types.h"
+
 struct dmi_header;
 
-void dmi_set_vendor(const struct dmi_header *h);
-int dmi_decode_oem(struct dmi_header *h);
+/*
+ * Vendors with vendor-specific decodes
+ */
+enum DMI_VENDORS { VENDOR_UNKNOWN, VENDOR_HP };
+
+/*
+ * A decoder for one vendor-specific structure type.  The decoder adds its
+ * fields to the node made for the structure, like the dmi_decode() cases do.
+ */
+typedef void (*dmi_oem_decode_f)(xmlNode *node, const struct dmi_header *h);
+
+typedef struct _dmi_oem_decoder {
+        int vendor;             /* One of DMI_VENDORS */
+        u8 type;                /* Structure type, 128 to 255 */
+        const char *desc;       /* Text of the DMIdescription node */
+        const char *tagname;    /* Name of the XML node made for the structure */
+        dmi_oem_decode_f decode;
+} dmi_oem_decoder;
+
+int dmi_vendor_id(const char *manufacturer);
+int dmi_get_vendor(const struct dmi_header *h);
+const dmi_oem_decoder *dmi_find_oem(const struct dmi_header *h);
+
+#endif
@@ -0,0 +1,489 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmiquery.c
+ *  @brief Command line tool printing decoded DMI structures as XML, JSON or plain values
+ *
+ *  dmiquery links the decoder directly and does not start a Python interpreter,
+ *  which makes one-shot lookups from shell scripts cheap:
+ *
+ *    dmiquery -p -f SerialNumber 1
+ *    dmiquery -j memory
+ *    dmiquery -d dump.dmidump -f 'Size,Size/@unit' 17
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libxml/tree.h>
+#include <libxml/xpath.h>
+
+#include "config.h"
+#include "types.h"
+#include "dmilog.h"
+#include "dmixml.h"
+#include "dmidecode.h"
+#include "dmisnapshot.h"
+
+typedef enum { FORMAT_XML, FORMAT_JSON, FORMAT_PLAIN } Query_format;
+
+#define MAX_FIELDS 32
+
+struct query {
+        Query_format format;
+        u8 types[256];                  /* Set to 1 for each selected type */
+        int all;                        /* No type or section given, print everything */
+        char *fields[MAX_FIELDS];       /* XPath expressions, relative to a structure */
+        int nfields;
+        int quiet;
+};
+
+
+static void usage(const char *prg)
+{
+        fprintf(stderr,
+                "Usage: %s [<options>] [<section>|<type> ...]\n\n"
+                "    OPTIONS\n\n"
+                "        [-d <dump file>]       Read a dump file written by dmidump\n"
+                "        [-D <device>]          Memory device (default: " DEFAULT_MEM_DEV ")\n"
+                "        [-m <mapping file>]    Section definitions (default: " PYTHON_XML_MAP ")\n"
+                "        [-f <field>[,...]]     Print only these fields, XPath relative to a structure\n"
+                "        [-x|-j|-p]             Print XML (default), JSON or plain field values\n"
+                "        [-q]                   Do not print warnings\n\n"
+                "    A section is a group name from the mapping file, like 'bios' or 'memory'.\n"
+                "    Without a section or type all structures are printed.\n",
+                prg);
+}
+
+
+/**
+ * Selects the types of a section, as defined in the GroupMapping of the
+ * python-dmidecode mapping file.
+ *
+ * @return Returns 1 if the section was found, otherwise 0
+ */
+static int select_section(struct query *q, xmlDoc *map, const char *section)
+{
+        xmlNode *group_n = NULL;
+        char *id = NULL;
+        long type;
+
+        if( (map == NULL)
+            || ((group_n = dmixml_FindNode(xmlDocGetRootElement(map), "GroupMapping")) == NULL)
+            || ((group_n = dmixml_FindNodeByAttr(group_n, "Mapping", "name", section)) == NULL) ) {
+                return 0;
+        }
+
+        foreach_xmlnode(group_n->children, group_n) {
+                if( (group_n->type != XML_ELEMENT_NODE)
+                    || (xmlStrcmp(group_n->name, (xmlChar *) "TypeMap") != 0)
+                    || ((id = dmixml_GetAttrValue(group_n, "id")) == NULL) ) {
+                        continue;
+                }
+                type = strtol(id, NULL, 0);
+                if( (type >= 0) && (type <= 0xFF) ) {
+                        q->types[type] = 1;
+                }
+        }
+        return 1;
+}
+
+
+static void json_string(const char *str)
+{
+        const unsigned char *p;
+
+        if( str == NULL ) {
+                fputs("null", stdout);
+                return;
+        }
+        putchar('"');
+        for( p = (const unsigned char *) str; *p; p++ ) {
+                switch( *p ) {
+                case '"':
+                        fputs("\\\"", stdout);
+                        break;
+                case '\\':
+                        fputs("\\\\", stdout);
+                        break;
+                case '\n':
+                        fputs("\\n", stdout);
+                        break;
+                case '\t':
+                        fputs("\\t", stdout);
+                        break;
+                default:
+                        if( *p < 0x20 ) {
+                                printf("\\u%04x", *p);
+                        } else {
+                                putchar(*p);
+                        }
+                }
+        }
+        putchar('"');
+}
+
+
+/**
+ * Prints an element as a JSON value.  Attributes become "@name" members and
+ * child elements "name" members of an object, repeated child elements become
+ * an array.  An element with text only becomes a string, otherwise the text
+ * is put in a "#text" member.
+ */
+static void json_node(xmlNode *node)
+{
+        xmlAttr *attr = NULL;
+        xmlNode *child = NULL, *sib = NULL;
+        xmlChar *text = NULL;
+        int members = 0, has_elements = 0, count;
+
+        for( child = node->children; child != NULL; child = child->next ) {
+                if( child->type == XML_ELEMENT_NODE ) {
+                        has_elements = 1;
+                        break;
+                }
+        }
+        if( !has_elements ) {
+                text = xmlNodeGetContent(node);
+        }
+
+        if( (node->properties == NULL) && !has_elements ) {
+                json_string((text != NULL && *text != '\0') ? (char *) text : NULL);
+                xmlFree(text);
+                return;
+        }
+
+        putchar('{');
+        for( attr = node->properties; attr != NULL; attr = attr->next ) {
+                xmlChar *val = xmlNodeGetContent((xmlNode *) attr);
+
+                printf("%s\"@%s\":", (members++ ? "," : ""), (char *) attr->name);
+                json_string((char *) val);
+                xmlFree(val);
+        }
+        if( (text != NULL) && (*text != '\0') ) {
+                printf("%s\"#text\":", (members++ ? "," : ""));
+                json_string((char *) text);
+        }
+        xmlFree(text);
+
+        for( child = node->children; child != NULL; child = child->next ) {
+                if( child->type != XML_ELEMENT_NODE ) {
+                        continue;
+                }
+
+                // Skip names already printed as part of an array
+                for( sib = node->children; sib != child; sib = sib->next ) {
+                        if( (sib->type == XML_ELEMENT_NODE) && (xmlStrcmp(sib->name, child->name) == 0) ) {
+                                break;
+                        }
+                }
+                if( sib != child ) {
+                        continue;
+                }
+
+                count = 0;
+                for( sib = child; sib != NULL; sib = sib->next ) {
+                        if( (sib->type == XML_ELEMENT_NODE) && (xmlStrcmp(sib->name, child->name) == 0) ) {
+                                count++;
+                        }
+                }
+
+                printf("%s", (members++ ? "," : ""));
+                json_string((char *) child->name);
+                putchar(':');
+                if( count == 1 ) {
+                        json_node(child);
+                        continue;
+                }
+                putchar('[');
+                count = 0;
+                for( sib = child; sib != NULL; sib = sib->next ) {
+                        if( (sib->type == XML_ELEMENT_NODE) && (xmlStrcmp(sib->name, child->name) == 0) ) {
+                                printf("%s", (count++ ? "," : ""));
+                                json_node(sib);
+                        }
+                }
+                putchar(']');
+        }
+        putchar('}');
+}
+
+
+/**
+ * Prints the selected fields of one structure
+ */
+static void print_fields(Log_t *logp, struct query *q, xmlXPathContext *xpctx, xmlNode *st_n, int first)
+{
+        xmlXPathObject *xpo = NULL;
+        xmlChar *handle = NULL;
+        char buf[4098];
+        int i, j, n;
+
+        xpctx->node = st_n;
+        handle = xmlGetProp(st_n, (xmlChar *) "handle");
+        if( q->format == FORMAT_JSON ) {
+                printf("%s{\"type\":%s,\"handle\":", (first ? "" : ",\n"),
+                       dmixml_GetAttrValue(st_n, "type"));
+                json_string((char *) handle);
+        } else if( q->format == FORMAT_XML ) {
+                printf("  <%s type=\"%s\" handle=\"%s\">\n", st_n->name,
+                       dmixml_GetAttrValue(st_n, "type"), handle);
+        }
+        xmlFree(handle);
+
+        for( i = 0; i < q->nfields; i++ ) {
+                xpo = xmlXPathEvalExpression((xmlChar *) q->fields[i], xpctx);
+                n = 0;
+                if( xpo != NULL ) {
+                        n = (xpo->type == XPATH_NODESET
+                             ? (xpo->nodesetval != NULL ? xpo->nodesetval->nodeNr : 0) : 1);
+                }
+
+                if( q->format == FORMAT_JSON ) {
+                        putchar(',');
+                        json_string(q->fields[i]);
+                        printf(":%s", (n > 1 ? "[" : ""));
+                }
+                for( j = 0; j < n; j++ ) {
+                        memset(buf, 0, sizeof(buf));
+                        dmixml_GetXPathContent(logp, buf, sizeof(buf) - 1, xpo, j);
+                        switch( q->format ) {
+                        case FORMAT_JSON:
+                                printf("%s", (j ? "," : ""));
+                                json_string(buf);
+                                break;
+                        case FORMAT_XML: {
+                                xmlChar *esc = xmlEncodeSpecialChars(NULL, (xmlChar *) buf);
+                                xmlChar *name = xmlEncodeSpecialChars(NULL, (xmlChar *) q->fields[i]);
+                                printf("    <Field name=\"%s\">%s</Field>\n", name, esc);
+                                xmlFree(esc);
+                                xmlFree(name);
+                                break;
+                        }
+                        case FORMAT_PLAIN:
+                                printf("%s\n", buf);
+                                break;
+                        }
+                }
+                if( q->format == FORMAT_JSON ) {
+                        printf("%s", (n > 1 ? "]" : (n == 0 ? "null" : "")));
+                }
+                if( xpo != NULL ) {
+                        xmlXPathFreeObject(xpo);
+                }
+        }
+
+        if( q->format == FORMAT_JSON ) {
+                putchar('}');
+        } else if( q->format == FORMAT_XML ) {
+                printf("  </%s>\n", st_n->name);
+        }
+}
+
+
+/**
+ * Prints the decoded structures in the requested format
+ */
+static void print_result(Log_t *logp, struct query *q, xmlDoc *doc)
+{
+        xmlNode *root_n = xmlDocGetRootElement(doc);
+        xmlXPathContext *xpctx = NULL;
+        xmlNode *st_n = NULL;
+        int first = 1;
+
+        if( q->nfields == 0 ) {
+                if( q->format == FORMAT_XML ) {
+                        xmlDocFormatDump(stdout, doc, 1);
+                        return;
+                }
+                // FORMAT_JSON
+                putchar('[');
+                foreach_xmlnode(root_n->children, st_n) {
+                        if( st_n->type == XML_ELEMENT_NODE ) {
+                                printf("%s", (first ? "\n" : ",\n"));
+                                json_node(st_n);
+                                first = 0;
+                        }
+                }
+                printf("\n]\n");
+                return;
+        }
+
+        xpctx = xmlXPathNewContext(doc);
+        if( q->format == FORMAT_JSON ) {
+                printf("[\n");
+        } else if( q->format == FORMAT_XML ) {
+                printf("<?xml version=\"1.0\"?>\n<dmiquery>\n");
+        }
+        foreach_xmlnode(root_n->children, st_n) {
+                if( st_n->type == XML_ELEMENT_NODE ) {
+                        print_fields(logp, q, xpctx, st_n, first);
+                        first = 0;
+                }
+        }
+        if( q->format == FORMAT_JSON ) {
+                printf("%s]\n", (first ? "" : "\n"));
+        } else if( q->format == FORMAT_XML ) {
+                printf("</dmiquery>\n");
+        }
+        xmlXPathFreeContext(xpctx);
+}
+
+
+static int add_fields(struct query *q, char *arg)
+{
+        char *tok = NULL, *save = NULL;
+
+        for( tok = strtok_r(arg, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save) ) {
+                if( q->nfields == MAX_FIELDS ) {
+                        return 0;
+                }
+                q->fields[q->nfields++] = tok;
+        }
+        return 1;
+}
+
+
+int main(int argc, char **argv)
+{
+        const char *devmem = DEFAULT_MEM_DEV;
+        const char *dumpfile = NULL;
+        const char *mapfile = PYTHON_XML_MAP;
+        struct query q;
+        Log_t *logp = NULL;
+        Snapshot_t *snap = NULL;
+        xmlDoc *doc = NULL, *map = NULL;
+        xmlNode *root_n = NULL;
+        char *warn = NULL, *end = NULL;
+        int c, i, ret = 0;
+        long type;
+        u32 s;
+
+        memset(&q, 0, sizeof(q));
+        q.format = FORMAT_XML;
+        while( (c = getopt(argc, argv, "d:D:m:f:xjpqh")) != -1 ) {
+                switch( c ) {
+                case 'd':
+                        dumpfile = optarg;
+                        break;
+                case 'D':
+                        devmem = optarg;
+                        break;
+                case 'm':
+                        mapfile = optarg;
+                        break;
+                case 'f':
+                        if( !add_fields(&q, optarg) ) {
+                                fprintf(stderr, "%s: At most %i fields can be selected\n", argv[0], MAX_FIELDS);
+                                return 1;
+                        }
+                        break;
+                case 'x':
+                        q.format = FORMAT_XML;
+                        break;
+                case 'j':
+                        q.format = FORMAT_JSON;
+                        break;
+                case 'p':
+                        q.format = FORMAT_PLAIN;
+                        break;
+                case 'q':
+                        q.quiet = 1;
+                        break;
+                default:
+                        usage(argv[0]);
+                        return 1;
+                }
+        }
+        if( (q.format == FORMAT_PLAIN) && (q.nfields == 0) ) {
+                fprintf(stderr, "%s: -p requires -f\n", argv[0]);
+                return 1;
+        }
+
+        // Types and sections to print
+        q.all = (optind == argc);
+        for( i = optind; i < argc; i++ ) {
+                type = strtol(argv[i], &end, 0);
+                if( (end != argv[i]) && (*end == '\0') ) {
+                        if( (type < 0) || (type > 0xFF) ) {
+                                fprintf(stderr, "%s: Invalid type number: %s\n", argv[0], argv[i]);
+                                return 1;
+                        }
+                        q.types[type] = 1;
+                        continue;
+                }
+
+                if( (map == NULL) && ((map = xmlReadFile(mapfile, NULL, 0)) == NULL) ) {
+                        fprintf(stderr, "%s: Could not open the XML mapping file '%s'\n", argv[0], mapfile);
+                        return 1;
+                }
+                if( !select_section(&q, map, argv[i]) ) {
+                        fprintf(stderr, "%s: Unknown section: %s\n", argv[0], argv[i]);
+                        xmlFreeDoc(map);
+                        return 1;
+                }
+        }
+        if( map != NULL ) {
+                xmlFreeDoc(map);
+        }
+
+        logp = log_init();
+        snap = snapshot_read(logp, devmem, dumpfile);
+        if( (snap == NULL) || !snap->found || (snapshot_index(snap) < 0) ) {
+                log_append(logp, LOGFL_NODUPS, LOG_ERR, "No SMBIOS nor DMI entry point found, sorry.");
+                ret = 2;
+                goto exit;
+        }
+
+        doc = xmlNewDoc((xmlChar *) "1.0");
+        root_n = xmlNewNode(NULL, (xmlChar *) "dmidecode");
+        xmlDocSetRootElement(doc, root_n);
+        dmixml_AddAttribute(root_n, "smbios_version", "%u.%u", snap->ver >> 8, snap->ver & 0xFF);
+
+        // One walk over the index, the structures are printed in table order
+        for( s = 0; s < snap->count; s++ ) {
+                if( q.all || q.types[snap->structs[s].type] ) {
+                        snapshot_decode_struct(snap, &snap->structs[s], root_n);
+                }
+        }
+        print_result(logp, &q, doc);
+        xmlFreeDoc(doc);
+
+ exit:
+        snapshot_free(snap);
+        if( (warn = log_retrieve(logp, LOG_ERR)) != NULL ) {
+                fprintf(stderr, "%s", warn);
+                free(warn);
+        }
+        if( !q.quiet && ((warn = log_retrieve(logp, LOG_WARNING)) != NULL) ) {
+                fprintf(stderr, "%s", warn);
+                free(warn);
+        }
+        log_close(logp);
+        return ret;
+}
@@ -0,0 +1,342 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+
+/**
+ *  @file dmisel.c
+ *  @brief Reader for the System Event Log described by a type 15 structure
+ *
+ *  The type 15 structure only tells where the log is and how it changed,
+ *  the records live in a separate area which is read from the memory
+ *  device.  A caller keeps a cursor between two reads: when the Log Change
+ *  Token has not moved the area is not read at all, otherwise only the
+ *  records after the cursor are returned.  The cursor also holds the
+ *  CRC-32C of all records up to it, so a log which was cleared and filled
+ *  again is noticed and read from the start.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "util.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+#include "dmisel.h"
+
+/** Access method 0x03, 32-bit physical address */
+#define SEL_METHOD_MEMORY 0x03
+
+/** Type of the record closing the log */
+#define SEL_END_OF_LOG 0xFF
+
+/**
+ * Returns the name of an event type, SMBIOS 7.16.6.1.
+ */
+const char *sel_event_type(u8 code)
+{
+        static const char *type[] = {
+                NULL,           /* 0x00 */
+                "Single-bit ECC memory error",
+                "Multi-bit ECC memory error",
+                "Parity memory error",
+                "Bus timeout",
+                "I/O channel block",
+                "Software NMI",
+                "POST memory resize",
+                "POST error",
+                "PCI parity error",
+                "PCI system error",
+                "CPU failure",
+                "EISA failsafe timer timeout",
+                "Correctable memory log disabled",
+                "Logging disabled",
+                NULL,           /* 0x0F */
+                "System limit exceeded",
+                "Asynchronous hardware timer expired",
+                "System configuration information",
+                "Hard disk information",
+                "System reconfigured",
+                "Uncorrectable CPU-complex error",
+                "Log area reset/cleared",
+                "System boot"   /* 0x17 */
+        };
+
+        if( code <= 0x17 && type[code] != NULL ) {
+                return type[code];
+        }
+        if( code >= 0x80 && code <= 0xFE ) {
+                return "OEM-specific";
+        }
+        return "Unknown";
+}
+
+char *sel_cursor_format(const Sel_cursor *cursor, char *buf, size_t buflen)
+{
+        if( buflen < SEL_CURSORLEN ) {
+                return NULL;
+        }
+        snprintf(buf, buflen, "%04x:%08x:%04x:%08x",
+                 cursor->handle, cursor->token, cursor->offset, cursor->crc);
+        return buf;
+}
+
+/**
+ * Parses a cursor string made by sel_cursor_format().
+ *
+ * @return Returns 0 on success, -1 if the string is not a cursor
+ */
+int sel_cursor_parse(Sel_cursor *cursor, const char *str)
+{
+        unsigned int handle, token, offset, crc;
+        char end;
+
+        if( (str == NULL) || (strlen(str) != SEL_CURSORLEN - 1)
+            || (sscanf(str, "%4x:%8x:%4x:%8x%c", &handle, &token, &offset, &crc, &end) != 4) ) {
+                return -1;
+        }
+        cursor->handle = handle;
+        cursor->token = token;
+        cursor->offset = offset;
+        cursor->crc = crc;
+        return 0;
+}
+
+/**
+ * Adds one record to a running checksum.  Bit 7 of the length byte is left
+ * out, it is set when the record is marked as read and must not break a
+ * cursor.
+ */
+static u32 sel_record_crc(u32 crc, const u8 *rec)
+{
+        u8 head[2] = { rec[0], rec[1] & 0x7F };
+
+        return crc32c(crc32c(crc, head, 2), rec + 2, (rec[1] & 0x7F) - 2);
+}
+
+static int sel_bcd(u8 v)
+{
+        if( ((v >> 4) > 9) || ((v & 0x0F) > 9) ) {
+                return -1;
+        }
+        return (v >> 4) * 10 + (v & 0x0F);
+}
+
+/**
+ * Formats the BCD date of a record, year, month, day, hour, minute and
+ * second.  The log only keeps two digits of the year, 80 to 99 are taken
+ * as 19xx.
+ */
+static void sel_record_time(const u8 *date, char *buf, size_t buflen)
+{
+        int v[6];
+        int i;
+
+        buf[0] = '\0';
+        for( i = 0; i < 6; i++ ) {
+                if( (v[i] = sel_bcd(date[i])) < 0 ) {
+                        return;
+                }
+        }
+        snprintf(buf, buflen, "%04i-%02i-%02i %02i:%02i:%02i",
+                 (v[0] >= 80 ? 1900 : 2000) + v[0], v[1], v[2], v[3], v[4], v[5]);
+}
+
+/**
+ * Reads the log header fields of a type 15 structure.
+ */
+static int sel_header(Log_t *logp, const Snapshot_t *snap, const Snapshot_struct *st, Sel_t *sel)
+{
+        const u8 *data = snap->table + st->offset;
+
+        if( st->length < 0x14 ) {
+                log_append(logp, LOGFL_NODUPS, LOG_WARNING,
+                           "System Event Log structure 0x%04x is too short", st->handle);
+                return -1;
+        }
+
+        sel->handle = st->handle;
+        sel->area_len = WORD(data + 0x04);
+        sel->header_start = WORD(data + 0x06);
+        sel->data_start = WORD(data + 0x08);
+        sel->method = data[0x0A];
+        sel->status = data[0x0B];
+        sel->token = DWORD(data + 0x0C);
+        sel->address = DWORD(data + 0x10);
+        return 0;
+}
+
+/**
+ * Walks the records of the log area, skipping the ones before the cursor.
+ */
+static int sel_records(Log_t *logp, Sel_t *sel, const Sel_cursor *cursor)
+{
+        unsigned int size = 0;
+        unsigned int start = sel->data_start;
+        unsigned int off;
+        u32 crc = 0;
+
+        // Resume after the cursor if the records before it are still the same
+        if( (cursor != NULL) && (cursor->handle == sel->handle) && (cursor->offset > sel->data_start) ) {
+                sel->reset = 1;
+                for( off = sel->data_start; off + 2 <= sel->area_len; ) {
+                        const u8 *rec = sel->area + off;
+                        unsigned int len = rec[1] & 0x7F;
+
+                        if( (rec[0] == SEL_END_OF_LOG) || (len < 8) || (off + len > sel->area_len) ) {
+                                break;
+                        }
+                        crc = sel_record_crc(crc, rec);
+                        if( off + len == cursor->offset ) {
+                                if( crc == cursor->crc ) {
+                                        sel->reset = 0;
+                                        start = cursor->offset;
+                                }
+                                break;
+                        }
+                        off += len;
+                }
+                if( sel->reset ) {
+                        crc = 0;
+                }
+        } else if( (cursor != NULL) && ((cursor->handle != sel->handle) || (cursor->offset != sel->data_start)) ) {
+                sel->reset = 1;
+        }
+
+        for( off = start; off + 2 <= sel->area_len; ) {
+                const u8 *rec = sel->area + off;
+                unsigned int len = rec[1] & 0x7F;
+                Sel_record *r = NULL;
+
+                if( (rec[0] == SEL_END_OF_LOG) || (len < 8) || (off + len > sel->area_len) ) {
+                        break;
+                }
+                if( sel->count == size ) {
+                        Sel_record *list = realloc(sel->records, (size ? size * 2 : 16) * sizeof(Sel_record));
+
+                        if( list == NULL ) {
+                                log_append(logp, LOGFL_NORMAL, LOG_WARNING,
+                                           "Failed to allocate memory for the event log records");
+                                return -1;
+                        }
+                        sel->records = list;
+                        size = (size ? size * 2 : 16);
+                }
+                r = &sel->records[sel->count++];
+                r->offset = off;
+                r->type = rec[0];
+                r->length = len;
+                r->read = (rec[1] & 0x80 ? 1 : 0);
+                sel_record_time(rec + 2, r->time, sizeof(r->time));
+                r->data = rec + 8;
+                r->datalen = len - 8;
+                crc = sel_record_crc(crc, rec);
+                off += len;
+        }
+
+        sel->next.handle = sel->handle;
+        sel->next.token = sel->token;
+        sel->next.offset = (sel->count > 0 ? off : start);
+        sel->next.crc = crc;
+        return 0;
+}
+
+/**
+ * Reads the event log of the first type 15 structure of a snapshot.  The
+ * log area is read from devmem, a dump file does not contain it.
+ *
+ * @param cursor Cursor returned by an earlier read, or NULL to read all records
+ * @return Returns the log, or NULL if there is no readable log.  If the
+ *         Log Change Token matches the cursor, changed is 0 and no records
+ *         are returned.
+ */
+Sel_t *sel_read(Log_t *logp, Snapshot_t *snap, const char *devmem, const Sel_cursor *cursor)
+{
+        const Snapshot_struct *st = NULL;
+        Sel_t *sel = NULL;
+        u32 i;
+
+        if( (snap == NULL) || (snap->table == NULL) ) {
+                return NULL;
+        }
+        if( (snap->structs == NULL) && (snapshot_index(snap) < 0) ) {
+                return NULL;
+        }
+        for( i = 0; i < snap->count; i++ ) {
+                if( snap->structs[i].type == 15 ) {
+                        st = &snap->structs[i];
+                        break;
+                }
+        }
+        if( st == NULL ) {
+                return NULL;
+        }
+
+        if( (sel = calloc(1, sizeof(Sel_t))) == NULL ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Failed to allocate memory for the event log");
+                return NULL;
+        }
+        if( sel_header(logp, snap, st, sel) != 0 ) {
+                free(sel);
+                return NULL;
+        }
+
+        if( (cursor != NULL) && (cursor->handle == sel->handle) && (cursor->token == sel->token) ) {
+                sel->next = *cursor;
+                return sel;
+        }
+        sel->changed = 1;
+
+        if( sel->method != SEL_METHOD_MEMORY ) {
+                log_append(logp, LOGFL_NODUPS, LOG_WARNING,
+                           "System Event Log access method 0x%02x is not supported", sel->method);
+                free(sel);
+                return NULL;
+        }
+        if( (devmem == NULL) || (sel->data_start >= sel->area_len) ) {
+                free(sel);
+                return NULL;
+        }
+        if( (sel->area = mem_chunk(logp, sel->address, sel->area_len, devmem)) == NULL ) {
+                free(sel);
+                return NULL;
+        }
+        if( sel_records(logp, sel, cursor) != 0 ) {
+                sel_free(sel);
+                return NULL;
+        }
+        return sel;
+}
+
+void sel_free(Sel_t *sel)
+{
+        if( sel == NULL ) {
+                return;
+        }
+        free(sel->records);
+        free(sel->area);
+        free(sel);
+}
@@ -0,0 +1,91 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+
+/**
+ *  @file dmisel.h
+ *  @brief Reader for the System Event Log described by a type 15 structure
+ */
+
+#ifndef DMISEL_H
+#define DMISEL_H
+
+#include "types.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+
+/** Length of a cursor string, including the terminating NUL */
+#define SEL_CURSORLEN 28
+
+/**
+ *  Position in an event log, remembered by a caller between two reads
+ */
+typedef struct {
+        u16 handle;             /**< Handle of the type 15 structure */
+        u32 token;              /**< Log Change Token when the log was read */
+        u16 offset;             /**< Offset of the first record not read yet, in the log area */
+        u32 crc;                /**< CRC-32C of all records before offset, 0 at the start of the log */
+} Sel_cursor;
+
+/**
+ *  One log record
+ */
+typedef struct {
+        u16 offset;             /**< Offset of the record in the log area */
+        u8 type;                /**< Event type */
+        u8 length;              /**< Record length, including the type and length bytes */
+        int read;               /**< Set to 1 if the record has been marked as read */
+        char time[20];          /**< "YYYY-MM-DD HH:MM:SS", empty if the BCD date is invalid */
+        const u8 *data;         /**< Variable data after the date, points into the log area */
+        u8 datalen;
+} Sel_record;
+
+/**
+ *  Event log of one type 15 structure, the records after a cursor
+ */
+typedef struct {
+        u16 handle;
+        u8 method;              /**< Access method, only 0x03 (32-bit memory-mapped) is read */
+        u8 status;              /**< Log Status, bit 0 valid, bit 1 full */
+        u32 token;              /**< Log Change Token */
+        u32 address;            /**< Physical address of the log area */
+        u16 area_len;
+        u16 header_start;
+        u16 data_start;
+        int changed;            /**< Set to 0 if the token matched the cursor and the area was not read */
+        int reset;              /**< Set to 1 if the cursor did not match the log, all records are returned */
+        Sel_record *records;
+        unsigned int count;
+        Sel_cursor next;        /**< Cursor after the last record */
+        u8 *area;               /**< Copy of the log area, NULL if it was not read */
+} Sel_t;
+
+Sel_t *sel_read(Log_t *logp, Snapshot_t *snap, const char *devmem, const Sel_cursor *cursor);
+const char *sel_event_type(u8 code);
+char *sel_cursor_format(const Sel_cursor *cursor, char *buf, size_t buflen);
+int sel_cursor_parse(Sel_cursor *cursor, const char *str);
+void sel_free(Sel_t *sel);
+
+#endif
@@ -0,0 +1,653 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmisink.c
+ *  @brief Output sinks writing encoded DMI data to a buffer or a file descriptor
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+
+#include "dmisink.h"
+
+static void strtab_free(Sink_strtab *tab);
+
+/**
+ * Creates a new sink
+ *
+ * @param ops  Encoder to use
+ * @param fd   File descriptor to write to, or -1 to collect the output in memory
+ *
+ * @return Returns a sink to be freed with sink_free(), or NULL on allocation failure
+ */
+Sink_t *sink_new(const Sink_ops *ops, int fd)
+{
+        Sink_t *sink = NULL;
+
+        sink = (Sink_t *) calloc(1, sizeof(Sink_t));
+        if( sink == NULL ) {
+                return NULL;
+        }
+        sink->ops = ops;
+        sink->fd = fd;
+        sink->size = (fd < 0 ? 4096 : SINK_FLUSH_SIZE);
+        sink->buf = (char *) malloc(sink->size);
+        if( sink->buf == NULL ) {
+                free(sink);
+                return NULL;
+        }
+        sink->first[0] = 1;
+        return sink;
+}
+
+
+static void sink_write_fd(Sink_t *sink, const char *data, size_t len)
+{
+        size_t off = 0;
+        ssize_t r;
+
+        while( off < len ) {
+                r = write(sink->fd, data + off, len - off);
+                if( r < 0 ) {
+                        if( errno == EINTR ) {
+                                continue;
+                        }
+                        sink->error = errno;
+                        break;
+                }
+                off += r;
+        }
+        sink->written += off;
+}
+
+
+/**
+ * Writes out the buffered data of a file descriptor sink
+ *
+ * @return Returns 0 on success, otherwise the errno of the failed write
+ */
+int sink_flush(Sink_t *sink)
+{
+        if( (sink->fd < 0) || sink->error ) {
+                return sink->error;
+        }
+        sink_write_fd(sink, sink->buf, sink->len);
+        sink->len = 0;
+        return sink->error;
+}
+
+
+/**
+ * Appends raw bytes to the sink.  Errors are recorded in sink->error, and
+ * all further output is discarded.
+ */
+void sink_write(Sink_t *sink, const void *data, size_t len)
+{
+        char *newbuf = NULL;
+        size_t newsize;
+
+        if( sink->error ) {
+                return;
+        }
+        if( sink->len + len > sink->size ) {
+                if( sink->fd >= 0 ) {
+                        if( sink_flush(sink) != 0 ) {
+                                return;
+                        }
+                        if( len > sink->size ) {
+                                // Too big to buffer, write it directly
+                                sink_write_fd(sink, (const char *) data, len);
+                                return;
+                        }
+                } else {
+                        for( newsize = sink->size * 2; newsize < sink->len + len; newsize *= 2 ) {
+                                ;
+                        }
+                        if( (newbuf = (char *) realloc(sink->buf, newsize)) == NULL ) {
+                                sink->error = ENOMEM;
+                                return;
+                        }
+                        sink->buf = newbuf;
+                        sink->size = newsize;
+                }
+        }
+        memcpy(sink->buf + sink->len, data, len);
+        sink->len += len;
+}
+
+
+/**
+ * Frees a sink.  Buffered data of a file descriptor sink is not flushed.
+ */
+void sink_free(Sink_t *sink)
+{
+        if( sink == NULL ) {
+                return;
+        }
+        strtab_free(sink->strings);
+        free(sink->buf);
+        free(sink);
+}
+
+
+/**
+ * Looks up an encoder by name
+ *
+ * @param name  Encoder name, "json" or "cbor"
+ *
+ * @return Returns the encoder, or NULL if there is none with that name
+ */
+const Sink_ops *sink_find(const char *name)
+{
+        static const Sink_ops *encoders[] = { &sink_json, &sink_cbor, NULL };
+        int i;
+
+        for( i = 0; encoders[i] != NULL; i++ ) {
+                if( strcmp(encoders[i]->name, name) == 0 ) {
+                        return encoders[i];
+                }
+        }
+        return NULL;
+}
+
+
+/*
+ * JSON encoder
+ */
+
+static void json_separator(Sink_t *sink)
+{
+        if( sink->after_key ) {
+                sink->after_key = 0;
+                return;
+        }
+        if( !sink->first[sink->depth] ) {
+                sink_write(sink, ",", 1);
+        }
+        sink->first[sink->depth] = 0;
+}
+
+
+static void json_quoted(Sink_t *sink, const char *str)
+{
+        const unsigned char *p = (const unsigned char *) str;
+        const unsigned char *run = p;
+        char esc[8];
+
+        sink_write(sink, "\"", 1);
+        for( ; *p; p++ ) {
+                if( (*p >= 0x20) && (*p != '"') && (*p != '\\') ) {
+                        continue;
+                }
+                sink_write(sink, run, p - run);
+                switch( *p ) {
+                case '"':
+                        sink_write(sink, "\\\"", 2);
+                        break;
+                case '\\':
+                        sink_write(sink, "\\\\", 2);
+                        break;
+                case '\n':
+                        sink_write(sink, "\\n", 2);
+                        break;
+                case '\t':
+                        sink_write(sink, "\\t", 2);
+                        break;
+                default:
+                        snprintf(esc, sizeof(esc), "\\u%04x", *p);
+                        sink_write(sink, esc, 6);
+                }
+                run = p + 1;
+        }
+        sink_write(sink, run, p - run);
+        sink_write(sink, "\"", 1);
+}
+
+
+static void json_open(Sink_t *sink, const char *c)
+{
+        json_separator(sink);
+        sink_write(sink, c, 1);
+        if( sink->depth + 1 >= SINK_MAXDEPTH ) {
+                sink->error = EOVERFLOW;
+                return;
+        }
+        sink->first[++sink->depth] = 1;
+}
+
+
+static void json_close(Sink_t *sink, const char *c)
+{
+        if( sink->depth > 0 ) {
+                sink->depth--;
+        }
+        sink_write(sink, c, 1);
+}
+
+
+static void json_begin_map(Sink_t *sink)
+{
+        json_open(sink, "{");
+}
+
+
+static void json_end_map(Sink_t *sink)
+{
+        json_close(sink, "}");
+}
+
+
+static void json_begin_list(Sink_t *sink)
+{
+        json_open(sink, "[");
+}
+
+
+static void json_end_list(Sink_t *sink)
+{
+        json_close(sink, "]");
+}
+
+
+static void json_key(Sink_t *sink, const char *key)
+{
+        json_separator(sink);
+        json_quoted(sink, key);
+        sink_write(sink, ":", 1);
+        sink->after_key = 1;
+}
+
+
+static void json_string(Sink_t *sink, const char *str)
+{
+        json_separator(sink);
+        json_quoted(sink, str);
+}
+
+
+static void json_integer(Sink_t *sink, long val)
+{
+        char num[32];
+
+        json_separator(sink);
+        sink_write(sink, num, snprintf(num, sizeof(num), "%ld", val));
+}
+
+
+static void json_real(Sink_t *sink, double val)
+{
+        char num[32];
+
+        json_separator(sink);
+        if( !isfinite(val) ) {
+                sink_write(sink, "null", 4);
+                return;
+        }
+        sink_write(sink, num, snprintf(num, sizeof(num), "%.17g", val));
+}
+
+
+static void json_boolean(Sink_t *sink, int val)
+{
+        json_separator(sink);
+        sink_write(sink, (val ? "true" : "false"), (val ? 4 : 5));
+}
+
+
+static void json_null(Sink_t *sink)
+{
+        json_separator(sink);
+        sink_write(sink, "null", 4);
+}
+
+
+const Sink_ops sink_json = {
+        "json",
+        json_begin_map,
+        json_end_map,
+        json_begin_list,
+        json_end_list,
+        json_key,
+        json_string,
+        json_integer,
+        json_real,
+        json_boolean,
+        json_null
+};
+
+
+/*
+ * CBOR encoder (RFC 8949)
+ *
+ * The output starts with the self-describe tag 55799 followed by a
+ * stringref namespace (tag 256), see http://cbor.schmorp.de/stringref.
+ * Every text string long enough to gain from it is added to a table the
+ * first time it is written, and written as a reference (tag 25) to its
+ * table index after that.  DMI data repeats the same keys and values for
+ * every structure, so most strings end up as 3-5 byte references.  Maps
+ * and lists use indefinite lengths, so the output can be streamed.
+ */
+
+/** Initial number of slots in the string table, must be a power of two */
+#define STRTAB_MINSLOTS 256
+
+struct _Sink_strtab_entry {
+        char *str;
+        size_t len;
+        unsigned long long idx;
+        unsigned int hash;
+};
+
+struct _Sink_strtab {
+        struct _Sink_strtab_entry *slots;
+        size_t size;                    /**< Number of slots, a power of two */
+        unsigned long long count;       /**< Number of strings in the table */
+};
+
+
+static unsigned int strtab_hash(const char *str, size_t len)
+{
+        unsigned int h = 2166136261U;
+        size_t i;
+
+        for( i = 0; i < len; i++ ) {
+                h = (h ^ (unsigned char) str[i]) * 16777619U;
+        }
+        return h;
+}
+
+
+static void strtab_free(Sink_strtab *tab)
+{
+        size_t i;
+
+        if( tab == NULL ) {
+                return;
+        }
+        for( i = 0; i < tab->size; i++ ) {
+                free(tab->slots[i].str);
+        }
+        free(tab->slots);
+        free(tab);
+}
+
+
+static struct _Sink_strtab_entry *strtab_slot(Sink_strtab *tab, const char *str, size_t len, unsigned int hash)
+{
+        size_t i;
+
+        for( i = hash & (tab->size - 1); tab->slots[i].str != NULL; i = (i + 1) & (tab->size - 1) ) {
+                if( (tab->slots[i].hash == hash) && (tab->slots[i].len == len)
+                    && (memcmp(tab->slots[i].str, str, len) == 0) ) {
+                        break;
+                }
+        }
+        return &tab->slots[i];
+}
+
+
+static int strtab_grow(Sink_strtab *tab)
+{
+        struct _Sink_strtab_entry *old = tab->slots, *slot = NULL;
+        size_t oldsize = tab->size, i;
+
+        tab->slots = (struct _Sink_strtab_entry *) calloc(oldsize * 2, sizeof(struct _Sink_strtab_entry));
+        if( tab->slots == NULL ) {
+                tab->slots = old;
+                return 0;
+        }
+        tab->size = oldsize * 2;
+        for( i = 0; i < oldsize; i++ ) {
+                if( old[i].str != NULL ) {
+                        slot = strtab_slot(tab, old[i].str, old[i].len, old[i].hash);
+                        *slot = old[i];
+                }
+        }
+        free(old);
+        return 1;
+}
+
+
+/**
+ * Minimum length of a string added to a stringref table holding n strings.
+ * Shorter strings would not be smaller as a reference.
+ */
+static size_t strtab_minlen(unsigned long long n)
+{
+        if( n < 24 ) {
+                return 3;
+        } else if( n < 256 ) {
+                return 4;
+        } else if( n < 65536 ) {
+                return 5;
+        } else if( n < 4294967296ULL ) {
+                return 7;
+        }
+        return 11;
+}
+
+
+static void cbor_head(Sink_t *sink, unsigned char major, unsigned long long val)
+{
+        unsigned char head[9];
+        size_t len, i;
+
+        if( val < 24 ) {
+                head[0] = (major << 5) | val;
+                len = 1;
+        } else if( val <= 0xFF ) {
+                head[0] = (major << 5) | 24;
+                len = 2;
+        } else if( val <= 0xFFFF ) {
+                head[0] = (major << 5) | 25;
+                len = 3;
+        } else if( val <= 0xFFFFFFFFULL ) {
+                head[0] = (major << 5) | 26;
+                len = 5;
+        } else {
+                head[0] = (major << 5) | 27;
+                len = 9;
+        }
+        // Arguments are big-endian
+        for( i = len - 1; i > 0; i-- ) {
+                head[i] = val & 0xFF;
+                val >>= 8;
+        }
+        sink_write(sink, head, len);
+}
+
+
+static void cbor_value(Sink_t *sink)
+{
+        if( (sink->depth == 0) && sink->first[0] ) {
+                // Self-describe tag 55799, then open the stringref namespace
+                sink_write(sink, "\xd9\xd9\xf7\xd9\x01\x00", 6);
+                sink->first[0] = 0;
+        }
+}
+
+
+static void cbor_open(Sink_t *sink, unsigned char head)
+{
+        cbor_value(sink);
+        sink_write(sink, &head, 1);
+        if( sink->depth + 1 >= SINK_MAXDEPTH ) {
+                sink->error = EOVERFLOW;
+                return;
+        }
+        sink->depth++;
+}
+
+
+static void cbor_close(Sink_t *sink)
+{
+        if( sink->depth > 0 ) {
+                sink->depth--;
+        }
+        sink_write(sink, "\xff", 1);
+}
+
+
+static void cbor_begin_map(Sink_t *sink)
+{
+        cbor_open(sink, 0xBF);
+}
+
+
+static void cbor_begin_list(Sink_t *sink)
+{
+        cbor_open(sink, 0x9F);
+}
+
+
+static void cbor_string(Sink_t *sink, const char *str)
+{
+        struct _Sink_strtab_entry *slot = NULL;
+        size_t len = strlen(str);
+        unsigned int hash;
+
+        cbor_value(sink);
+        if( sink->error ) {
+                return;
+        }
+        if( len < 3 ) {
+                goto literal;
+        }
+        if( sink->strings == NULL ) {
+                sink->strings = (Sink_strtab *) calloc(1, sizeof(Sink_strtab));
+                if( sink->strings == NULL ) {
+                        sink->error = ENOMEM;
+                        return;
+                }
+                sink->strings->slots = (struct _Sink_strtab_entry *) calloc(STRTAB_MINSLOTS,
+                                                                           sizeof(struct _Sink_strtab_entry));
+                if( sink->strings->slots == NULL ) {
+                        sink->error = ENOMEM;
+                        return;
+                }
+                sink->strings->size = STRTAB_MINSLOTS;
+        }
+
+        hash = strtab_hash(str, len);
+        slot = strtab_slot(sink->strings, str, len, hash);
+        if( slot->str != NULL ) {
+                cbor_head(sink, 6, 25);
+                cbor_head(sink, 0, slot->idx);
+                return;
+        }
+        if( len < strtab_minlen(sink->strings->count) ) {
+                goto literal;
+        }
+
+        // The decoder adds this string to its table as well, so it must be added here
+        if( (slot->str = strdup(str)) == NULL ) {
+                sink->error = ENOMEM;
+                return;
+        }
+        slot->len = len;
+        slot->hash = hash;
+        slot->idx = sink->strings->count++;
+        if( (sink->strings->count * 2 > sink->strings->size) && !strtab_grow(sink->strings) ) {
+                sink->error = ENOMEM;
+                return;
+        }
+
+ literal:
+        cbor_head(sink, 3, len);
+        sink_write(sink, str, len);
+}
+
+
+static void cbor_integer(Sink_t *sink, long val)
+{
+        cbor_value(sink);
+        if( val >= 0 ) {
+                cbor_head(sink, 0, (unsigned long long) val);
+        } else {
+                cbor_head(sink, 1, (unsigned long long) -(val + 1));
+        }
+}
+
+
+static void cbor_real(Sink_t *sink, double val)
+{
+        unsigned long long bits64;
+        unsigned int bits32;
+        unsigned char out[9];
+        float single = (float) val;
+        int i;
+
+        cbor_value(sink);
+        if( (double) single == val ) {
+                memcpy(&bits32, &single, sizeof(bits32));
+                out[0] = 0xFA;
+                for( i = 4; i > 0; i-- ) {
+                        out[i] = bits32 & 0xFF;
+                        bits32 >>= 8;
+                }
+                sink_write(sink, out, 5);
+                return;
+        }
+        memcpy(&bits64, &val, sizeof(bits64));
+        out[0] = 0xFB;
+        for( i = 8; i > 0; i-- ) {
+                out[i] = bits64 & 0xFF;
+                bits64 >>= 8;
+        }
+        sink_write(sink, out, 9);
+}
+
+
+static void cbor_boolean(Sink_t *sink, int val)
+{
+        cbor_value(sink);
+        sink_write(sink, (val ? "\xf5" : "\xf4"), 1);
+}
+
+
+static void cbor_null(Sink_t *sink)
+{
+        cbor_value(sink);
+        sink_write(sink, "\xf6", 1);
+}
+
+
+const Sink_ops sink_cbor = {
+        "cbor",
+        cbor_begin_map,
+        cbor_close,
+        cbor_begin_list,
+        cbor_close,
+        cbor_string,
+        cbor_string,
+        cbor_integer,
+        cbor_real,
+        cbor_boolean,
+        cbor_null
+};
@@ -0,0 +1,91 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmisink.h
+ *  @brief Output sinks writing encoded DMI data to a buffer or a file descriptor
+ */
+
+#ifndef DMISINK_H
+#define DMISINK_H
+
+#include <stddef.h>
+
+/** Bytes buffered before a file descriptor sink writes them out */
+#define SINK_FLUSH_SIZE 65536
+
+/** Maximum nesting of maps and lists */
+#define SINK_MAXDEPTH 32
+
+typedef struct _Sink_t Sink_t;
+typedef struct _Sink_strtab Sink_strtab;
+
+/**
+ *  Encoder callbacks.  A map is a sequence of key()/value pairs, where a
+ *  value is a scalar, a map or a list.
+ */
+struct _Sink_ops {
+        const char *name;
+        void (*begin_map)(Sink_t *sink);
+        void (*end_map)(Sink_t *sink);
+        void (*begin_list)(Sink_t *sink);
+        void (*end_list)(Sink_t *sink);
+        void (*key)(Sink_t *sink, const char *key);
+        void (*string)(Sink_t *sink, const char *str);
+        void (*integer)(Sink_t *sink, long val);
+        void (*real)(Sink_t *sink, double val);
+        void (*boolean)(Sink_t *sink, int val);
+        void (*null)(Sink_t *sink);
+};
+typedef struct _Sink_ops Sink_ops;
+
+/**
+ *  An output sink.  With fd set to -1 all output is kept in a growing
+ *  buffer, otherwise the buffer is written out every SINK_FLUSH_SIZE bytes.
+ */
+struct _Sink_t {
+        const Sink_ops *ops;    /**< Encoder */
+        int fd;                 /**< Output file descriptor, -1 for a memory buffer */
+        char *buf;              /**< Output buffer */
+        size_t len;             /**< Bytes used in buf */
+        size_t size;            /**< Allocated size of buf */
+        size_t written;         /**< Bytes written to fd so far */
+        int error;              /**< errno of the first failed allocation or write, 0 if none */
+        int depth;              /**< Current nesting level */
+        char first[SINK_MAXDEPTH]; /**< Set while no member was written at a level */
+        int after_key;          /**< Set if the next value belongs to a key */
+        Sink_strtab *strings;   /**< Strings already written, used by the CBOR encoder */
+};
+
+extern const Sink_ops sink_json;
+extern const Sink_ops sink_cbor;
+
+const Sink_ops *sink_find(const char *name);
+
+Sink_t *sink_new(const Sink_ops *ops, int fd);
+void sink_write(Sink_t *sink, const void *data, size_t len);
+int sink_flush(Sink_t *sink);
+void sink_free(Sink_t *sink);
+
+#endif
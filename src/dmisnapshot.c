@@ -0,0 +1,736 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmisnapshot.c
+ *  @brief One consistent read of the SMBIOS/DMI entry point and table
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "config.h"
+#include "types.h"
+#include "util.h"
+#include "efi.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+
+#define QWORD64(x) ((uint64_t) DWORD(x) | ((uint64_t) DWORD((x) + 4) << 32))
+
+static void put16(u8 *p, u16 v)
+{
+        p[0] = v & 0xFF;
+        p[1] = v >> 8;
+}
+
+static void put32(u8 *p, u32 v)
+{
+        put16(p, v & 0xFFFF);
+        put16(p + 2, v >> 16);
+}
+
+static void put64(u8 *p, uint64_t v)
+{
+        put32(p, v & 0xFFFFFFFF);
+        put32(p + 4, v >> 32);
+}
+
+/**
+ * Validates an entry point and copies the values needed to read the table
+ * into the snapshot.
+ *
+ * @param snap   Snapshot to update
+ * @param buf    Pointer to a possible entry point
+ * @param avail  Number of bytes available at buf
+ *
+ * @return Returns 1 if a valid entry point was found, otherwise 0
+ */
+static int snapshot_entry(Snapshot_t *snap, const u8 *buf, size_t avail)
+{
+        if(avail >= 0x18 && memcmp(buf, "_SM3_", 5) == 0) {
+                /* Tables above 4 GiB can not be read by mem_chunk() */
+                if(buf[0x06] > 0x20 || !checksum(buf, buf[0x06]) || DWORD(buf + 0x14) != 0) {
+                        return 0;
+                }
+                snap->legacy = 0;
+                snap->entry_len = buf[0x06];
+                snap->base = DWORD(buf + 0x10);
+                snap->len = DWORD(buf + 0x0C);
+                snap->num = 0;
+                snap->ver = (buf[0x07] << 8) + buf[0x08];
+        } else if(avail >= 0x20 && memcmp(buf, "_SM_", 4) == 0) {
+                if(buf[0x05] > 0x20 || !checksum(buf, buf[0x05])
+                   || memcmp(buf + 0x10, "_DMI_", 5) != 0 || !checksum(buf + 0x10, 0x0F)) {
+                        return 0;
+                }
+                snap->legacy = 0;
+                snap->entry_len = buf[0x05];
+                snap->base = DWORD(buf + 0x18);
+                snap->len = WORD(buf + 0x16);
+                snap->num = WORD(buf + 0x1C);
+                snap->ver = (buf[0x06] << 8) + buf[0x07];
+
+                /* Some BIOS report weird SMBIOS version, fix that up */
+                switch (snap->ver) {
+                case 0x021F:
+                        snap->ver = 0x0203;
+                        break;
+                case 0x0233:
+                        snap->ver = 0x0206;
+                        break;
+                }
+        } else if(avail >= 0x10 && memcmp(buf, "_DMI_", 5) == 0) {
+                if(!checksum(buf, 0x0F)) {
+                        return 0;
+                }
+                snap->legacy = 1;
+                snap->entry_len = 0x0F;
+                snap->base = DWORD(buf + 0x08);
+                snap->len = WORD(buf + 0x06);
+                snap->num = WORD(buf + 0x0C);
+                snap->ver = ((buf[0x0E] & 0xF0) << 4) + (buf[0x0E] & 0x0F);
+        } else {
+                return 0;
+        }
+        memcpy(snap->entry, buf, snap->entry_len);
+        snap->found = 1;
+        return 1;
+}
+
+
+/**
+ * Reads the header of a dump file written by snapshot_write() into the
+ * snapshot.  Legacy dump files have no header.
+ *
+ * @param logp  Pointer to the log buffer
+ * @param snap  Snapshot of a dump file, with its entry point
+ * @param hdr   SNAPSHOT_DUMP_HDRLEN bytes following the entry point
+ * @param len   Return value, the table length given by the header
+ * @param crc   Return value, the table CRC given by the header
+ *
+ * @return Returns 1 if the header is valid, 0 if there is no header and -1
+ *         if the header is corrupted
+ */
+static int snapshot_header(Log_t *logp, Snapshot_t *snap, const u8 *hdr, u32 *len, u32 *crc)
+{
+        u8 buf[SNAPSHOT_DUMP_HDRLEN];
+
+        snap->dumpver = 1;
+        snap->origin = SNAPSHOT_SRC_DUMP;
+        if( (hdr == NULL) || (memcmp(hdr, SNAPSHOT_DUMP_MAGIC, 8) != 0) ) {
+                return 0;
+        }
+        memcpy(buf, hdr, sizeof(buf));
+        memset(buf + 0x20, 0, 4);
+        if( (WORD(hdr + 0x08) < SNAPSHOT_DUMP_VERSION) || (WORD(hdr + 0x0A) != SNAPSHOT_DUMP_HDRLEN)
+            || (crc32c(0, buf, sizeof(buf)) != DWORD(hdr + 0x20)) ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Dump file header is corrupted");
+                return -1;
+        }
+        snap->dumpver = WORD(hdr + 0x08);
+        snap->origin = (Snapshot_src) hdr[0x0C];
+        snap->taken = (time_t) QWORD64(hdr + 0x18);
+        memcpy(snap->host, hdr + 0x28, SNAPSHOT_HOSTLEN);
+        snap->host[SNAPSHOT_HOSTLEN - 1] = '\0';
+        *len = DWORD(hdr + 0x10);
+        *crc = DWORD(hdr + 0x14);
+        return 1;
+}
+
+
+/**
+ * Computes the fingerprint CRC of a snapshot with a table.  The entry point
+ * is taken as it is stored in a legacy dump file, so that a table gives the
+ * same fingerprint wherever it was read from.
+ */
+static void snapshot_crc(Snapshot_t *snap)
+{
+        u8 entry[0x20];
+
+        snapshot_dump_entry(snap, entry, 0x20);
+        snap->crc = crc32c(crc32c(0, entry, snap->entry_len), snap->table, snap->len);
+}
+
+
+/**
+ * Checks a table read from a dump file against the length and CRC given by
+ * its header.  A table which does not match is dropped, so that nothing is
+ * decoded from it.
+ *
+ * @return Returns 1 if the table matches, otherwise 0
+ */
+static int snapshot_verify(Log_t *logp, Snapshot_t *snap, int header, u32 len, u32 crc)
+{
+        if( header == 0 ) {
+                return 1;
+        }
+        if( header > 0 ) {
+                if( (snap->len == len) && (crc32c(0, snap->table, snap->len) == crc) ) {
+                        return 1;
+                }
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "DMI table in the dump file is corrupted");
+        }
+        free(snap->table);
+        snap->table = NULL;
+        return 0;
+}
+
+
+/**
+ * Locates the entry point, without reading the table.  The entry point is
+ * read from the start of a dump file.  For the default memory device, the
+ * sysfs copy exported by Linux is preferred, as it does not need to map
+ * physical memory.  Otherwise it is looked up via EFI or by scanning the
+ * 0xF0000 memory segment.
+ *
+ * @param logp      Pointer to the log buffer
+ * @param devmem    Memory device to read from if dumpfile is NULL
+ * @param dumpfile  Dump file written by dmidump, or NULL
+ *
+ * @return Returns a new snapshot which must be freed with snapshot_free().  If
+ *         no entry point was found, found is 0.  NULL is returned if the
+ *         memory could not be accessed at all.
+ */
+Snapshot_t *snapshot_locate(Log_t *logp, const char *devmem, const char *dumpfile)
+{
+        Snapshot_t *snap = NULL;
+        u8 *buf = NULL;
+        size_t fp, len;
+        int efi;
+
+        snap = (Snapshot_t *) calloc(1, sizeof(Snapshot_t));
+        if( snap == NULL ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for snapshot");
+                return NULL;
+        }
+
+        if( dumpfile != NULL ) {
+                snap->source = SNAPSHOT_SRC_DUMP;
+                if( (buf = mem_chunk(logp, 0, 0x20, dumpfile)) == NULL ) {
+                        goto error;
+                }
+                snapshot_entry(snap, buf, 0x20);
+        } else {
+                len = 0x20;
+                if( (devmem != NULL) && (strcmp(devmem, DEFAULT_MEM_DEV) == 0)
+                    && ((buf = read_file(logp, &len, SYS_ENTRY_FILE)) != NULL) ) {
+                        snap->source = SNAPSHOT_SRC_SYSFS;
+                        if( snapshot_entry(snap, buf, len) ) {
+                                free(buf);
+                                return snap;
+                        }
+                        free(buf);
+                        buf = NULL;
+                }
+
+                /* Then try EFI (ia64, Intel-based Mac) */
+                efi = address_from_efi(logp, &fp);
+                if( efi == EFI_NOT_FOUND ) {
+                        /* Fallback to memory scan (x86, x86_64) */
+                        snap->source = SNAPSHOT_SRC_SCAN;
+                        if( (buf = mem_chunk(logp, 0xF0000, 0x10000, devmem)) == NULL ) {
+                                goto error;
+                        }
+                        /* Prefer an SMBIOS 3 entry point if there is one */
+                        for( fp = 0; fp <= 0xFFF0; fp += 16 ) {
+                                if( (memcmp(buf + fp, "_SM3_", 5) == 0)
+                                    && snapshot_entry(snap, buf + fp, 0x10000 - fp) ) {
+                                        break;
+                                }
+                        }
+                        for( fp = 0; !snap->found && (fp <= 0xFFF0); fp += 16 ) {
+                                if( snapshot_entry(snap, buf + fp, 0x10000 - fp) ) {
+                                        break;
+                                }
+                        }
+                } else if( efi == EFI_NO_SMBIOS ) {
+                        goto error;
+                } else {
+                        snap->source = SNAPSHOT_SRC_EFI;
+                        if( (buf = mem_chunk(logp, fp, 0x20, devmem)) == NULL ) {
+                                goto error;
+                        }
+                        snapshot_entry(snap, buf, 0x20);
+                }
+        }
+        free(buf);
+        return snap;
+
+ error:
+        free(buf);
+        free(snap);
+        return NULL;
+}
+
+
+/**
+ * Reads the table a located entry point points at, and computes its CRC.
+ *
+ * @param logp      Pointer to the log buffer
+ * @param snap      Snapshot returned by snapshot_locate()
+ * @param devmem    Memory device to read from if dumpfile is NULL
+ * @param dumpfile  Dump file written by dmidump, or NULL
+ *
+ * @return Returns 1 if the table was read, otherwise 0
+ */
+int snapshot_load(Log_t *logp, Snapshot_t *snap, const char *devmem, const char *dumpfile)
+{
+        u8 *hdr = NULL;
+        u32 hdrlen = 0, hdrcrc = 0;
+        int header = 0;
+        size_t len;
+
+        if( (snap == NULL) || !snap->found ) {
+                return 0;
+        }
+        len = snap->len;
+        if( snap->source == SNAPSHOT_SRC_SYSFS ) {
+                /* The sysfs table starts at offset 0, and SMBIOS 3 only gives a maximum length */
+                if( (snap->table = read_file(logp, &len, SYS_TABLE_FILE)) != NULL ) {
+                        snap->len = len;
+                }
+        } else if( dumpfile != NULL ) {
+                if( snap->base >= 0x20 + SNAPSHOT_DUMP_HDRLEN ) {
+                        hdr = mem_chunk(logp, 0x20, SNAPSHOT_DUMP_HDRLEN, dumpfile);
+                }
+                header = snapshot_header(logp, snap, hdr, &hdrlen, &hdrcrc);
+                free(hdr);
+                if( header >= 0 ) {
+                        snap->table = mem_chunk(logp, snap->base, snap->len, dumpfile);
+                }
+        } else {
+                snap->table = mem_chunk(logp, snap->base, snap->len, devmem);
+        }
+        if( (snap->table == NULL) || !snapshot_verify(logp, snap, header, hdrlen, hdrcrc) ) {
+                return 0;
+        }
+        snapshot_crc(snap);
+        return 1;
+}
+
+
+/**
+ * Locates the entry point and reads the complete DMI table into memory.
+ *
+ * @param logp      Pointer to the log buffer
+ * @param devmem    Memory device to read from if dumpfile is NULL
+ * @param dumpfile  Dump file written by dmidump, or NULL
+ *
+ * @return Returns a new snapshot which must be freed with snapshot_free().  If
+ *         no entry point was found, found is 0.  If the table could not be
+ *         read, table is NULL.  NULL is returned if the memory could not be
+ *         accessed at all.
+ */
+Snapshot_t *snapshot_read(Log_t *logp, const char *devmem, const char *dumpfile)
+{
+        Snapshot_t *snap = NULL;
+
+        if( (snap = snapshot_locate(logp, devmem, dumpfile)) != NULL ) {
+                snapshot_load(logp, snap, devmem, dumpfile);
+        }
+        return snap;
+}
+
+
+/**
+ * Builds the structure index of a snapshot.  Only complete structures are
+ * indexed; the walk stops at the first broken or truncated one, just like
+ * the decoder does.  Calling it again on an indexed snapshot is a no-op.
+ *
+ * @param snap  Snapshot to index
+ *
+ * @return Returns the number of indexed structures, or -1 on error
+ */
+int snapshot_index(Snapshot_t *snap)
+{
+        const u8 *buf, *data, *next;
+        u32 i = 0, size;
+
+        if( (snap == NULL) || !snap->found || (snap->table == NULL) ) {
+                return -1;
+        }
+        if( snap->structs != NULL ) {
+                return snap->count;
+        }
+
+        /* SMBIOS 3 does not announce the number of structures */
+        size = (snap->num != 0 ? snap->num : snap->len / 4);
+        snap->structs = (Snapshot_struct *) calloc(size + 1, sizeof(Snapshot_struct));
+        if( snap->structs == NULL ) {
+                return -1;
+        }
+
+        buf = data = snap->table;
+        while( ((snap->num == 0) || (i < snap->num)) && (data + 4 <= buf + snap->len) ) {
+                if( data[1] < 4 ) {
+                        break;
+                }
+
+                next = data + data[1];
+                while( (next - buf + 1 < snap->len) && (next[0] != 0 || next[1] != 0) ) {
+                        next++;
+                }
+                next += 2;
+                if( next - buf > snap->len ) {
+                        break;
+                }
+
+                snap->structs[i].type = data[0];
+                snap->structs[i].length = data[1];
+                snap->structs[i].handle = WORD(data + 2);
+                snap->structs[i].offset = data - buf;
+                snap->structs[i].size = next - data;
+                data = next;
+                i++;
+
+                if( (snap->num == 0) && (snap->structs[i - 1].type == 127) ) {
+                        break;
+                }
+        }
+        snap->count = i;
+
+        /* The OEM decoders need the system manufacturer, look it up once */
+        for( i = 0; i < snap->count; i++ ) {
+                if( (snap->structs[i].type == 1) && (snap->structs[i].length >= 5) ) {
+                        snap->manufacturer = snapshot_string(snap, &snap->structs[i],
+                                                             snap->table[snap->structs[i].offset + 0x04]);
+                        break;
+                }
+        }
+        return snap->count;
+}
+
+
+/**
+ * Looks up a string in the string-set of an indexed structure.  The string is
+ * returned as it is in the table, without the filtering done by dmi_string().
+ *
+ * @return Returns a pointer into the raw table, or NULL if s is 0 or out of range
+ */
+const char *snapshot_string(const Snapshot_t *snap, const Snapshot_struct *st, u8 s)
+{
+        const char *bp = (const char *) snap->table + st->offset + st->length;
+
+        if( s == 0 ) {
+                return NULL;
+        }
+        while( (s > 1) && (*bp != '\0') ) {
+                bp += strlen(bp) + 1;
+                s--;
+        }
+        return (*bp != '\0' ? bp : NULL);
+}
+
+
+/**
+ * Formats the fingerprint of a snapshot.  Byte-identical entry points and
+ * tables always give the same fingerprint, so a changed fingerprint means
+ * the table has changed.
+ *
+ * @param snap    Snapshot to fingerprint
+ * @param buf     Return buffer, should be at least SNAPSHOT_FPLEN bytes
+ * @param buflen  Size of the return buffer
+ *
+ * @return Returns buf on success, or NULL if the snapshot holds no table.
+ */
+char *snapshot_fingerprint(const Snapshot_t *snap, char *buf, size_t buflen)
+{
+        if( (snap == NULL) || !snap->found || (snap->table == NULL) ) {
+                return NULL;
+        }
+        snprintf(buf, buflen, "%08x%08x", snap->len, snap->crc);
+        return buf;
+}
+
+
+/**
+ * Sets the checksum byte at pos so that the len bytes at buf add up to 0.
+ */
+static void snapshot_checksum(u8 *buf, size_t len, size_t pos)
+{
+        u8 sum = 0;
+        size_t i;
+
+        buf[pos] = 0;
+        for( i = 0; i < len; i++ ) {
+                sum += buf[i];
+        }
+        buf[pos] = -sum;
+}
+
+
+/**
+ * Reads a snapshot from a dump image in memory, laid out like a dump file:
+ * the entry point at offset 0, an optional header and the table at the
+ * address the entry point gives.
+ *
+ * @param logp  Pointer to the log buffer
+ * @param buf   Dump image
+ * @param len   Size of the dump image
+ *
+ * @return Returns a new snapshot which must be freed with snapshot_free(),
+ *         with found and table set like snapshot_read() does, or NULL if
+ *         memory ran out.
+ */
+Snapshot_t *snapshot_parse(Log_t *logp, const u8 *buf, size_t len)
+{
+        Snapshot_t *snap = NULL;
+        u32 hdrlen = 0, hdrcrc = 0;
+        int header;
+
+        if( (snap = (Snapshot_t *) calloc(1, sizeof(Snapshot_t))) == NULL ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for snapshot");
+                return NULL;
+        }
+        snap->source = SNAPSHOT_SRC_DUMP;
+        if( !snapshot_entry(snap, buf, (len < 0x20 ? len : 0x20)) ) {
+                return snap;
+        }
+        header = snapshot_header(logp, snap, ((snap->base >= 0x20 + SNAPSHOT_DUMP_HDRLEN)
+                                              && (len >= 0x20 + SNAPSHOT_DUMP_HDRLEN) ? buf + 0x20 : NULL),
+                                 &hdrlen, &hdrcrc);
+        if( header < 0 ) {
+                return snap;
+        }
+        /* SMBIOS 3 only gives a maximum length, like the sysfs table it may be shorter */
+        if( (snap->num == 0) && !snap->legacy && ((size_t) snap->base <= len)
+            && ((size_t) snap->len > len - snap->base) ) {
+                snap->len = len - snap->base;
+        }
+        if( ((size_t) snap->base > len) || ((size_t) snap->len > len - snap->base) ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "DMI table is truncated in the dump image");
+                return snap;
+        }
+        if( (snap->table = malloc(snap->len > 0 ? snap->len : 1)) == NULL ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for snapshot");
+                return snap;
+        }
+        memcpy(snap->table, buf + snap->base, snap->len);
+        if( snapshot_verify(logp, snap, header, hdrlen, hdrcrc) ) {
+                snapshot_crc(snap);
+        }
+        return snap;
+}
+
+
+/**
+ * Makes the entry point of a dump file.  Just like dmidump does, the table
+ * address is changed to where the table is put in the file.  For SMBIOS 3,
+ * the maximum table length is set to the actual length.
+ *
+ * @param snap   Snapshot holding a table
+ * @param entry  Return buffer of 32 bytes
+ * @param base   Offset of the table in the dump file
+ */
+void snapshot_dump_entry(const Snapshot_t *snap, u8 *entry, u32 base)
+{
+        memset(entry, 0, 0x20);
+        memcpy(entry, snap->entry, snap->entry_len);
+        if( memcmp(entry, "_SM3_", 5) == 0 ) {
+                put32(entry + 0x0C, snap->len);
+                put64(entry + 0x10, base);
+                snapshot_checksum(entry, entry[0x06], 0x05);
+        } else if( memcmp(entry, "_SM_", 4) == 0 ) {
+                /* The intermediate checksum keeps the entry point checksum valid */
+                put32(entry + 0x18, base);
+                snapshot_checksum(entry + 0x10, 0x0F, 0x05);
+        } else {
+                put32(entry + 0x08, base);
+                snapshot_checksum(entry, 0x0F, 0x05);
+        }
+}
+
+
+/**
+ * Fills in the header of a dump file.  The header of a dump file is kept
+ * when it is written again, so it always describes the original read.
+ */
+static void snapshot_dump_header(const Snapshot_t *snap, u8 *hdr)
+{
+        memset(hdr, 0, SNAPSHOT_DUMP_HDRLEN);
+        memcpy(hdr, SNAPSHOT_DUMP_MAGIC, 8);
+        put16(hdr + 0x08, SNAPSHOT_DUMP_VERSION);
+        put16(hdr + 0x0A, SNAPSHOT_DUMP_HDRLEN);
+        if( memcmp(snap->entry, "_SM3_", 5) == 0 ) {
+                hdr[0x0D] = 3;
+        } else if( memcmp(snap->entry, "_SM_", 4) == 0 ) {
+                hdr[0x0D] = 2;
+        }
+        put32(hdr + 0x10, snap->len);
+        put32(hdr + 0x14, crc32c(0, snap->table, snap->len));
+        if( snap->source == SNAPSHOT_SRC_DUMP ) {
+                hdr[0x0C] = snap->origin;
+                put64(hdr + 0x18, (uint64_t) snap->taken);
+                memcpy(hdr + 0x28, snap->host, SNAPSHOT_HOSTLEN - 1);
+        } else {
+                hdr[0x0C] = snap->source;
+                put64(hdr + 0x18, (uint64_t) time(NULL));
+                if( gethostname((char *) hdr + 0x28, SNAPSHOT_HOSTLEN - 1) != 0 ) {
+                        memset(hdr + 0x28, 0, SNAPSHOT_HOSTLEN);
+                }
+        }
+        put32(hdr + 0x20, crc32c(0, hdr, SNAPSHOT_DUMP_HDRLEN));
+}
+
+
+static mode_t snapshot_umask = (mode_t) -1;
+
+/**
+ * Reads the umask of the process once, for the mode of new dump files.  The
+ * umask can only be read by setting it, so this is called before threads
+ * which could create files are started.
+ */
+void snapshot_init_umask(void)
+{
+        if( snapshot_umask == (mode_t) -1 ) {
+                snapshot_umask = umask(0);
+                umask(snapshot_umask);
+        }
+}
+
+
+/**
+ * Writes a snapshot as a dump file, which can be read back with
+ * snapshot_read().  The entry point made by snapshot_dump_entry() goes to
+ * offset 0, followed by the header and the table.  The file is written
+ * under a temporary name in the same directory and renamed when it is
+ * complete, so readers see either the old or the new dump file.  A replaced
+ * dump file keeps its mode, a new one is created like open() with 0666 would.
+ *
+ * @param logp      Pointer to the log buffer
+ * @param snap      Snapshot holding a table
+ * @param dumpfile  File to write, it is replaced if it exists
+ *
+ * @return Returns 1 on success, otherwise 0
+ */
+int snapshot_write(Log_t *logp, const Snapshot_t *snap, const char *dumpfile)
+{
+        u8 entry[0x20], hdr[SNAPSHOT_DUMP_HDRLEN];
+        struct iovec iov[3];
+        struct stat sb;
+        char *tmpname = NULL;
+        mode_t mode;
+        ssize_t n;
+        int fd = -1, i = 0;
+
+        if( (snap == NULL) || !snap->found || (snap->table == NULL) ) {
+                return 0;
+        }
+        snapshot_dump_entry(snap, entry, sizeof(entry) + sizeof(hdr));
+        snapshot_dump_header(snap, hdr);
+        iov[0].iov_base = entry;
+        iov[0].iov_len = sizeof(entry);
+        iov[1].iov_base = hdr;
+        iov[1].iov_len = sizeof(hdr);
+        iov[2].iov_base = snap->table;
+        iov[2].iov_len = snap->len;
+
+        if( (tmpname = malloc(strlen(dumpfile) + 8)) == NULL ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for the dump file name");
+                return 0;
+        }
+        sprintf(tmpname, "%s.XXXXXX", dumpfile);
+        if( (fd = mkstemp(tmpname)) < 0 ) {
+                log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s: %s", dumpfile, strerror(errno));
+                free(tmpname);
+                return 0;
+        }
+
+        /* One writev() normally writes it all, continue where a short write stopped */
+        while( i < 3 ) {
+                if( (n = writev(fd, iov + i, 3 - i)) < 0 ) {
+                        if( errno == EINTR ) {
+                                continue;
+                        }
+                        goto error;
+                }
+                while( (i < 3) && ((size_t) n >= iov[i].iov_len) ) {
+                        n -= iov[i].iov_len;
+                        i++;
+                }
+                if( i < 3 ) {
+                        iov[i].iov_base = (u8 *) iov[i].iov_base + n;
+                        iov[i].iov_len -= n;
+                }
+        }
+        if( stat(dumpfile, &sb) == 0 ) {
+                mode = sb.st_mode & 07777;
+        } else {
+                snapshot_init_umask();
+                mode = 0666 & ~snapshot_umask;
+        }
+        if( (fchmod(fd, mode) != 0) || (fsync(fd) != 0) ) {
+                goto error;
+        }
+        if( close(fd) != 0 ) {
+                fd = -1;
+                goto error;
+        }
+        fd = -1;
+        if( rename(tmpname, dumpfile) != 0 ) {
+                goto error;
+        }
+        free(tmpname);
+        return 1;
+
+ error:
+        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "%s: %s", dumpfile, strerror(errno));
+        if( fd >= 0 ) {
+                close(fd);
+        }
+        unlink(tmpname);
+        free(tmpname);
+        return 0;
+}
+
+
+/**
+ * Free all memory used by a snapshot.
+ *
+ * @param snap Snapshot to free, may be NULL
+ */
+void snapshot_free(Snapshot_t *snap)
+{
+        if( snap == NULL ) {
+                return;
+        }
+        if( snap->table != NULL ) {
+                free(snap->table);
+                snap->table = NULL;
+        }
+        if( snap->structs != NULL ) {
+                free(snap->structs);
+                snap->structs = NULL;
+        }
+        free(snap);
+}
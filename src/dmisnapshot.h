@@ -0,0 +1,129 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmisnapshot.h
+ *  @brief One consistent read of the SMBIOS/DMI entry point and table
+ */
+
+#ifndef DMISNAPSHOT_H
+#define DMISNAPSHOT_H
+
+#include <time.h>
+
+#include "types.h"
+#include "dmilog.h"
+
+/**
+ *  Where the snapshot was read from
+ */
+typedef enum { SNAPSHOT_SRC_DUMP = 0,   /**< A dump file written by dmidump */
+               SNAPSHOT_SRC_EFI  = 1,   /**< Entry point address from the EFI systab */
+               SNAPSHOT_SRC_SCAN = 2,   /**< Entry point found by scanning 0xF0000-0xFFFFF */
+               SNAPSHOT_SRC_SYSFS = 3   /**< Entry point and table exported by Linux in sysfs */
+} Snapshot_src;
+
+/** sysfs copies of the entry point and the table, Linux >= 4.2 */
+#define SYS_ENTRY_FILE "/sys/firmware/dmi/tables/smbios_entry_point"
+#define SYS_TABLE_FILE "/sys/firmware/dmi/tables/DMI"
+
+/** Length of a fingerprint string, including the terminating NUL */
+#define SNAPSHOT_FPLEN 17
+
+/**
+ *  Dump files written by snapshot_write() have a header between the entry
+ *  point and the table.  The entry point gives the table address after the
+ *  header, so readers which do not know the header still find the table.
+ *  Legacy dump files have the table right after the entry point, at 32.
+ *
+ *  Header layout, all numbers are little-endian:
+ *  @verbatim
+    0x00  "PYDMIDMP"
+    0x08  u16 version (2), u16 header length
+    0x0C  u8 Snapshot_src the table was read from
+    0x0D  u8 entry point type, 2 for _SM_, 3 for _SM3_ and 0 for _DMI_
+    0x10  u32 table length
+    0x14  u32 CRC-32C of the table
+    0x18  u64 time the table was read, seconds since the epoch
+    0x20  u32 CRC-32C of the header, computed with this field set to 0
+    0x28  host name, NUL padded
+    @endverbatim
+ */
+#define SNAPSHOT_DUMP_MAGIC     "PYDMIDMP"
+#define SNAPSHOT_DUMP_VERSION   2
+#define SNAPSHOT_DUMP_HDRLEN    0x80
+#define SNAPSHOT_HOSTLEN        64
+
+/**
+ *  Location of one structure inside a snapshot table
+ */
+struct _Snapshot_struct {
+        u8 type;                /**< Structure type */
+        u8 length;              /**< Length of the formatted area */
+        u16 handle;             /**< Structure handle */
+        u32 offset;             /**< Offset of the structure in the table */
+        u32 size;               /**< Formatted area plus string-set, including the double NUL */
+};
+typedef struct _Snapshot_struct Snapshot_struct;
+
+/**
+ *  A raw copy of the entry point and the DMI table it points at.  The table
+ *  is never modified after it has been read, so a snapshot can be decoded
+ *  any number of times.
+ */
+struct _Snapshot_t {
+        Snapshot_src source;    /**< Where the data was read from */
+        int found;              /**< Set to 1 if a valid entry point was found */
+        int legacy;             /**< Set to 1 if the entry point is a legacy _DMI_ one */
+        u8 entry[0x20];         /**< Raw copy of the entry point */
+        u8 entry_len;           /**< Number of valid bytes in entry */
+        u32 base;               /**< Table address, as given by the entry point */
+        u32 len;                /**< Table length in bytes, the maximum length for SMBIOS 3 */
+        u16 num;                /**< Number of structures announced by the entry point, 0 if unknown (SMBIOS 3) */
+        u16 ver;                /**< SMBIOS version, with known BIOS fixups applied */
+        u8 *table;              /**< Raw table, NULL if it could not be read */
+        u32 crc;                /**< CRC-32C of the entry point, as made by snapshot_dump_entry(), and the table */
+        Snapshot_struct *structs; /**< Structure index, filled by snapshot_index() */
+        u32 count;              /**< Number of entries in structs */
+        const char *manufacturer; /**< System manufacturer for the OEM decoders, filled by snapshot_index() */
+        int dumpver;            /**< Dump file layout, 1 for legacy or SNAPSHOT_DUMP_VERSION, 0 if not a dump */
+        Snapshot_src origin;    /**< Where the table in a dump file was read from, from the header */
+        time_t taken;           /**< When the table in a dump file was read, 0 if unknown */
+        char host[SNAPSHOT_HOSTLEN]; /**< Host the table in a dump file was read on, empty if unknown */
+};
+typedef struct _Snapshot_t Snapshot_t;
+
+Snapshot_t *snapshot_locate(Log_t *logp, const char *devmem, const char *dumpfile);
+int snapshot_load(Log_t *logp, Snapshot_t *snap, const char *devmem, const char *dumpfile);
+Snapshot_t *snapshot_read(Log_t *logp, const char *devmem, const char *dumpfile);
+int snapshot_index(Snapshot_t *snap);
+const char *snapshot_string(const Snapshot_t *snap, const Snapshot_struct *st, u8 s);
+char *snapshot_fingerprint(const Snapshot_t *snap, char *buf, size_t buflen);
+Snapshot_t *snapshot_parse(Log_t *logp, const u8 *buf, size_t len);
+void snapshot_dump_entry(const Snapshot_t *snap, u8 *entry, u32 base);
+void snapshot_init_umask(void);
+int snapshot_write(Log_t *logp, const Snapshot_t *snap, const char *dumpfile);
+void snapshot_free(Snapshot_t *snap);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmistats.c
+ *  @brief Per-process instrumentation counters
+ */
+
+#include <time.h>
+
+#include "dmistats.h"
+
+Stats_t dmi_stats;
+
+static const char *phase_names[STATS_PHASE_MAX] = {
+        "read",
+        "decode",
+        "pythonize",
+        "xpath"
+};
+
+
+/**
+ * Returns a monotonic time stamp, in nanoseconds
+ */
+unsigned long long stats_now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * Adds the time passed since start to a phase
+ *
+ * @param phase  Phase to account the time to
+ * @param start  Time stamp returned by stats_now() when the phase began
+ */
+void stats_phase_end(Stats_phase phase, unsigned long long start)
+{
+        __atomic_fetch_add(&dmi_stats.ns[phase], stats_now() - start, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Returns the name of a phase, as used in the Python API
+ */
+const char *stats_phase_name(Stats_phase phase)
+{
+        return (phase < STATS_PHASE_MAX ? phase_names[phase] : NULL);
+}
+
+
+/**
+ * Sets all counters to zero.  Every counter is cleared with an atomic
+ * exchange, so adds made by queries running meanwhile are either counted
+ * before the reset or after it, never lost half-way.
+ */
+void stats_reset(void)
+{
+        int i;
+
+        __atomic_exchange_n(&dmi_stats.bytes_read, 0, __ATOMIC_RELAXED);
+        __atomic_exchange_n(&dmi_stats.structs_walked, 0, __ATOMIC_RELAXED);
+        __atomic_exchange_n(&dmi_stats.structs_decoded, 0, __ATOMIC_RELAXED);
+        __atomic_exchange_n(&dmi_stats.xml_nodes, 0, __ATOMIC_RELAXED);
+        __atomic_exchange_n(&dmi_stats.xml_attributes, 0, __ATOMIC_RELAXED);
+        __atomic_exchange_n(&dmi_stats.xpath_evals, 0, __ATOMIC_RELAXED);
+        __atomic_exchange_n(&dmi_stats.py_objects, 0, __ATOMIC_RELAXED);
+        __atomic_exchange_n(&dmi_stats.log_appends, 0, __ATOMIC_RELAXED);
+        for( i = 0; i < STATS_PHASE_MAX; i++ ) {
+                __atomic_exchange_n(&dmi_stats.ns[i], 0, __ATOMIC_RELAXED);
+        }
+}
@@ -0,0 +1,73 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmistats.h
+ *  @brief Per-process instrumentation counters
+ */
+
+#ifndef DMISTATS_H
+#define DMISTATS_H
+
+/**
+ *  Phases the time of a query is split into
+ */
+typedef enum { STATS_PHASE_READ = 0,      /**< Reading the entry point and table (mem_chunk()) */
+               STATS_PHASE_DECODE,        /**< Decoding the table into XML */
+               STATS_PHASE_PYTHONIZE,     /**< Converting the XML to Python objects */
+               STATS_PHASE_XPATH,         /**< XPath evaluations, also part of STATS_PHASE_PYTHONIZE */
+               STATS_PHASE_MAX
+} Stats_phase;
+
+/**
+ *  Counters collected since the module was loaded or the last stats_reset().
+ *  The counters belong to the process, they are shared by all threads and
+ *  all interpreters which load the module.  They are only accessed with
+ *  relaxed atomics, so concurrent queries never lose counts and readers
+ *  never see a torn value, also without a GIL.
+ */
+struct _Stats_t {
+        unsigned long long bytes_read;        /**< Bytes copied by mem_chunk() */
+        unsigned long structs_walked;         /**< Structures visited while walking a table */
+        unsigned long structs_decoded;        /**< Structures decoded into XML */
+        unsigned long xml_nodes;              /**< XML elements created while decoding */
+        unsigned long xml_attributes;         /**< XML attributes created while decoding */
+        unsigned long xpath_evals;            /**< XPath expressions evaluated */
+        unsigned long py_objects;             /**< Python objects created by the pythonizer */
+        unsigned long log_appends;            /**< Calls to log_append() */
+        unsigned long long ns[STATS_PHASE_MAX]; /**< Cumulative nanoseconds per phase */
+};
+typedef struct _Stats_t Stats_t;
+
+extern Stats_t dmi_stats;
+
+#define stats_add(counter, n) ((void) __atomic_fetch_add(&dmi_stats.counter, (n), __ATOMIC_RELAXED))
+#define stats_get(counter) __atomic_load_n(&dmi_stats.counter, __ATOMIC_RELAXED)
+
+unsigned long long stats_now(void);
+void stats_phase_end(Stats_phase phase, unsigned long long start);
+const char *stats_phase_name(Stats_phase phase);
+void stats_reset(void);
+
+#endif
@@ -0,0 +1,475 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmistream.c
+ *  @brief Streams decoded DMI structures through an XML->Python mapping into a sink
+ *
+ *  The result has the same layout as the dictionaries made by pythonizeXMLnode(),
+ *  but no Python objects are created.  The structures are decoded one at a time
+ *  into a small XML document which is freed as soon as it has been written to
+ *  the sink, so memory use does not grow with the size of the table.
+ */
+
+#include <Python.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libxml/tree.h>
+#include <libxml/xpath.h>
+
+#include "dmidecode.h"
+#include "dmixml.h"
+#include "dmistats.h"
+#include "dmistream.h"
+
+struct stream {
+        Log_t *logp;
+        Sink_t *sink;
+        xmlXPathContext *xpctx;
+};
+
+static int stream_members(struct stream *st, ptzMAP *in_map, xmlNode *data_n);
+
+
+static xmlXPathObject *stream_xpath(struct stream *st, xmlNode *node, const char *xpath)
+{
+        st->xpctx->node = node;
+        return _get_xpath_values(st->xpctx, xpath);
+}
+
+
+static char *stream_key(struct stream *st, char *key, ptzMAP *map_p, xmlNode *node, int idx)
+{
+        st->xpctx->node = node;
+        return _get_key_value(st->logp, key, 256, map_p, st->xpctx, idx);
+}
+
+
+static int stream_error(struct stream *st, ptzMAP *map_p, int elmtid)
+{
+        log_append(st->logp, LOGFL_NORMAL, LOG_ERR, "Could not get key value: %s [%i] (Defining key: %s)",
+                   map_p->rootpath, elmtid, map_p->key);
+        return -1;
+}
+
+
+/**
+ * Writes an integer from the decoder as the type of a mapping entry, the
+ * counterpart of RawToPyObj()
+ *
+ * @return Returns 0 if the entry is not numeric and nothing was written
+ */
+static int stream_raw_value(struct stream *st, ptzMAP *map_p, int rawtype, long raw)
+{
+        switch( map_p->type_value ) {
+        case ptzINT:
+        case ptzLIST_INT:
+                st->sink->ops->integer(st->sink, raw);
+                return 1;
+
+        case ptzFLOAT:
+        case ptzLIST_FLOAT:
+                st->sink->ops->real(st->sink, (rawtype == DMIXML_RAW_UNSIGNED
+                                               ? (double) (unsigned long) raw : (double) raw));
+                return 1;
+
+        case ptzBOOL:
+        case ptzLIST_BOOL:
+                st->sink->ops->boolean(st->sink, (raw == 1 ? 1 : 0));
+                return 1;
+
+        default:
+                return 0;
+        }
+}
+
+
+/**
+ * Writes a value converted the same way as StringToPyObj() does
+ */
+static void stream_value(struct stream *st, ptzMAP *map_p, const char *instr)
+{
+        const char *workstr = NULL;
+        long raw = 0;
+        int rawtype;
+
+        if( (workstr = ptzmap_GetValue(map_p, instr)) == NULL ) {
+                st->sink->ops->null(st->sink);
+                return;
+        }
+
+        switch( map_p->type_value ) {
+        case ptzINT:
+        case ptzLIST_INT:
+        case ptzBOOL:
+        case ptzLIST_BOOL:
+                rawtype = dmixml_ParseRawValue(workstr, &raw);
+                stream_raw_value(st, map_p, rawtype, raw);
+                break;
+
+        case ptzFLOAT:
+        case ptzLIST_FLOAT:
+                st->sink->ops->real(st->sink, atof(workstr));
+                break;
+
+        case ptzSTR:
+        case ptzLIST_STR:
+                st->sink->ops->string(st->sink, workstr);
+                break;
+
+        default:
+                log_append(st->logp, LOGFL_NODUPS, LOG_WARNING, "Invalid type '%i' for value '%s'",
+                           map_p->type_value, instr);
+                st->sink->ops->null(st->sink);
+        }
+}
+
+
+/**
+ * Writes one value of an XPath result.  Integers the decoder attached to the XML
+ * node are written directly, other values are parsed from the node text.
+ */
+static void stream_xpath_value(struct stream *st, ptzMAP *map_p, xmlXPathObject *xpo, int idx)
+{
+        char val[4098];
+        long raw = 0;
+        int rawtype;
+
+        if( map_p->canonical ) {
+                if( ptzmap_CanonicalValue(xpo, idx, &raw) ) {
+                        st->sink->ops->integer(st->sink, raw);
+                } else {
+                        st->sink->ops->null(st->sink);
+                }
+                return;
+        }
+
+        // emptyIsNone and emptyValue are rules on the text, see XPathToPyObj()
+        if( (map_p->emptyIsNone == 0) && (map_p->emptyValue == NULL)
+            && ((rawtype = dmixml_GetXPathRawValue(xpo, idx, &raw)) != 0)
+            && stream_raw_value(st, map_p, rawtype, raw) ) {
+                return;
+        }
+        memset(val, 0, sizeof(val));
+        dmixml_GetXPathContent(st->logp, val, 4097, xpo, idx);
+        stream_value(st, map_p, val);
+}
+
+
+/**
+ * Returns the position of the last node in a node set carrying the given list
+ * index, or -1 if there is none.  Fixed lists are written in index order, where
+ * the pythonizer would overwrite list items.
+ */
+static int stream_list_item(ptzMAP *map_p, xmlNodeSet *nodes, int index)
+{
+        char *idx = NULL;
+        int i;
+
+        for( i = nodes->nodeNr - 1; i >= 0; i-- ) {
+                idx = dmixml_GetAttrValue(nodes->nodeTab[i], map_p->list_index);
+                if( (idx != NULL) && (atoi(idx) == index) ) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+
+/**
+ * Writes a single value map entry, the counterpart of _add_xpath_result()
+ */
+static void stream_xpath_result(struct stream *st, ptzMAP *map_p, xmlNode *data_n, xmlXPathObject *value)
+{
+        char key[258];
+        int i;
+
+        switch( value->type ) {
+        case XPATH_NODESET:
+                if( value->nodesetval == NULL ) {
+                        break;
+                }
+                if( value->nodesetval->nodeNr == 0 ) {
+                        if( stream_key(st, key, map_p, data_n, 0) != NULL ) {
+                                st->sink->ops->key(st->sink, key);
+                                st->sink->ops->null(st->sink);
+                        }
+                        break;
+                }
+                for( i = 0; i < value->nodesetval->nodeNr; i++ ) {
+                        // A constant key would be set repeatedly, only the last value is kept
+                        if( (map_p->type_key == ptzCONST) && (i < value->nodesetval->nodeNr - 1) ) {
+                                continue;
+                        }
+                        if( stream_key(st, key, map_p, data_n, i) != NULL ) {
+                                st->sink->ops->key(st->sink, key);
+                                stream_xpath_value(st, map_p, value, i);
+                        }
+                }
+                break;
+
+        default:
+                if( stream_key(st, key, map_p, data_n, 0) != NULL ) {
+                        st->sink->ops->key(st->sink, key);
+                        stream_xpath_value(st, map_p, value, 0);
+                }
+                break;
+        }
+}
+
+
+/**
+ * Writes a list of values
+ */
+static void stream_value_list(struct stream *st, ptzMAP *map_p, xmlXPathObject *xpo)
+{
+        int i, k;
+
+        st->sink->ops->begin_list(st->sink);
+        if( map_p->fixed_list_size > 0 ) {
+                for( k = 1; k <= map_p->fixed_list_size; k++ ) {
+                        if( (i = stream_list_item(map_p, xpo->nodesetval, k)) < 0 ) {
+                                st->sink->ops->null(st->sink);
+                                continue;
+                        }
+                        stream_xpath_value(st, map_p, xpo, i);
+                }
+        } else {
+                for( i = 0; i < xpo->nodesetval->nodeNr; i++ ) {
+                        stream_xpath_value(st, map_p, xpo, i);
+                }
+        }
+        st->sink->ops->end_list(st->sink);
+}
+
+
+/**
+ * Writes a nested dictionary
+ */
+static int stream_dict(struct stream *st, ptzMAP *map_p, xmlNode *data_n)
+{
+        int ret;
+
+        st->sink->ops->begin_map(st->sink);
+        ret = stream_members(st, map_p, data_n);
+        st->sink->ops->end_map(st->sink);
+        return ret;
+}
+
+
+/**
+ * Writes one map entry, the counterpart of _deep_pythonize()
+ *
+ * @return Returns 0 on success, -1 on error
+ */
+static int stream_entry(struct stream *st, ptzMAP *map_p, xmlNode *data_n, int elmtid)
+{
+        xmlXPathObject *xpo = NULL;
+        char key[258];
+        int i, k, ret = 0;
+
+        switch( map_p->type_value ) {
+        case ptzCONST:
+                if( stream_key(st, key, map_p, data_n, 0) == NULL ) {
+                        return stream_error(st, map_p, elmtid);
+                }
+                st->sink->ops->key(st->sink, key);
+                st->sink->ops->string(st->sink, map_p->value);
+                break;
+
+        case ptzSTR:
+        case ptzINT:
+        case ptzFLOAT:
+        case ptzBOOL:
+                xpo = stream_xpath(st, data_n, map_p->value);
+                if( xpo != NULL ) {
+                        stream_xpath_result(st, map_p, data_n, xpo);
+                        xmlXPathFreeObject(xpo);
+                }
+                break;
+
+        case ptzLIST_STR:
+        case ptzLIST_INT:
+        case ptzLIST_FLOAT:
+        case ptzLIST_BOOL:
+                xpo = stream_xpath(st, data_n, map_p->value);
+                if( xpo == NULL ) {
+                        break;
+                }
+                if( stream_key(st, key, map_p, data_n, 0) == NULL ) {
+                        xmlXPathFreeObject(xpo);
+                        return stream_error(st, map_p, elmtid);
+                }
+                st->sink->ops->key(st->sink, key);
+                if( (xpo->nodesetval != NULL) && (xpo->nodesetval->nodeNr > 0) ) {
+                        stream_value_list(st, map_p, xpo);
+                } else {
+                        st->sink->ops->null(st->sink);
+                }
+                xmlXPathFreeObject(xpo);
+                break;
+
+        case ptzDICT:
+                if( map_p->child == NULL ) {
+                        break;
+                }
+                if( stream_key(st, key, map_p, data_n, 0) == NULL ) {
+                        return stream_error(st, map_p, elmtid);
+                }
+                st->sink->ops->key(st->sink, key);
+                ret = stream_dict(st, map_p->child, data_n);
+                break;
+
+        case ptzLIST_DICT:
+                if( map_p->child == NULL ) {
+                        break;
+                }
+                if( stream_key(st, key, map_p, data_n, 0) == NULL ) {
+                        return stream_error(st, map_p, elmtid);
+                }
+                xpo = stream_xpath(st, data_n, map_p->value);
+                if( (xpo == NULL) || (xpo->nodesetval == NULL) || (xpo->nodesetval->nodeNr == 0) ) {
+                        if( xpo != NULL ) {
+                                xmlXPathFreeObject(xpo);
+                        }
+                        return stream_error(st, map_p, elmtid);
+                }
+
+                st->sink->ops->key(st->sink, key);
+                st->sink->ops->begin_list(st->sink);
+                if( map_p->fixed_list_size > 0 ) {
+                        for( k = 1; (ret == 0) && (k <= map_p->fixed_list_size); k++ ) {
+                                if( (i = stream_list_item(map_p, xpo->nodesetval, k)) < 0 ) {
+                                        st->sink->ops->null(st->sink);
+                                } else {
+                                        ret = stream_dict(st, map_p->child, xpo->nodesetval->nodeTab[i]);
+                                }
+                        }
+                } else {
+                        for( i = 0; (ret == 0) && (i < xpo->nodesetval->nodeNr); i++ ) {
+                                ret = stream_dict(st, map_p->child, xpo->nodesetval->nodeTab[i]);
+                        }
+                }
+                st->sink->ops->end_list(st->sink);
+                xmlXPathFreeObject(xpo);
+                break;
+
+        default:
+                log_append(st->logp, LOGFL_NODUPS, LOG_WARNING, "Unknown value type: %i", map_p->type_value);
+                break;
+        }
+        return ret;
+}
+
+
+/**
+ * Writes the members of a dictionary, the counterpart of pythonizeXMLnode()
+ *
+ * @return Returns 0 on success, -1 on error
+ */
+static int stream_members(struct stream *st, ptzMAP *in_map, xmlNode *data_n)
+{
+        xmlXPathObject *xpo = NULL;
+        ptzMAP *map_p = NULL;
+        char key[258];
+        int i, ret = 0;
+
+        foreach_xmlnode(in_map, map_p) {
+                if( (map_p->type_value == ptzDICT) && (map_p->rootpath != NULL) ) {
+                        xpo = stream_xpath(st, data_n, map_p->rootpath);
+                        if( (xpo != NULL) && (xpo->nodesetval != NULL) ) {
+                                for( i = 0; (ret == 0) && (i < xpo->nodesetval->nodeNr); i++ ) {
+                                        if( stream_key(st, key, map_p, xpo->nodesetval->nodeTab[i], 0) != NULL ) {
+                                                ret = stream_entry(st, map_p, xpo->nodesetval->nodeTab[i], i);
+                                        }
+                                }
+                        }
+                        if( xpo != NULL ) {
+                                xmlXPathFreeObject(xpo);
+                        }
+                } else {
+                        ret = stream_entry(st, map_p, data_n, 0);
+                }
+                if( (ret != 0) || (st->sink->error != 0) ) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+
+/**
+ * Decodes the structures of the selected types and writes them to a sink as
+ * one map, keyed the way the mapping defines.
+ *
+ * @param logp   Pointer to the log buffer, errors are logged as LOG_ERR
+ * @param sink   Sink to write to
+ * @param map    Mapping for the selected types, may be NULL to write an empty map
+ * @param types  Array of 256 flags, set to 1 for each type to decode
+ * @param snap   Snapshot to decode
+ *
+ * @return Returns 0 on success, -1 on error
+ */
+int dmistream_snapshot(Log_t *logp, Sink_t *sink, ptzMAP *map, const u8 *types, Snapshot_t *snap)
+{
+        struct stream st;
+        xmlDoc *doc = NULL;
+        xmlNode *root_n = NULL;
+        unsigned long long start;
+        u32 s;
+        int ret = 0;
+
+        st.logp = logp;
+        st.sink = sink;
+        sink->ops->begin_map(sink);
+        if( (map != NULL) && (snapshot_index(snap) > 0) ) {
+                for( s = 0; (ret == 0) && (s < snap->count); s++ ) {
+                        if( !types[snap->structs[s].type] ) {
+                                continue;
+                        }
+
+                        doc = xmlNewDoc((xmlChar *) "1.0");
+                        root_n = xmlNewNode(NULL, (xmlChar *) "dmidecode");
+                        xmlDocSetRootElement(doc, root_n);
+
+                        start = stats_now();
+                        snapshot_decode_struct(snap, &snap->structs[s], root_n);
+                        stats_phase_end(STATS_PHASE_DECODE, start);
+                        dmixml_CountNodes(root_n->children);
+
+                        start = stats_now();
+                        st.xpctx = xmlXPathNewContext(doc);
+                        ret = stream_members(&st, map, root_n);
+                        xmlXPathFreeContext(st.xpctx);
+                        stats_phase_end(STATS_PHASE_PYTHONIZE, start);
+
+                        xmlFreeDoc(doc);
+                }
+        }
+        sink->ops->end_map(sink);
+        return ((ret != 0) || (sink->error != 0) ? -1 : 0);
+}
@@ -0,0 +1,41 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmistream.h
+ *  @brief Streams decoded DMI structures through an XML->Python mapping into a sink
+ */
+
+#ifndef DMISTREAM_H
+#define DMISTREAM_H
+
+#include "types.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+#include "dmisink.h"
+#include "xmlpythonizer.h"
+
+int dmistream_snapshot(Log_t *logp, Sink_t *sink, ptzMAP *map, const u8 *types, Snapshot_t *snap);
+
+#endif
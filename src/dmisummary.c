@@ -0,0 +1,540 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+/**
+ *  @file dmisummary.c
+ *  @brief Aggregated views computed straight from the raw DMI table
+ *
+ *  The summaries answer questions which otherwise need every structure of a
+ *  few types to be decoded into dictionaries and joined by handle in Python.
+ *  They are computed in one walk over the structure index of a snapshot,
+ *  reading the raw fields, so the sizes and speeds are never formatted into
+ *  strings just to be parsed again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "types.h"
+#include "dmilog.h"
+#include "dmidecode.h"
+#include "dmisnapshot.h"
+#include "dmisummary.h"
+
+/**
+ * Makes room for one more element in a list, doubling its size when full.
+ *
+ * @return Returns the list, which may have moved, or NULL if memory ran out
+ */
+static void *summary_grow(void *list, unsigned int *size, unsigned int count, size_t elmsize)
+{
+        void *ptr = NULL;
+
+        if( count < *size ) {
+                return list;
+        }
+        if( (ptr = realloc(list, (*size ? *size * 2 : 8) * elmsize)) == NULL ) {
+                return NULL;
+        }
+        *size = (*size ? *size * 2 : 8);
+        memset((char *) ptr + count * elmsize, 0, (*size - count) * elmsize);
+        return ptr;
+}
+
+
+/**
+ * Copies a string from the raw table, replacing the characters dmi_string()
+ * would filter with dots.  NULL gives an empty string.
+ */
+static void summary_string(char *buf, size_t len, const char *str)
+{
+        size_t i;
+
+        snprintf(buf, len, "%s", (str != NULL ? str : ""));
+        for( i = 0; buf[i] != '\0'; i++ ) {
+                if( (buf[i] < 32) || (buf[i] == 127) || ((unsigned char) buf[i] > 127) ) {
+                        buf[i] = '.';
+                }
+        }
+}
+
+
+static unsigned long long summary_qword(const u8 *p)
+{
+        u64 val = QWORD(p);
+
+        return ((unsigned long long) val.h << 32) | val.l;
+}
+
+
+/**
+ * Finds the array with the given handle, or adds an empty one.  Devices may
+ * point at an array which comes later in the table, or which is missing.
+ */
+static Memsummary_array *memsummary_array(Memsummary_t *ms, unsigned int *size, u16 handle)
+{
+        Memsummary_array *arrays = NULL;
+        unsigned int i;
+
+        for( i = 0; i < ms->narrays; i++ ) {
+                if( ms->arrays[i].handle == handle ) {
+                        return &ms->arrays[i];
+                }
+        }
+        arrays = summary_grow(ms->arrays, size, ms->narrays, sizeof(Memsummary_array));
+        if( arrays == NULL ) {
+                return NULL;
+        }
+        ms->arrays = arrays;
+        ms->arrays[ms->narrays].handle = handle;
+        return &ms->arrays[ms->narrays++];
+}
+
+
+/**
+ * Derives the channel of a device from its Bank Locator.  Bank Locators such
+ * as "P0_Node0_Channel1_Dimm0" name the DIMM inside the channel last, so
+ * everything from the last "DIMM" following a separator is cut off.  Other
+ * Bank Locators are used as they are.
+ */
+static void memsummary_channel_name(const char *bank, char *buf, size_t len)
+{
+        size_t i, cut;
+
+        summary_string(buf, len, bank);
+        cut = strlen(buf);
+        for( i = 0; buf[i] != '\0'; i++ ) {
+                if( (i > 0) && (strchr("_- /", buf[i - 1]) != NULL)
+                    && (strncasecmp(buf + i, "dimm", 4) == 0) ) {
+                        cut = i - 1;
+                }
+        }
+        buf[cut] = '\0';
+}
+
+
+static Memsummary_channel *memsummary_channel(Memsummary_t *ms, unsigned int *size,
+                                              u16 array, const char *bank)
+{
+        Memsummary_channel *channels = NULL;
+        char name[sizeof(ms->channels->name)];
+        unsigned int i;
+
+        memsummary_channel_name(bank, name, sizeof(name));
+        for( i = 0; i < ms->nchannels; i++ ) {
+                if( (ms->channels[i].array == array) && (strcmp(ms->channels[i].name, name) == 0) ) {
+                        return &ms->channels[i];
+                }
+        }
+        channels = summary_grow(ms->channels, size, ms->nchannels, sizeof(Memsummary_channel));
+        if( channels == NULL ) {
+                return NULL;
+        }
+        ms->channels = channels;
+        ms->channels[ms->nchannels].array = array;
+        memcpy(ms->channels[ms->nchannels].name, name, sizeof(name));
+        return &ms->channels[ms->nchannels++];
+}
+
+
+static Memsummary_mix *memsummary_mix(Memsummary_t *ms, unsigned int *size,
+                                      const char *type, unsigned int speed)
+{
+        Memsummary_mix *mix = NULL;
+        unsigned int i;
+
+        for( i = 0; i < ms->nmix; i++ ) {
+                if( (ms->mix[i].type == type) && (ms->mix[i].speed == speed) ) {
+                        return &ms->mix[i];
+                }
+        }
+        mix = summary_grow(ms->mix, size, ms->nmix, sizeof(Memsummary_mix));
+        if( mix == NULL ) {
+                return NULL;
+        }
+        ms->mix = mix;
+        ms->mix[ms->nmix].type = type;
+        ms->mix[ms->nmix].speed = speed;
+        return &ms->mix[ms->nmix++];
+}
+
+
+/**
+ * Size of a Memory Device (7.18.5), in bytes.  0 means the slot is empty or
+ * the size is unknown.
+ */
+unsigned long long memsummary_device_size(const Snapshot_struct *st, const u8 *data)
+{
+        u16 code = WORD(data + 0x0C);
+
+        if( (st->length >= 0x20) && (code == 0x7FFF) ) {
+                return (unsigned long long) (DWORD(data + 0x1C) & 0x7FFFFFFFUL) << 20;
+        }
+        if( (code == 0) || (code == 0xFFFF) ) {
+                return 0;
+        }
+        if( code & 0x8000 ) {
+                return (unsigned long long) (code & 0x7FFF) << 10;
+        }
+        return (unsigned long long) code << 20;
+}
+
+
+/**
+ * Speed of a Memory Device in MT/s, 0 if unknown.  SMBIOS 3.3 moved speeds
+ * above 65534 MT/s to the Extended Speed field.
+ */
+unsigned int memsummary_device_speed(const Snapshot_struct *st, const u8 *data)
+{
+        u16 code;
+
+        if( st->length < 0x17 ) {
+                return 0;
+        }
+        code = WORD(data + 0x15);
+        if( (code == 0xFFFF) && (st->length >= 0x58) ) {
+                return DWORD(data + 0x54) & 0x7FFFFFFFUL;
+        }
+        return (code == 0xFFFF ? 0 : code);
+}
+
+
+void memsummary_free(Memsummary_t *ms)
+{
+        if( ms == NULL ) {
+                return;
+        }
+        free(ms->arrays);
+        free(ms->channels);
+        free(ms->mix);
+        free(ms->ranges);
+        free(ms);
+}
+
+
+/**
+ * Computes the memory topology from the Physical Memory Array (16), Memory
+ * Device (17), Memory Array Mapped Address (19) and Memory Device Mapped
+ * Address (20) structures.  The totals only cover arrays used as System
+ * Memory, and devices pointing at an array which is not in the table.
+ *
+ * @param logp  Log buffer for errors
+ * @param snap  Snapshot to summarise, indexed on demand
+ *
+ * @return Returns a summary to be freed with memsummary_free(), or NULL if the
+ *         snapshot holds no table or memory ran out
+ */
+Memsummary_t *memsummary_build(Log_t *logp, Snapshot_t *snap)
+{
+        Memsummary_t *ms = NULL;
+        unsigned int asize = 0, csize = 0, msize = 0, rsize = 0, refsize = 0, nrefs = 0;
+        u16 *refs = NULL, *ptr = NULL;
+        unsigned int i, j;
+
+        if( snapshot_index(snap) < 0 ) {
+                return NULL;
+        }
+        if( (ms = (Memsummary_t *) calloc(1, sizeof(Memsummary_t))) == NULL ) {
+                goto nomem;
+        }
+
+        for( i = 0; i < snap->count; i++ ) {
+                const Snapshot_struct *st = &snap->structs[i];
+                const u8 *data = snap->table + st->offset;
+                Memsummary_array *arr = NULL;
+                Memsummary_channel *chn = NULL;
+                Memsummary_mix *mix = NULL;
+                Memsummary_range *rng = NULL;
+                unsigned long long size;
+
+                switch( st->type ) {
+                case 16:        /* 7.17 Physical Memory Array */
+                        if( st->length < 0x0F ) {
+                                break;
+                        }
+                        if( (arr = memsummary_array(ms, &asize, st->handle)) == NULL ) {
+                                goto nomem;
+                        }
+                        arr->use = data[0x05];
+                        arr->ecc = dmi_memory_array_ec_type_name(data[0x06]);
+                        arr->devices = WORD(data + 0x0D);
+                        if( DWORD(data + 0x07) != 0x80000000UL ) {
+                                arr->maximum = (unsigned long long) DWORD(data + 0x07) << 10;
+                        } else if( st->length >= 0x17 ) {
+                                arr->maximum = summary_qword(data + 0x0F);
+                        }
+                        break;
+
+                case 17:        /* 7.18 Memory Device */
+                        if( st->length < 0x15 ) {
+                                break;
+                        }
+                        arr = memsummary_array(ms, &asize, WORD(data + 0x04));
+                        chn = (arr != NULL ? memsummary_channel(ms, &csize, arr->handle,
+                                                                snapshot_string(snap, st, data[0x11]))
+                               : NULL);
+                        if( chn == NULL ) {
+                                goto nomem;
+                        }
+                        arr->slots++;
+                        chn->slots++;
+                        if( WORD(data + 0x0C) == 0 ) {
+                                break;
+                        }
+                        size = memsummary_device_size(st, data);
+                        arr->populated++;
+                        arr->installed += size;
+                        chn->populated++;
+                        chn->installed += size;
+                        mix = memsummary_mix(ms, &msize, dmi_memory_device_type_name(data[0x12]),
+                                             memsummary_device_speed(st, data));
+                        if( mix == NULL ) {
+                                goto nomem;
+                        }
+                        mix->count++;
+                        break;
+
+                case 19:        /* 7.20 Memory Array Mapped Address */
+                        if( st->length < 0x0F ) {
+                                break;
+                        }
+                        rng = summary_grow(ms->ranges, &rsize, ms->nranges, sizeof(Memsummary_range));
+                        if( rng == NULL ) {
+                                goto nomem;
+                        }
+                        ms->ranges = rng;
+                        rng = &ms->ranges[ms->nranges++];
+                        rng->handle = st->handle;
+                        rng->array = WORD(data + 0x0C);
+                        if( (st->length >= 0x1F) && (DWORD(data + 0x04) == 0xFFFFFFFFUL) ) {
+                                rng->start = summary_qword(data + 0x0F);
+                                rng->end = summary_qword(data + 0x17);
+                        } else {
+                                rng->start = (unsigned long long) DWORD(data + 0x04) << 10;
+                                rng->end = ((unsigned long long) DWORD(data + 0x08) << 10) + 0x3FF;
+                        }
+                        if( rng->end >= rng->start ) {
+                                ms->mapped += rng->end - rng->start + 1;
+                        }
+                        break;
+
+                case 20:        /* 7.21 Memory Device Mapped Address */
+                        if( st->length < 0x13 ) {
+                                break;
+                        }
+                        // The range it belongs to may come later, count them at the end
+                        if( (ptr = summary_grow(refs, &refsize, nrefs, sizeof(u16))) == NULL ) {
+                                goto nomem;
+                        }
+                        refs = ptr;
+                        refs[nrefs++] = WORD(data + 0x0E);
+                        break;
+                }
+        }
+
+        for( i = 0; i < nrefs; i++ ) {
+                for( j = 0; j < ms->nranges; j++ ) {
+                        if( ms->ranges[j].handle == refs[i] ) {
+                                ms->ranges[j].devices++;
+                                break;
+                        }
+                }
+        }
+        free(refs);
+
+        // Arrays only known from their devices have no use set
+        for( i = 0; i < ms->narrays; i++ ) {
+                if( (ms->arrays[i].use == 0x03) || (ms->arrays[i].use == 0) ) {
+                        ms->installed += ms->arrays[i].installed;
+                        ms->maximum += ms->arrays[i].maximum;
+                        ms->slots += ms->arrays[i].slots;
+                        ms->populated += ms->arrays[i].populated;
+                }
+        }
+        return ms;
+
+ nomem:
+        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for the memory summary");
+        free(refs);
+        memsummary_free(ms);
+        return NULL;
+}
+
+
+/**
+ * Installed size of a cache (7.8.4), in bytes.  SMBIOS 3.1 moved sizes of
+ * 2 GB and more to the Installed Cache Size 2 field.
+ */
+static unsigned long long cpusummary_cache_size(const Snapshot_struct *st, const u8 *data)
+{
+        u16 code = WORD(data + 0x09);
+        u32 code2;
+
+        if( (code == 0xFFFF) && (st->length >= 0x1B) ) {
+                code2 = DWORD(data + 0x17);
+                return (unsigned long long) (code2 & 0x7FFFFFFFUL) << (code2 & 0x80000000UL ? 16 : 10);
+        }
+        return (unsigned long long) (code & 0x7FFF) << (code & 0x8000 ? 16 : 10);
+}
+
+
+/**
+ * Core or thread count of a processor (7.5).  SMBIOS 3.0 moved counts above
+ * 255 to a 16-bit field, announced by 0xFF in the old one.
+ */
+unsigned int cpusummary_count(const Snapshot_struct *st, const u8 *data, u8 offset, u8 offset2)
+{
+        if( (data[offset] == 0xFF) && (st->length >= 0x30) ) {
+                return WORD(data + offset2);
+        }
+        return data[offset];
+}
+
+
+void cpusummary_free(Cpusummary_t *cs)
+{
+        if( cs == NULL ) {
+                return;
+        }
+        free(cs->cpus);
+        free(cs);
+}
+
+
+/**
+ * Computes the processor topology from the Processor Information (4) and
+ * Cache Information (7) structures.  Only central processors are listed.
+ * The caches are resolved through the L1, L2 and L3 cache handles of every
+ * processor, which may point at a cache shared with another socket.
+ *
+ * @param logp  Log buffer for errors
+ * @param snap  Snapshot to summarise, indexed on demand
+ *
+ * @return Returns a summary to be freed with cpusummary_free(), or NULL if the
+ *         snapshot holds no table or memory ran out
+ */
+Cpusummary_t *cpusummary_build(Log_t *logp, Snapshot_t *snap)
+{
+        Cpusummary_t *cs = NULL;
+        struct {
+                u16 handle;
+                unsigned long long size;
+        } *caches = NULL, *ptr = NULL;
+        u16 (*cachehandles)[3] = NULL, (*hptr)[3] = NULL;
+        unsigned int psize = 0, csize = 0, hsize = 0, ncaches = 0;
+        unsigned int i, j, k;
+
+        if( snapshot_index(snap) < 0 ) {
+                return NULL;
+        }
+        if( (cs = (Cpusummary_t *) calloc(1, sizeof(Cpusummary_t))) == NULL ) {
+                goto nomem;
+        }
+
+        for( i = 0; i < snap->count; i++ ) {
+                const Snapshot_struct *st = &snap->structs[i];
+                const u8 *data = snap->table + st->offset;
+                Cpusummary_socket *cpu = NULL;
+
+                switch( st->type ) {
+                case 4:         /* 7.5 Processor Information */
+                        // Only Central Processors, not math or DSP processors
+                        if( (st->length < 0x1A) || (data[0x05] != 0x03) ) {
+                                break;
+                        }
+                        if( ((cpu = summary_grow(cs->cpus, &psize, cs->ncpus, sizeof(Cpusummary_socket))) == NULL)
+                            || ((hptr = summary_grow(cachehandles, &hsize, cs->ncpus, sizeof(*hptr))) == NULL) ) {
+                                if( cpu != NULL ) {
+                                        cs->cpus = cpu;
+                                }
+                                goto nomem;
+                        }
+                        cs->cpus = cpu;
+                        cachehandles = hptr;
+                        cpu = &cs->cpus[cs->ncpus];
+                        cpu->handle = st->handle;
+                        summary_string(cpu->socket, sizeof(cpu->socket), snapshot_string(snap, st, data[0x04]));
+                        summary_string(cpu->manufacturer, sizeof(cpu->manufacturer),
+                                       snapshot_string(snap, st, data[0x07]));
+                        summary_string(cpu->version, sizeof(cpu->version), snapshot_string(snap, st, data[0x10]));
+                        cpu->populated = (data[0x18] & (1 << 6) ? 1 : 0);
+                        cpu->max_speed = WORD(data + 0x14);
+                        cpu->current_speed = WORD(data + 0x16);
+                        for( k = 0; k < 3; k++ ) {
+                                cachehandles[cs->ncpus][k] = (st->length >= 0x20 ? WORD(data + 0x1A + 2 * k) : 0xFFFF);
+                        }
+                        if( st->length >= 0x28 ) {
+                                cpu->cores = cpusummary_count(st, data, 0x23, 0x2A);
+                                cpu->cores_enabled = cpusummary_count(st, data, 0x24, 0x2C);
+                                cpu->threads = cpusummary_count(st, data, 0x25, 0x2E);
+                        }
+
+                        cs->sockets++;
+                        if( cpu->populated ) {
+                                cs->populated++;
+                                cs->cores += cpu->cores;
+                                cs->threads += cpu->threads;
+                        }
+                        cs->ncpus++;
+                        break;
+
+                case 7:         /* 7.8 Cache Information */
+                        if( st->length < 0x0F ) {
+                                break;
+                        }
+                        // The processors pointing at it may come earlier, resolve them at the end
+                        if( (ptr = summary_grow(caches, &csize, ncaches, sizeof(*caches))) == NULL ) {
+                                goto nomem;
+                        }
+                        caches = ptr;
+                        caches[ncaches].handle = st->handle;
+                        caches[ncaches++].size = cpusummary_cache_size(st, data);
+                        break;
+                }
+        }
+
+        for( i = 0; i < cs->ncpus; i++ ) {
+                for( k = 0; k < 3; k++ ) {
+                        for( j = 0; j < ncaches; j++ ) {
+                                if( caches[j].handle == cachehandles[i][k] ) {
+                                        cs->cpus[i].cache[k] = caches[j].size;
+                                        break;
+                                }
+                        }
+                }
+        }
+        free(caches);
+        free(cachehandles);
+        return cs;
+
+ nomem:
+        log_append(logp, LOGFL_NORMAL, LOG_WARNING, "Could not allocate memory for the processor summary");
+        free(caches);
+        free(cachehandles);
+        cpusummary_free(cs);
+        return NULL;
+}
@@ -0,0 +1,139 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+
+/**
+ *  @file dmisummary.h
+ *  @brief Aggregated views computed straight from the raw DMI table
+ */
+
+#ifndef DMISUMMARY_H
+#define DMISUMMARY_H
+
+#include "types.h"
+#include "dmilog.h"
+#include "dmisnapshot.h"
+
+/**
+ *  One Physical Memory Array (type 16) and the devices (type 17) in it
+ */
+typedef struct {
+        u16 handle;
+        u8 use;                         /**< Raw Use code, 0x03 is System Memory */
+        const char *ecc;                /**< Error correction type, NULL if out of spec */
+        unsigned long long maximum;     /**< Maximum capacity in bytes, 0 if unknown */
+        unsigned int devices;           /**< Number of devices announced by the array */
+        unsigned int slots;             /**< Number of type 17 structures found for it */
+        unsigned int populated;
+        unsigned long long installed;   /**< Bytes installed in the populated devices */
+} Memsummary_array;
+
+/**
+ *  Devices of one array sharing a channel, as told by their Bank Locator
+ */
+typedef struct {
+        u16 array;
+        char name[64];                  /**< Bank Locator without the DIMM part, empty if unknown */
+        unsigned int slots;
+        unsigned int populated;
+        unsigned long long installed;
+} Memsummary_channel;
+
+/**
+ *  Number of populated devices of one memory type and speed
+ */
+typedef struct {
+        const char *type;               /**< Memory type, NULL if out of spec */
+        unsigned int speed;             /**< Speed in MT/s, 0 if unknown */
+        unsigned int count;
+} Memsummary_mix;
+
+/**
+ *  One Memory Array Mapped Address (type 19)
+ */
+typedef struct {
+        u16 handle;
+        u16 array;
+        unsigned long long start;       /**< First byte of the range */
+        unsigned long long end;         /**< Last byte of the range */
+        unsigned int devices;           /**< Number of type 20 structures mapped into it */
+} Memsummary_range;
+
+/**
+ *  Memory topology of a DMI table
+ */
+typedef struct {
+        unsigned long long installed;   /**< Bytes installed in all arrays */
+        unsigned long long maximum;     /**< Maximum capacity of the system memory arrays */
+        unsigned long long mapped;      /**< Bytes covered by the mapped address ranges */
+        unsigned int slots;
+        unsigned int populated;
+        Memsummary_array *arrays;
+        unsigned int narrays;
+        Memsummary_channel *channels;
+        unsigned int nchannels;
+        Memsummary_mix *mix;
+        unsigned int nmix;
+        Memsummary_range *ranges;
+        unsigned int nranges;
+} Memsummary_t;
+
+/**
+ *  One processor socket (type 4) and the caches (type 7) it points at
+ */
+typedef struct {
+        u16 handle;
+        char socket[64];                /**< Socket Designation */
+        char manufacturer[64];
+        char version[64];
+        int populated;                  /**< Set to 1 if the socket holds a processor */
+        unsigned int cores;             /**< Core count, 0 if unknown */
+        unsigned int cores_enabled;
+        unsigned int threads;
+        unsigned int max_speed;         /**< Speed in MHz, 0 if unknown */
+        unsigned int current_speed;
+        unsigned long long cache[3];    /**< Installed L1, L2 and L3 sizes in bytes, 0 if none */
+} Cpusummary_socket;
+
+/**
+ *  Processor and cache topology of a DMI table
+ */
+typedef struct {
+        unsigned int sockets;           /**< Central processor sockets */
+        unsigned int populated;
+        unsigned int cores;             /**< Cores and threads of all populated sockets */
+        unsigned int threads;
+        Cpusummary_socket *cpus;
+        unsigned int ncpus;
+} Cpusummary_t;
+
+unsigned long long memsummary_device_size(const Snapshot_struct *st, const u8 *data);
+unsigned int memsummary_device_speed(const Snapshot_struct *st, const u8 *data);
+unsigned int cpusummary_count(const Snapshot_struct *st, const u8 *data, u8 offset, u8 offset2);
+Memsummary_t *memsummary_build(Log_t *logp, Snapshot_t *snap);
+void memsummary_free(Memsummary_t *ms);
+Cpusummary_t *cpusummary_build(Log_t *logp, Snapshot_t *snap);
+void cpusummary_free(Cpusummary_t *cs);
+
+#endif
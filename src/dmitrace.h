@@ -0,0 +1,67 @@
+/*
+ *   This file is part of python-dmidecode.
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ *   For the avoidance of doubt the "preferred form" of this code is one which
+ *   is in an open unpatent encumbered format. Where cryptographic key signing
+ *   forms part of the process of creating an executable the information
+ *   including keys needed to generate an equivalently functional executable
+ *   are deemed to be part of the source code.
+ */
+
+/**
+ *  @file dmitrace.h
+ *  @brief Static tracepoints (USDT) for bpftrace, perf and SystemTap
+ *
+ *  The probes are only compiled in when <sys/sdt.h> is available and
+ *  HAVE_SYS_SDT_H is defined, which setup.py does unless DMIDECODE_NO_SDT
+ *  is set in the environment.  Otherwise the macros expand to nothing.
+ *  An unused probe is a single nop instruction.
+ *
+ *  Provider "dmidecode", probes:
+ *
+ *    mem__chunk__entry     (u64 base, u64 length)
+ *    mem__chunk__return    (u64 base, u64 length, int success)
+ *    table__entry          (int type, u32 length, u16 structures)
+ *    table__return         (int type, int walked)
+ *    struct__entry         (u8 type, u16 handle, u8 length)
+ *    struct__return        (u8 type, u16 handle, u8 length)
+ *    pythonize__entry      (char *section, int type)
+ *    pythonize__return     (char *section, int type, int success)
+ *    log__append           (int level, char *message)
+ *
+ *  section is NULL when a single type is queried, and type is -1 when a
+ *  section is queried.  For example:
+ *
+ *    bpftrace -e 'usdt:./dmidecodemod.so:dmidecode:struct__entry { @t[arg1] = nsecs; }
+ *                 usdt:./dmidecodemod.so:dmidecode:struct__return /@t[arg1]/ {
+ *                         @ns[arg0] = hist(nsecs - @t[arg1]); delete(@t[arg1]); }'
+ */
+
+#ifndef DMITRACE_H
+#define DMITRACE_H
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define DMITRACE2(probe, a, b) DTRACE_PROBE2(dmidecode, probe, a, b)
+#define DMITRACE3(probe, a, b, c) DTRACE_PROBE3(dmidecode, probe, a, b, c)
+#else
+#define DMITRACE2(probe, a, b)
+#define DMITRACE3(probe, a, b, c)
+#endif
+
+#endif
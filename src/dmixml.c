@@ -33,9 +33,11 @@
 
 
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <stdint.h>
 
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
@@ -44,6 +46,7 @@
 #include "dmidecode.h"
 #include "dmilog.h"
 #include "dmixml.h"
+#include "dmistats.h"
 
 /**
  * Internal function for dmixml_* functions.  The function will allocate a buffer and populate it
@@ -77,6 +80,84 @@ xmlChar *dmixml_buildstr(size_t len, const char *fmt, va_list ap) {
         return ret;
 }
 
+/**
+ * Tells whether a format string prints a single integer and nothing else, in decimal
+ * or in hexadecimal behind a 0x prefix
+ * @param  const char*  The format string given to one of the dmixml_Add*() functions
+ * @return int          The argument type of the integer, or 0 for any other format
+ */
+static int dmixml_rawformat(const char *fmt) {
+        if( strncmp(fmt, "0x%", 3) == 0 ) {
+                // Hexadecimal handles, codes and addresses: "0x%x", "0x%04x", "0x%08X"
+                fmt += 3;
+                if( *fmt == '0' ) {
+                        fmt++;
+                }
+                while( (*fmt >= '1') && (*fmt <= '9') ) {
+                        fmt++;
+                }
+                return ((strcmp(fmt, "x") == 0) || (strcmp(fmt, "X") == 0) ? 'u' : 0);
+        } else if( (strcmp(fmt, "%i") == 0) || (strcmp(fmt, "%d") == 0) ) {
+                return 'i';
+        } else if( strcmp(fmt, "%u") == 0 ) {
+                return 'u';
+        } else if( strcmp(fmt, "%ld") == 0 ) {
+                return 'l';
+        } else if( strcmp(fmt, "%lu") == 0 ) {
+                return 'L';
+        }
+        return 0;
+}
+
+/**
+ * Attaches the integer printed into a text node to the node itself, so that
+ * dmixml_GetRawValue() can return it without parsing the text again.  The value
+ * is read with the same type vsnprintf() used for it, and stored shifted above
+ * the tag in _private.  A value which does not fit there is not attached, its
+ * text is parsed instead.
+ * @param  xmlNode*     The text node holding the formatted value
+ * @param  int          Argument type, as returned by dmixml_rawformat()
+ * @param  va_list      Argument list of the dmixml_Add*() call
+ */
+static void dmixml_setraw(xmlNode *text, int rawfmt, va_list ap) {
+        long sval = 0;
+        unsigned long uval = 0;
+
+        if( (text == NULL) || (text->type != XML_TEXT_NODE) ) {
+                return;
+        }
+
+        switch( rawfmt ) {
+        case 'i':
+                sval = va_arg(ap, int);
+                break;
+        case 'u':
+                uval = va_arg(ap, unsigned int);
+                break;
+        case 'l':
+                sval = va_arg(ap, long);
+                break;
+        case 'L':
+                uval = va_arg(ap, unsigned long);
+                break;
+        default:
+                return;
+        }
+
+        if( (rawfmt == 'i') || (rawfmt == 'l') ) {
+                if( (sval < INTPTR_MIN / 4) || (sval > INTPTR_MAX / 4) ) {
+                        return;
+                }
+                text->_private = (void *) ((uintptr_t) ((intptr_t) sval * 4) | DMIXML_RAW_SIGNED);
+        } else {
+                if( uval > (UINTPTR_MAX >> 2) ) {
+                        return;
+                }
+                text->_private = (void *) (((uintptr_t) uval << 2) | DMIXML_RAW_UNSIGNED);
+        }
+}
+
+
 
 /**
  * Add an XML property/attribute to the given XML node
@@ -92,6 +173,7 @@ xmlAttr *dmixml_AddAttribute(xmlNode *node, const char *atrname, const char *fmt
         xmlChar *val_s = NULL, *atrname_s = NULL;
         xmlAttr *res = NULL;
         va_list ap;
+        int rawfmt;
 
         if( (node == NULL) || (atrname == NULL) ) {
                 return NULL;
@@ -111,6 +193,11 @@ xmlAttr *dmixml_AddAttribute(xmlNode *node, const char *atrname, const char *fmt
 
         res = xmlNewProp(node, atrname_s,
                          (xmlStrcmp(val_s, (xmlChar *) "(null)") == 0 ? NULL : val_s));
+        if( (res != NULL) && ((rawfmt = dmixml_rawformat(fmt)) != 0) ) {
+                va_start(ap, fmt);
+                dmixml_setraw(res->children, rawfmt, ap);
+                va_end(ap);
+        }
 
         free(val_s);
  exit:
@@ -135,6 +222,7 @@ xmlNode *dmixml_AddTextChild(xmlNode *node, const char *tagname, const char *fmt
         xmlChar *val_s = NULL, *tagname_s = NULL;
         xmlNode *res = NULL;
         va_list ap;
+        int rawfmt;
 
         if( (node == NULL) || (tagname == NULL) ) {
                 return NULL;
@@ -155,6 +243,11 @@ xmlNode *dmixml_AddTextChild(xmlNode *node, const char *tagname, const char *fmt
         // Do not add any contents if the string contents is "(null)"
         res = xmlNewTextChild(node, NULL, tagname_s,
                               (xmlStrcmp(val_s, (xmlChar *) "(null)") == 0 ? NULL : val_s));
+        if( (res != NULL) && ((rawfmt = dmixml_rawformat(fmt)) != 0) ) {
+                va_start(ap, fmt);
+                dmixml_setraw(res->children, rawfmt, ap);
+                va_end(ap);
+        }
 
         free(val_s);
  exit:
@@ -240,7 +333,20 @@ xmlNode *dmixml_AddTextContent(xmlNode *node, const char *fmt, ...)
         va_end(ap);
 
         if( xmlStrcmp(val_s, (xmlChar *) "(null)") != 0 ) {
-                res = xmlAddChild(node, xmlNewText(val_s));
+                xmlNode *text = xmlNewText(val_s);
+                int rawfmt;
+
+                assert( text != NULL );
+                if( (node->children == NULL) && ((rawfmt = dmixml_rawformat(fmt)) != 0) ) {
+                        va_start(ap, fmt);
+                        dmixml_setraw(text, rawfmt, ap);
+                        va_end(ap);
+                }
+                res = xmlAddChild(node, text);
+                if( (res != NULL) && (res != text) ) {
+                        // Merged into an existing text node, which no longer holds a single number
+                        res->_private = NULL;
+                }
         } else {
                 res = node;
         }
@@ -381,6 +487,126 @@ inline char *dmixml_GetNodeContent(xmlNode *node, const char *key) {
         return dmixml_GetContent(dmixml_FindNode(node, key));
 }
 
+/**
+ * Retrieve the integer the decoder formatted into a node.  This is only set when the
+ * text was built by one of the dmixml_Add*() functions from a lone "%i", "%d", "%u",
+ * "%ld" or "%lu" format, or a "0x%x" format with an optional width.
+ * @param  xmlNode*     Text node, or the element or attribute holding it
+ * @param  long*        Receives the value.  Unsigned values are returned in the same bits.
+ * @return int          DMIXML_RAW_SIGNED or DMIXML_RAW_UNSIGNED if a value was found,
+ *                      otherwise 0 and the node text has to be parsed
+ */
+int dmixml_GetRawValue(xmlNode *node, long *value) {
+        int rawtype;
+
+        if( (node != NULL) && (node->type != XML_TEXT_NODE) ) {
+                // Same text node as dmixml_GetContent() returns
+                node = node->children;
+        }
+        if( (node == NULL) || (node->type != XML_TEXT_NODE) ) {
+                return 0;
+        }
+        rawtype = (uintptr_t) node->_private & DMIXML_RAW_MASK;
+        if( rawtype == DMIXML_RAW_SIGNED ) {
+                // The low bits are clear, so the division is exact for negative values too
+                *value = (long) ((intptr_t) ((uintptr_t) node->_private & ~(uintptr_t) DMIXML_RAW_MASK) / 4);
+        } else if( rawtype == DMIXML_RAW_UNSIGNED ) {
+                *value = (long) ((uintptr_t) node->_private >> 2);
+        } else {
+                return 0;
+        }
+        return rawtype;
+}
+
+/**
+ * Parses an integer from node text the way the decoder prints it: decimal, with a sign
+ * if negative, or hexadecimal behind a 0x prefix.  This is the text counterpart of
+ * dmixml_GetRawValue(), and gives the same value for the same node.  Like atoi(), text
+ * which does not start with a number gives 0.
+ * @param  const char*  The text
+ * @param  long*        Receives the value.  Unsigned values are returned in the same bits.
+ * @return int          DMIXML_RAW_SIGNED or DMIXML_RAW_UNSIGNED
+ */
+int dmixml_ParseRawValue(const char *str, long *value) {
+        while( *str == ' ' ) {
+                str++;
+        }
+        if( (str[0] == '0') && ((str[1] == 'x') || (str[1] == 'X')) ) {
+                *value = (long) strtoul(str, NULL, 16);
+                return DMIXML_RAW_UNSIGNED;
+        } else if( str[0] == '-' ) {
+                *value = strtol(str, NULL, 10);
+                return DMIXML_RAW_SIGNED;
+        }
+        *value = (long) strtoul(str, NULL, 10);
+        return DMIXML_RAW_UNSIGNED;
+}
+
+/**
+ * Retrieve the integer behind one element of an XPath node set, see dmixml_GetRawValue()
+ * @param  xmlXPathObject*  Pointer to the XPath object containing the data
+ * @param  int              Which of the node set elements to look at
+ * @param  long*            Receives the value
+ * @return int              DMIXML_RAW_SIGNED or DMIXML_RAW_UNSIGNED if a value was found,
+ *                          otherwise 0
+ */
+int dmixml_GetXPathRawValue(xmlXPathObject *xpo, int idx, long *value) {
+        if( (xpo == NULL) || (xpo->type != XPATH_NODESET) || (xpo->nodesetval == NULL)
+            || (xpo->nodesetval->nodeNr < (idx+1)) ) {
+                return 0;
+        }
+        return dmixml_GetRawValue(xpo->nodesetval->nodeTab[idx], value);
+}
+
+/**
+ * Carries the integers attached by dmixml_setraw() over from a node chain to its copy
+ * @param xmlNode*  First node of the original chain
+ * @param xmlNode*  First node of the copy
+ */
+static void dmixml_copyraw(xmlNode *from, xmlNode *to) {
+        xmlAttr *from_a = NULL, *to_a = NULL;
+
+        for( ; (from != NULL) && (to != NULL); from = from->next, to = to->next ) {
+                if( from->type == XML_TEXT_NODE ) {
+                        // Only when the copy still holds the same text, it may have been merged
+                        if( (((uintptr_t) from->_private & DMIXML_RAW_MASK) != 0)
+                            && (to->type == XML_TEXT_NODE) && xmlStrEqual(from->content, to->content) ) {
+                                to->_private = from->_private;
+                        }
+                        continue;
+                }
+                if( (from->type != XML_ELEMENT_NODE) || (to->type != XML_ELEMENT_NODE) ) {
+                        continue;
+                }
+                for( from_a = from->properties, to_a = to->properties;
+                     (from_a != NULL) && (to_a != NULL); from_a = from_a->next, to_a = to_a->next ) {
+                        dmixml_copyraw(from_a->children, to_a->children);
+                }
+                dmixml_copyraw(from->children, to->children);
+        }
+}
+
+/**
+ * A variant of xmlCopyNode() doing a recursive copy, which keeps the integers
+ * dmixml_GetRawValue() returns for the original nodes
+ * @param xmlNode*  The node to copy
+ * @return xmlNode* The new node, or NULL on errors
+ */
+xmlNode *dmixml_CopyNode(xmlNode *node) {
+        xmlNode *copy = xmlCopyNode(node, 1);
+
+        if( (copy != NULL) && (node->type == XML_ELEMENT_NODE) ) {
+                xmlAttr *from_a = NULL, *to_a = NULL;
+
+                for( from_a = node->properties, to_a = copy->properties;
+                     (from_a != NULL) && (to_a != NULL); from_a = from_a->next, to_a = to_a->next ) {
+                        dmixml_copyraw(from_a->children, to_a->children);
+                }
+                dmixml_copyraw(node->children, copy->children);
+        }
+        return copy;
+}
+
 /**
  * Retrieve the contents from an XPath object.
  * @author David Sommerseth <davids@redhat.com>
@@ -426,3 +652,25 @@ char *dmixml_GetXPathContent(Log_t *logp, char *buf, size_t buflen, xmlXPathObje
         }
         return buf;
 }
+
+
+/**
+ * Adds the elements and attributes of a node chain and all their children to the XML
+ * counters in dmi_stats.
+ * @param xmlNode*  First node of the chain, siblings following it are counted as well
+ */
+void dmixml_CountNodes(xmlNode *node)
+{
+        xmlAttr *attr = NULL;
+
+        for( ; node != NULL; node = node->next ) {
+                if( node->type != XML_ELEMENT_NODE ) {
+                        continue;
+                }
+                stats_add(xml_nodes, 1);
+                for( attr = node->properties; attr != NULL; attr = attr->next ) {
+                        stats_add(xml_attributes, 1);
+                }
+                dmixml_CountNodes(node->children);
+        }
+}
@@ -32,6 +32,13 @@
 
 #define foreach_xmlnode(n, itn) for( itn = n; itn != NULL; itn = itn->next )
 
+// Tags in the low bits of xmlNode->_private of text nodes carrying the integer they
+// were formatted from, the value is kept in the bits above.  xmlNode->extra belongs
+// to libxml2.
+#define DMIXML_RAW_SIGNED   1
+#define DMIXML_RAW_UNSIGNED 2
+#define DMIXML_RAW_MASK     3
+
 struct dmi_header;
 
 xmlAttr *dmixml_AddAttribute(xmlNode *node, const char *atrname, const char *fmt, ...);
@@ -78,5 +85,10 @@ xmlNode *dmixml_FindNode(xmlNode *, const char *key);
 inline char *dmixml_GetContent(xmlNode *node);
 inline char *dmixml_GetNodeContent(xmlNode *node, const char *key);
 char *dmixml_GetXPathContent(Log_t *logp, char *buf, size_t buflen, xmlXPathObject *xpo, int idx);
+int dmixml_GetRawValue(xmlNode *node, long *value);
+int dmixml_ParseRawValue(const char *str, long *value);
+int dmixml_GetXPathRawValue(xmlXPathObject *xpo, int idx, long *value);
+xmlNode *dmixml_CopyNode(xmlNode *node);
+void dmixml_CountNodes(xmlNode *node);
 
 #endif
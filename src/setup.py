@@ -70,7 +70,16 @@ setup(
         "src/dmilog.c",
         "src/xmlpythonizer.c",
         "src/efi.c",
-        "src/dmidump.c"
+        "src/dmidump.c",
+        "src/dmisnapshot.c",
+        "src/dmidiff.c",
+        "src/dmistats.c",
+        "src/dmisink.c",
+        "src/dmistream.c",
+        "src/dmisummary.c",
+        "src/dmisel.c",
+        "src/dmiarchive.c",
+        "src/dmicolumns.c"
       ],
       include_dirs = incdir,
       library_dirs = libdir,
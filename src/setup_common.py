@@ -26,7 +26,7 @@
 #   are deemed to be part of the source code.
 #
 
-import subprocess, sys
+import subprocess, sys, os
 if sys.version_info[0] < 3:
     import commands as subprocess
 from os import path as os_path
@@ -99,5 +99,12 @@ def get_macros():
     macros = []
     if sys.byteorder == 'big':
         macros.append(("ALIGNMENT_WORKAROUND", None))
+
+    # USDT probes, see src/dmitrace.h
+    if not os.environ.get("DMIDECODE_NO_SDT"):
+        for incdir in ("/usr/include", "/usr/local/include"):
+            if os_path.exists(os_path.join(incdir, "sys", "sdt.h")):
+                macros.append(("HAVE_SYS_SDT_H", None))
+                break
     return macros
 
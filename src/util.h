@@ -27,6 +27,7 @@
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof((x)[0]))
 
 int checksum(const u8 * buf, size_t len);
+u32 crc32c(u32 crc, const void *buf, size_t len);
 void *mem_chunk(Log_t *logp, size_t base, size_t len, const char *devmem);
-int write_dump(size_t base, size_t len, const void *data, const char *dumpfile, int add);
+void *read_file(Log_t *logp, size_t *max_len, const char *filename);
 u64 u64_range(u64 start, u64 end);
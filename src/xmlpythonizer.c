@@ -75,6 +75,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 
 #include <libxml/tree.h>
 #include <libxml/xpath.h>
@@ -83,6 +85,7 @@
 #include "dmixml.h"
 #include "dmierror.h"
 #include "dmilog.h"
+#include "dmistats.h"
 #include "xmlpythonizer.h"
 #include "version.h"
 #include "compat.h"
@@ -179,6 +182,129 @@ void ptzmap_SetFixedList(ptzMAP *map_p, const char *index, int size)
 }
 
 
+/**
+ * Switches all map entries with a unitvalue attribute to canonical units.  The value of
+ * these entries becomes an integer in the canonical unit of its kind, see ptzUNITS.
+ * @param ptzMAP*  The parsed mapping to update, including its children
+ */
+void ptzmap_SetCanonicalUnits(ptzMAP *map_p)
+{
+        for( ; map_p != NULL; map_p = map_p->next ) {
+                if( map_p->child != NULL ) {
+                        ptzmap_SetCanonicalUnits(map_p->child);
+                }
+                if( map_p->unitvalue == NULL ) {
+                        continue;
+                }
+
+                free(map_p->value);
+                map_p->value = strdup(map_p->unitvalue);
+                assert( map_p->value != NULL );
+                switch( map_p->type_value ) {
+                case ptzLIST_STR:
+                case ptzLIST_INT:
+                case ptzLIST_FLOAT:
+                case ptzLIST_BOOL:
+                        map_p->type_value = ptzLIST_INT;
+                        break;
+                default:
+                        map_p->type_value = ptzINT;
+                        break;
+                }
+                // Values without a number become None
+                map_p->emptyIsNone = 0;
+                if( map_p->emptyValue != NULL ) {
+                        free(map_p->emptyValue);
+                        map_p->emptyValue = NULL;
+                }
+                map_p->canonical = 1;
+        }
+}
+
+
+/**
+ * Canonical units of the values the decoder puts out with a unit attribute.  Sizes
+ * are in bytes, frequencies in Hz, voltages in mV, currents in mA, power in mW,
+ * energy in mWh, widths in bits and times in ns.
+ */
+static const struct {
+        const char *unit;
+        double factor;
+} ptzUNITS[] = {
+        {"bytes", 1.0},
+        {"bit",   1.0},
+        {"kB",    1024.0},
+        {"KB",    1024.0},
+        {"MB",    1048576.0},
+        {"GB",    1073741824.0},
+        {"TB",    1099511627776.0},
+        {"PB",    1125899906842624.0},
+        {"Hz",    1.0},
+        {"kHz",   1e3},
+        {"MHz",   1e6},
+        {"GHz",   1e9},
+        {"mV",    1.0},
+        {"V",     1e3},
+        {"mA",    1.0},
+        {"A",     1e3},
+        {"mW",    1.0},
+        {"W",     1e3},
+        {"mWh",   1.0},
+        {"Wh",    1e3},
+        {"ns",    1.0},
+        {NULL,    0.0}
+};
+
+
+/**
+ * Converts one value of an XPath result to the canonical unit of its kind.  The node
+ * must hold a plain number and the unit in its unit attribute.
+ * @param xmlXPathObject*  XPath object containing the nodes
+ * @param int              Which of the nodes to convert
+ * @param long*            Receives the value in canonical units
+ * @return int             1 on success, 0 if the node has no number or an unknown unit
+ */
+int ptzmap_CanonicalValue(xmlXPathObject *xpo, int idx, long *value)
+{
+        xmlNode *node = NULL;
+        const char *unit = NULL, *text = NULL;
+        char *end = NULL;
+        double number;
+        int i;
+
+        if( (xpo == NULL) || (xpo->type != XPATH_NODESET) || (xpo->nodesetval == NULL)
+            || (xpo->nodesetval->nodeNr < (idx+1)) ) {
+                return 0;
+        }
+        node = xpo->nodesetval->nodeTab[idx];
+
+        if( (text = dmixml_GetContent(node)) == NULL ) {
+                return 0;
+        }
+        errno = 0;
+        number = strtod(text, &end);
+        if( (end == text) || (*end != '\0') || (errno != 0) ) {
+                return 0;
+        }
+
+        if( (node->type != XML_ELEMENT_NODE) || ((unit = dmixml_GetAttrValue(node, "unit")) == NULL) ) {
+                return 0;
+        }
+        for( i = 0; ptzUNITS[i].unit != NULL; i++ ) {
+                if( strcmp(ptzUNITS[i].unit, unit) == 0 ) {
+                        number *= ptzUNITS[i].factor;
+                        // Do not wrap around on values too big for the result
+                        if( (number >= (double) LONG_MAX) || (number <= (double) LONG_MIN) ) {
+                                return 0;
+                        }
+                        *value = (long) (number < 0 ? number - 0.5 : number + 0.5);
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+
 /**
  * This functions frees up a complete pointer chain.  This is normally called via #define ptzmap_Free()
  * @author David Sommerseth <davids@redhat.com>
@@ -205,6 +331,11 @@ void ptzmap_Free_func(ptzMAP *ptr)
                 ptr->emptyValue = NULL;
         }
 
+        if( ptr->unitvalue != NULL ) {
+                free(ptr->unitvalue);
+                ptr->unitvalue = NULL;
+        }
+
         free(ptr->key);
         ptr->key = NULL;
 
@@ -405,6 +536,9 @@ ptzMAP *_do_dmimap_parsing_typeid(Log_t *logp, xmlNode *node) {
                         if( (tmpstr = dmixml_GetAttrValue(ptr_n, "emptyValue")) != NULL ) {
                                 retmap->emptyValue = strdup(tmpstr);
                         }
+                        if( (tmpstr = dmixml_GetAttrValue(ptr_n, "unitvalue")) != NULL ) {
+                                retmap->unitvalue = strdup(tmpstr);
+                        }
                 }
 
                 if( (retmap != NULL) && (listidx != NULL) && (fixedsize > 0) ) {
@@ -597,18 +731,16 @@ ptzMAP *dmiMAP_ParseMappingXML_GroupName(Log_t *logp, xmlDoc *xmlmap, const char
 
 
 /**
- * Internal function for converting a given mapped value to the appropriate Python data type
- * @author David Sommerseth <davids@redhat.com>
+ * Applies the emptyIsNone and emptyValue settings of a mapping entry to a value
  * @param ptzMAP*      Pointer to the current mapping entry being parsed
- * @param const char * String which contains the value to be converted to a Python value
- * @return PyObject *  The converted value as a Python object
+ * @param const char * String which contains the value to be converted
+ * @return const char* The string to convert, or NULL if the value is None
  */
-inline PyObject *StringToPyObj(Log_t *logp, ptzMAP *val_m, const char *instr) {
-        PyObject *value;
+const char *ptzmap_GetValue(ptzMAP *val_m, const char *instr) {
         const char *workstr = NULL;
 
         if( instr == NULL ) {
-                return Py_None;
+                return NULL;
         }
 
         if( (val_m->emptyIsNone == 1) || (val_m->emptyValue != NULL) ) {
@@ -629,7 +761,7 @@ inline PyObject *StringToPyObj(Log_t *logp, ptzMAP *val_m, const char *instr) {
                 if( cp_p <= cp ) {
                         free(cp);
                         if( val_m->emptyIsNone == 1 ) {
-                                return Py_None;
+                                return NULL;
                         }
                         if( val_m->emptyValue != NULL ) {
                                 workstr = (const char *)val_m->emptyValue;
@@ -639,25 +771,70 @@ inline PyObject *StringToPyObj(Log_t *logp, ptzMAP *val_m, const char *instr) {
                 }
         }
 
-        if( workstr == NULL ) {
-                workstr = instr;
-        }
+        return (workstr != NULL ? workstr : instr);
+}
 
 
+/**
+ * Converts an integer from the decoder to the Python type of a mapping entry
+ * @param ptzMAP*      Mapping entry of the value
+ * @param int          DMIXML_RAW_SIGNED or DMIXML_RAW_UNSIGNED
+ * @param long         The value, unsigned values are held in the same bits
+ * @return PyObject*   The new Python object, or NULL if the entry is not numeric
+ */
+static PyObject *RawToPyObj(ptzMAP *val_m, int rawtype, long raw) {
         switch( val_m->type_value ) {
         case ptzINT:
         case ptzLIST_INT:
-                value = PYNUMBER_FROMLONG(atoi(workstr));
-                break;
+                return (rawtype == DMIXML_RAW_UNSIGNED
+                        ? PyLong_FromUnsignedLong((unsigned long) raw) : PYNUMBER_FROMLONG(raw));
 
         case ptzFLOAT:
         case ptzLIST_FLOAT:
-                value = PyFloat_FromDouble(atof(workstr));
-                break;
+                return PyFloat_FromDouble(rawtype == DMIXML_RAW_UNSIGNED
+                                          ? (double) (unsigned long) raw : (double) raw);
+
+        case ptzBOOL:
+        case ptzLIST_BOOL:
+                return PyBool_FromLong((raw == 1 ? 1 : 0));
+
+        default:
+                // Strings keep the formatting of the decoder
+                return NULL;
+        }
+}
+
+
+/**
+ * Internal function for converting a given mapped value to the appropriate Python data type
+ * @author David Sommerseth <davids@redhat.com>
+ * @param ptzMAP*      Pointer to the current mapping entry being parsed
+ * @param const char * String which contains the value to be converted to a Python value
+ * @return PyObject *  The converted value as a Python object
+ */
+static inline PyObject *StringToPyObj(Log_t *logp, ptzMAP *val_m, const char *instr) {
+        PyObject *value;
+        const char *workstr = NULL;
+        long raw = 0;
+        int rawtype;
+
+        if( (workstr = ptzmap_GetValue(val_m, instr)) == NULL ) {
+                return Py_None;
+        }
 
+        switch( val_m->type_value ) {
+        case ptzINT:
+        case ptzLIST_INT:
         case ptzBOOL:
         case ptzLIST_BOOL:
-                value = PyBool_FromLong((atoi(workstr) == 1 ? 1:0));
+                // Parsed to the same value the decoder attaches, see XPathToPyObj()
+                rawtype = dmixml_ParseRawValue(workstr, &raw);
+                value = RawToPyObj(val_m, rawtype, raw);
+                break;
+
+        case ptzFLOAT:
+        case ptzLIST_FLOAT:
+                value = PyFloat_FromDouble(atof(workstr));
                 break;
 
         case ptzSTR:
@@ -671,10 +848,51 @@ inline PyObject *StringToPyObj(Log_t *logp, ptzMAP *val_m, const char *instr) {
 			   val_m->type_value, instr);
                 value = Py_None;
         }
+        if( value != Py_None ) {
+                stats_add(py_objects, 1);
+        }
         return value;
 }
 
 
+/**
+ * Converts one value of an XPath result to a Python object.  Integers the decoder
+ * attached to the XML node are used directly, other values are parsed from the
+ * node text by StringToPyObj().
+ * @param Log_t*           Log context
+ * @param ptzMAP*          Mapping entry of the value, which defines the Python type
+ * @param xmlXPathObject*  XPath object containing the data value(s)
+ * @param int              Which of the values in the XPath object to convert
+ * @param char*            Work buffer for the node text
+ * @param size_t           Size of the work buffer
+ * @return PyObject*       The new Python object, or Py_None
+ */
+static PyObject *XPathToPyObj(Log_t *logp, ptzMAP *val_m, xmlXPathObject *xpo, int idx, char *buf, size_t buflen) {
+        PyObject *value = NULL;
+        long raw = 0;
+        int rawtype;
+
+        if( val_m->canonical ) {
+                if( ptzmap_CanonicalValue(xpo, idx, &raw) == 0 ) {
+                        return Py_None;
+                }
+                stats_add(py_objects, 1);
+                return PYNUMBER_FROMLONG(raw);
+        }
+
+        // emptyIsNone and emptyValue are rules on the text, leave those values to StringToPyObj()
+        if( (val_m->emptyIsNone == 0) && (val_m->emptyValue == NULL)
+            && ((rawtype = dmixml_GetXPathRawValue(xpo, idx, &raw)) != 0) ) {
+                if( (value = RawToPyObj(val_m, rawtype, raw)) != NULL ) {
+                        stats_add(py_objects, 1);
+                        return value;
+                }
+        }
+        dmixml_GetXPathContent(logp, buf, buflen, xpo, idx);
+        return StringToPyObj(logp, val_m, buf);
+}
+
+
 /**
  * Retrieves a value from the data XML doc (via XPath Context) based on a XPath query
  * @author David Sommerseth <davids@redhat.com>
@@ -686,15 +904,19 @@ inline PyObject *StringToPyObj(Log_t *logp, ptzMAP *val_m, const char *instr) {
 xmlXPathObject *_get_xpath_values(xmlXPathContext *xpctx, const char *xpath) {
         xmlChar *xp_xpr = NULL;
         xmlXPathObject *xp_obj = NULL;
+        unsigned long long start;
 
         if( xpath == NULL ) {
                 return NULL;
         }
 
+        start = stats_now();
         xp_xpr = xmlCharStrdup(xpath);
         xp_obj = xmlXPathEvalExpression(xp_xpr, xpctx);
         assert( xp_obj != NULL );
         free(xp_xpr);
+        stats_add(xpath_evals, 1);
+        stats_phase_end(STATS_PHASE_XPATH, start);
 
         return xp_obj;
 }
@@ -772,7 +994,7 @@ char *_get_key_value(Log_t *logp, char *key, size_t buflen,
  * @param ptzMAP*           Pointer to the current mapping entry being parsed
  * @param xmlXPathObject*   Pointer to XPath object containing the data value(s) for the dictionary
  */
-inline void _add_xpath_result(Log_t *logp, PyObject *pydat, xmlXPathContext *xpctx, ptzMAP *map_p, xmlXPathObject *value) {
+static inline void _add_xpath_result(Log_t *logp, PyObject *pydat, xmlXPathContext *xpctx, ptzMAP *map_p, xmlXPathObject *value) {
         int i = 0;
         char *key = NULL;
         char *val = NULL;
@@ -797,16 +1019,16 @@ inline void _add_xpath_result(Log_t *logp, PyObject *pydat, xmlXPathContext *xpc
                 } else {
                         for( i = 0; i < value->nodesetval->nodeNr; i++ ) {
                                 if( _get_key_value(logp, key, 256, map_p, xpctx, i) != NULL ) {
-                                        dmixml_GetXPathContent(logp, val, 4097, value, i);
-                                        PyADD_DICT_VALUE(pydat, key, StringToPyObj(logp, map_p, val));
+                                        PyObject *pyval = XPathToPyObj(logp, map_p, value, i, val, 4097);
+                                        PyADD_DICT_VALUE(pydat, key, pyval);
                                 }
                         }
                 }
                 break;
         default:
                 if( _get_key_value(logp, key, 256, map_p, xpctx, 0) != NULL ) {
-                        dmixml_GetXPathContent(logp, val, 4097, value, 0);
-                        PyADD_DICT_VALUE(pydat, key, StringToPyObj(logp, map_p, val));
+                        PyObject *pyval = XPathToPyObj(logp, map_p, value, 0, val, 4097);
+                        PyADD_DICT_VALUE(pydat, key, pyval);
                 }
                 break;
         }
@@ -838,7 +1060,7 @@ PyObject *_deep_pythonize(Log_t *logp, PyObject *retdata,
 
         xpdoc = xmlNewDoc((xmlChar *) "1.0");
         assert( xpdoc != NULL );
-        xmlDocSetRootElement(xpdoc, xmlCopyNode(data_n, 1));
+        xmlDocSetRootElement(xpdoc, dmixml_CopyNode(data_n));
 
         xpctx = xmlXPathNewContext(xpdoc);
         assert( xpctx != NULL );
@@ -852,6 +1074,7 @@ PyObject *_deep_pythonize(Log_t *logp, PyObject *retdata,
         case ptzCONST:
                 if( _get_key_value(logp, key, 256, map_p, xpctx, 0) != NULL ) {
                         value = PyBytes_FromString(map_p->value);
+                        stats_add(py_objects, 1);
                         PyADD_DICT_VALUE(retdata, key, value);
                 } else {
                         PyReturnError(PyExc_ValueError, "Could not get key value: %s [%i] (Defining key: %s)",
@@ -879,6 +1102,7 @@ PyObject *_deep_pythonize(Log_t *logp, PyObject *retdata,
                         if( _get_key_value(logp, key, 256, map_p, xpctx, 0) != NULL ) {
                                 if( (xpo->nodesetval != NULL) && (xpo->nodesetval->nodeNr > 0) ) {
                                         value = PyList_New(0);
+                                        stats_add(py_objects, 1);
 
                                         // If we're working on a fixed list, create one which contains
                                         // only Py_None objects.  Otherwise the list will be filled with
@@ -892,7 +1116,6 @@ PyObject *_deep_pythonize(Log_t *logp, PyObject *retdata,
                                         for( i = 0; i < xpo->nodesetval->nodeNr; i++ ) {
                                                 char *valstr = NULL;
                                                 valstr = (char *) malloc(4098);
-                                                dmixml_GetXPathContent(logp, valstr, 4097, xpo, i);
 
                                                 // If we have a fixed list and we have a index value for the list
                                                 if( (map_p->fixed_list_size > 0) && (map_p->list_index != NULL) ) {
@@ -902,13 +1125,13 @@ PyObject *_deep_pythonize(Log_t *logp, PyObject *retdata,
                                                                                   map_p->list_index);
                                                         if( idx != NULL ) {
                                                                 PyList_SetItem(value, atoi(idx)-1,
-                                                                               StringToPyObj(logp,
-											     map_p, valstr)
+                                                                               XPathToPyObj(logp, map_p, xpo, i,
+                                                                                            valstr, 4097)
                                                                                );
                                                         }
                                                 } else {
                                                         // No list index - append the value
-                                                        PyList_Append(value,StringToPyObj(logp,map_p,valstr));
+                                                        PyList_Append(value,XPathToPyObj(logp,map_p,xpo,i,valstr,4097));
                                                 }
                                                 free(valstr);
                                         }
@@ -963,6 +1186,7 @@ PyObject *_deep_pythonize(Log_t *logp, PyObject *retdata,
 
                 // Prepare a data list
                 value = PyList_New(0);
+                stats_add(py_objects, 1);
 
                 // If we're working on a fixed list, create one which contains
                 // only Py_None objects.  Otherwise the list will be filled with
@@ -1035,6 +1259,7 @@ PyObject *pythonizeXMLnode(Log_t *logp, ptzMAP *in_map, xmlNode *data_n) {
 
         // Loop through all configured elements
         retdata = PyDict_New();
+        stats_add(py_objects, 1);
         foreach_xmlnode(in_map, map_p) {
                 if( (map_p->type_value == ptzDICT) && (map_p->rootpath != NULL) ) {
                         xmlXPathObject *xpo = NULL;
@@ -1043,7 +1268,7 @@ PyObject *pythonizeXMLnode(Log_t *logp, ptzMAP *in_map, xmlNode *data_n) {
                         // Set the root node in the XPath context
                         xpdoc = xmlNewDoc((xmlChar *) "1.0");
                         assert( xpdoc != NULL );
-                        xmlDocSetRootElement(xpdoc, xmlCopyNode(data_n, 1));
+                        xmlDocSetRootElement(xpdoc, dmixml_CopyNode(data_n));
 
                         xpctx = xmlXPathNewContext(xpdoc);
                         if( xpctx == NULL ) {
@@ -43,6 +43,8 @@ typedef struct ptzMAP_s {
         char *list_index ;      // Only to be used on fixed lists
         int emptyIsNone;        // If set to 1, empty input (right trimmed) strings sets the result to Py_None
         char *emptyValue;       // If set, this value will be used when input is empty
+        char *unitvalue;        // XPath to the node holding the number and unit attribute behind 'value'
+        int canonical;          // If set, 'value' points at unitvalue, converted to canonical units
         struct ptzMAP_s *child; // Only used for type_value == (ptzDICT || ptzLIST_DICT)
         struct ptzMAP_s *next;  // Pointer chain
 
@@ -53,6 +55,13 @@ ptzMAP *dmiMAP_ParseMappingXML_TypeID(Log_t *logp, xmlDoc *xmlmap, int typeid);
 ptzMAP *dmiMAP_ParseMappingXML_GroupName(Log_t *logp, xmlDoc *xmlmap, const char *mapname);
 #define ptzmap_Free(ptr) { ptzmap_Free_func(ptr); ptr = NULL; }
 void ptzmap_Free_func(ptzMAP *ptr);
+const char *ptzmap_GetValue(ptzMAP *val_m, const char *instr);
+void ptzmap_SetCanonicalUnits(ptzMAP *map_p);
+int ptzmap_CanonicalValue(xmlXPathObject *xpo, int idx, long *value);
+
+xmlXPathObject *_get_xpath_values(xmlXPathContext *xpctx, const char *xpath);
+char *_get_key_value(Log_t *logp, char *key, size_t buflen,
+                     ptzMAP *map_p, xmlXPathContext *xpctx, int idx);
 
 PyObject *pythonizeXMLdoc(Log_t *logp, ptzMAP *map, xmlDoc *xmldoc);
 PyObject *pythonizeXMLnode(Log_t *logp, ptzMAP *map, xmlNode *nodes);